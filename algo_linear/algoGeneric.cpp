@@ -1,6 +1,71 @@
 #include "algoGeneric.h"
 
+#include <chess/board_impl.h>
+#include <common/mappedFile.h>
+#include <nlohmann/json.hpp>
+
 #include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <unordered_set>
+
+
+namespace {
+
+	// mixed into a position hash so that transpositions are only shared at equal depth
+	inline std::uint64_t depthKey(unsigned int depth)
+	{
+		return 0x9E3779B97F4A7C15ULL * (depth + 1);
+	}
+
+	const char treeMagic[4] = { 'S', 'P', 'G', 'T' };
+	const std::uint32_t treeVersion = 2;
+
+	struct TreeHeader {
+		char magic[4];
+		std::uint32_t version;
+		std::uint64_t rootHash;
+		std::uint64_t evalKey;
+		std::uint32_t round;
+		std::uint32_t shareTranspositions;
+		std::uint64_t numNodes;
+		std::uint64_t numEdges;
+		std::uint64_t fenBytes;
+		std::int64_t leafExpansions;
+		std::int64_t nodesCreated;
+		std::int64_t transpositionHits;
+		std::int64_t evaluations;
+		std::int64_t evalCacheHits;
+		std::int64_t evalCacheMisses;
+		std::int64_t evalMissNanoseconds;
+	};
+
+	struct NodeRecord {
+		double score;
+		std::uint64_t hash;
+		std::uint32_t depth;
+		std::int32_t direction;
+		std::uint32_t firstEdge;
+		std::uint32_t numEdges;
+		std::uint32_t fenOffset;
+		std::uint32_t fenLength;     // 0 for a node without board
+		std::uint32_t transposition; // 1 when in the transposition table
+		std::uint32_t padding;
+	};
+
+	struct EdgeRecord {
+		std::int8_t sourceRank;
+		std::int8_t sourceFile;
+		std::int8_t destinationRank;
+		std::int8_t destinationFile;
+		std::int8_t promotedPiece;
+		std::int8_t padding[3];
+		std::uint32_t child;          // node index
+	};
+
+} // end anonymous namespace
 
 
 namespace space {
@@ -13,6 +78,13 @@ namespace space {
 	{
 		// this->fen = Fen::fromBoard(v_board, 0, 0).fen;
 		this->direction = colorToSign(v_board->whoPlaysNext());
+		this->hash = v_board->getHash();
+		++this->objectCount;
+	}
+
+	Node::Node(double s, unsigned int v_depth, int v_direction, std::uint64_t v_hash) :
+		direction(v_direction), depth(v_depth), score(s), hash(v_hash)
+	{
 		++this->objectCount;
 	}
 
@@ -40,6 +112,20 @@ namespace space {
 		return count;
 	}
 
+	int Node::uniqueFamilySize() const
+	{
+		std::unordered_set<const Node*> seen{ this };
+		std::vector<const Node*> stack{ this };
+		while (!stack.empty()) {
+			const Node* node = stack.back();
+			stack.pop_back();
+			for (const auto& child : node->children)
+				if (seen.insert(child.second.get()).second)
+					stack.push_back(child.second.get());
+		}
+		return static_cast<int>(seen.size());
+	}
+
 	// ---------   Pruning & Folding   --------
 
 
@@ -70,7 +156,11 @@ namespace space {
 
 		std::vector<Move> moves = this->pruning(sv,nMoves, sDelta,  node->direction);
 		for (const Move& m : moves) {
-			node->children.erase(m);
+			auto it = node->children.find(m);
+			if (it == node->children.end())
+				continue;
+			--it->second->parents; // a shared child stays on its other lines
+			node->children.erase(it);
 		}
 	}
 
@@ -125,47 +215,250 @@ namespace space {
 
 	AlgoGeneric::Score AlgoGeneric::getLinearScore(IBoard::Ptr board)
 	{
-		Score whiteScore = 0,blackScore = 0;
-		for (const auto v : this->wts) {
-			whiteScore += v.first->getValue(board, Color::White) * v.second;
-			blackScore += v.first->getValue(board, Color::Black) * v.second;
+		this->evaluations.fetch_add(1, std::memory_order_relaxed);
+		if (!this->evalCache)
+			return this->evaluate(board);
+		bool hit;
+		Score score = this->evalCache->getOrCompute(board->getHash(), this->getEvalKey(),
+			[this, &board]() {
+				auto start = std::chrono::steady_clock::now();
+				Score computed = this->evaluate(board);
+				this->countMisses(1, std::chrono::steady_clock::now() - start);
+				return computed;
+			}, hit);
+		if (hit)
+			this->evalCacheHits.fetch_add(1, std::memory_order_relaxed);
+		return score;
+	}
+
+	void AlgoGeneric::getLinearScores(const std::vector<IBoard::Ptr>& boards, std::vector<Score>& scores)
+	{
+		this->getScores(boards, scores, nullptr, nullptr);
+	}
+
+	void AlgoGeneric::getLinearScores(const IBoard& parent, const std::vector<std::pair<Move, IBoard::Ptr>>& children, std::vector<Score>& scores)
+	{
+		std::vector<IBoard::Ptr> boards;
+		std::vector<Move> moves;
+		for (const auto& mb : children) {
+			moves.push_back(mb.first);
+			boards.push_back(mb.second);
+		}
+		this->getScores(boards, scores, &parent, &moves);
+	}
+
+	void AlgoGeneric::getScores(const std::vector<IBoard::Ptr>& boards, std::vector<Score>& scores,
+		const IBoard* parent, const std::vector<Move>* moves)
+	{
+		scores.resize(boards.size());
+		this->evaluations.fetch_add(boards.size(), std::memory_order_relaxed);
+		if (!this->evalCache) {
+			this->evaluateBatch(boards, scores, parent, moves);
+			return;
 		}
-		return whiteScore - blackScore;
+
+		std::vector<IBoard::Ptr> missing;
+		std::vector<Move> missingMoves;
+		std::vector<std::size_t> missingIndex;
+		for (std::size_t i = 0; i < boards.size(); i++) {
+			if (!this->evalCache->probe(boards[i]->getHash(), this->getEvalKey(), scores[i])) {
+				missing.push_back(boards[i]);
+				if (moves)
+					missingMoves.push_back((*moves)[i]);
+				missingIndex.push_back(i);
+			}
+		}
+		this->evalCacheHits.fetch_add(boards.size() - missing.size(), std::memory_order_relaxed);
+		if (missing.empty())
+			return;
+
+		auto start = std::chrono::steady_clock::now();
+		std::vector<Score> missingScores;
+		this->evaluateBatch(missing, missingScores, parent, moves ? &missingMoves : nullptr);
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		this->countMisses(missing.size(), elapsed);
+		for (std::size_t j = 0; j < missing.size(); j++) {
+			scores[missingIndex[j]] = missingScores[j];
+			this->evalCache->store(missing[j]->getHash(), this->getEvalKey(), missingScores[j], elapsed.count() / missing.size());
+		}
+	}
+
+	void AlgoGeneric::countMisses(std::size_t count, std::chrono::duration<double> elapsed)
+	{
+		this->evalCacheMisses.fetch_add(count, std::memory_order_relaxed);
+		this->evalMissNanoseconds.fetch_add((long long)(elapsed.count() * 1e9), std::memory_order_relaxed);
+	}
+
+	AlgoGeneric::Score AlgoGeneric::evaluate(const IBoard::Ptr& board) const
+	{
+		return this->nnue ? this->nnue->evaluate(board) : this->evaluator.evaluate(board);
+	}
+
+	void AlgoGeneric::evaluateBatch(const std::vector<IBoard::Ptr>& boards, std::vector<Score>& scores,
+		const IBoard* parent, const std::vector<Move>* moves) const
+	{
+		if (!this->nnue) {
+			this->evaluator.evaluateBatch(boards, scores);
+			return;
+		}
+
+		scores.resize(boards.size());
+		if (!parent || !moves) {
+			for (std::size_t i = 0; i < boards.size(); i++)
+				scores[i] = this->nnue->evaluate(boards[i]);
+			return;
+		}
+
+		// the parent accumulator is built once, each child only applies its move
+		NnueEvaluator::Accumulator parentAcc, childAcc;
+		this->nnue->refresh(*parent, parentAcc);
+		for (std::size_t i = 0; i < boards.size(); i++) {
+			this->nnue->update(parentAcc, *parent, (*moves)[i], *boards[i], childAcc);
+			scores[i] = this->nnue->evaluate(childAcc, boards[i]->whoPlaysNext());
+		}
+	}
+
+	AlgoGeneric::Stats AlgoGeneric::getStats() const
+	{
+		Stats result = this->stats;
+		result.evaluations = this->evaluations.load();
+		result.evalCacheHits = this->evalCacheHits.load();
+		long long misses = this->evalCacheMisses.load();
+		if (misses > 0)
+			result.evalSecondsSaved = result.evalCacheHits * (this->evalMissNanoseconds.load() * 1e-9 / misses);
+		return result;
+	}
+
+	void AlgoGeneric::setWeights(const FeatureMap& v_wts)
+	{
+		this->wts = v_wts;
+		this->evaluator = LinearEvaluator(v_wts);
+	}
+
+	void AlgoGeneric::resetRoot(IBoard::Ptr board)
+	{
+		this->root = std::make_shared<Node>(Node(board,
+											this->getLinearScore(board),
+											0));
+		this->stats = Stats();
+		this->stats.nodesCreated = 1;
+		this->evaluations = 0;
+		this->evalCacheHits = 0;
+		this->evalCacheMisses = 0;
+		this->evalMissNanoseconds = 0;
+		this->transpositions.clear();
 	}
 
 	void AlgoGeneric::expand()
 	{
-		this->expand(this->root);
+		++this->pass;
+		std::vector<Node*> path;
+		this->expand(this->root, path);
 	}
 
-	void AlgoGeneric::expand(Node::Ptr node)
+	void AlgoGeneric::expand(Node::Ptr node, std::vector<Node*>& path)
 	{
-		if (node->children.size() == 0)
-			this->expandLeafNode(node);
+		if (node->visitedPass == this->pass) // shared node, already reached through another parent
+			return;
+		node->visitedPass = this->pass;
+
+		if (node->children.size() == 0) {
+			if (node->board.has_value()) // expanded nodes without moves have no board left
+				this->expandLeafNode(node, path);
+		}
 		else {
+			path.push_back(node.get());
 			for (auto& mn : node->children) {
-				this->expand(mn.second);
+				this->expand(mn.second, path);
 			}
+			path.pop_back();
 		}
 	}
 
-	void AlgoGeneric::expandLeafNode(Node::Ptr node)
+	// A move from node to childHash repeats the position of an ancestor. It is
+	// a draw on every line through node only when the nodes from below that
+	// ancestor down to node have one parent each; they are then taken out of
+	// the transposition table, so that no other line comes to share them.
+	bool AlgoGeneric::isRepetitionDraw(Node* node, const std::vector<Node*>& path, std::uint64_t childHash)
+	{
+		std::size_t below = path.size() + 1; // first node of the line below the repeated position
+		if (childHash != node->hash) {
+			auto it = std::find_if(path.rbegin(), path.rend(), [childHash](const Node* n) { return n->hash == childHash; });
+			if (it == path.rend())
+				return false; // no repetition
+			below = std::size_t(path.rend() - it);
+		}
+
+		auto line = [&path, node](std::size_t i) { return i < path.size() ? path[i] : node; };
+		for (std::size_t i = below; i <= path.size(); i++)
+			if (line(i)->parents > 1)
+				return false;
+		for (std::size_t i = below; i <= path.size(); i++) {
+			Node* n = line(i);
+			auto it = this->transpositions.find(n->hash ^ depthKey(n->depth));
+			if (it != this->transpositions.end() && it->second.lock().get() == n)
+				this->transpositions.erase(it);
+		}
+		return true;
+	}
+
+	// path holds the ancestors of node, root first
+	void AlgoGeneric::expandLeafNode(Node::Ptr node, const std::vector<Node*>& path)
 	{		
 		space_assert(node->board.has_value(), "A leaf node must have board object");
 		IBoard::MoveMap allMoves = node->board.value()->getValidMoves();
+		++this->stats.leafExpansions;
+		unsigned int childDepth = node->depth + 1;
+		std::vector<std::pair<Move, IBoard::Ptr>> newChildren;
+		std::vector<std::uint64_t> newKeys;
 		for (const auto& mb : allMoves) 
 		{
-			Score score;
-			if (mb.second->isCheckMate()) {
-				int direction = colorToSign(mb.second->whoPlaysNext());
-				score = AlgoGeneric::scoreMax * direction;
+			std::uint64_t transpositionKey = 0;
+			if (this->shareTranspositions) {
+				std::uint64_t childHash = mb.second->getHash();
+				if (this->isRepetitionDraw(node.get(), path, childHash)) {
+					// repeats a position on every line to here: a draw, never expanded
+					auto child = std::make_shared<Node>(Node(mb.second, 0, childDepth));
+					child->board = std::nullopt;
+					node->children[mb.first] = child;
+					++this->stats.nodesCreated;
+					continue;
+				}
+
+				transpositionKey = childHash ^ depthKey(childDepth);
+				auto it = this->transpositions.find(transpositionKey);
+				if (it != this->transpositions.end()) {
+					if (auto shared = it->second.lock()) {
+						node->children[mb.first] = shared;
+						++shared->parents;
+						++this->stats.transpositionHits;
+						continue;
+					}
+				}
 			}
-			else if (mb.second->isStaleMate())
+
+			newChildren.push_back(mb);
+			newKeys.push_back(transpositionKey);
+		}
+
+		// all new children are scored in one batch
+		std::vector<Score> scores;
+		this->getLinearScores(*node->board.value(), newChildren, scores);
+
+		for (std::size_t i = 0; i < newChildren.size(); i++)
+		{
+			const IBoard::Ptr& board = newChildren[i].second;
+			Score score = scores[i];
+			if (board->isCheckMate()) // the side to move has lost
+				score = -AlgoGeneric::scoreMax * colorToSign(board->whoPlaysNext());
+			else if (board->isStaleMate())
 				score = 0;
-			else
-				score = 42.0; // this->getLinearScore(mb.second); // 18 * urand();
-			Node childNode = Node(mb.second, score, node->depth + 1);
-			node->children[mb.first] = std::make_shared<Node>(childNode);
+			Node childNode = Node(board, score, childDepth);
+			auto child = std::make_shared<Node>(childNode);
+			node->children[newChildren[i].first] = child;
+			++this->stats.nodesCreated;
+			if (this->shareTranspositions)
+				this->transpositions[newKeys[i]] = child;
 		}
 		node->board = std::nullopt;
 	}
@@ -178,10 +471,12 @@ namespace space {
 	//         fold to get (updated) score for current node
 	//         delete board if present 
 	// Q: stack overflow ? seems max_memory <= height of tree + max Children coount
+	// Shared nodes are pruned and folded once per pass, whichever parent reaches them first.
 
 
 	void AlgoGeneric::refresh()
 	{
+		++this->pass;
 		refreshNode(this->root);
 	}
 
@@ -190,6 +485,9 @@ namespace space {
 		if (node->children.size() == 0) { // Nothing to do for leaf nodes
 			return;
 		}
+		if (node->visitedPass == this->pass)
+			return;
+		node->visitedPass = this->pass;
 		for (auto child : node->children) {
 			this->refreshNode(child.second);
 		}		
@@ -197,6 +495,192 @@ namespace space {
 		this->rec->fold(node);
 	}
 
+	int AlgoGeneric::treeSize() const
+	{
+		return this->shareTranspositions ? this->root->uniqueFamilySize() : this->root->familySize();
+	}
+
+
+	//-------------------------------------------------------------------------
+	// checkpoints
+
+	void AlgoGeneric::setCheckpoint(const std::string& path, double seconds, std::function<void(int round)> onSaved)
+	{
+		this->checkpointPath = path;
+		this->checkpointSeconds = seconds;
+		this->onCheckpoint = onSaved;
+	}
+
+	int AlgoGeneric::resumeRoot(IBoard::Ptr board)
+	{
+		this->lastCheckpoint = std::chrono::steady_clock::now();
+		if (!this->checkpointPath.empty())
+			if (auto round = this->loadTree(this->checkpointPath, board))
+				return round.value();
+		this->resetRoot(board);
+		return 0;
+	}
+
+	void AlgoGeneric::checkpoint(int round)
+	{
+		if (this->checkpointPath.empty())
+			return;
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - this->lastCheckpoint;
+		if (elapsed.count() < this->checkpointSeconds)
+			return;
+		this->saveTree(this->checkpointPath, round);
+		this->lastCheckpoint = std::chrono::steady_clock::now();
+		if (this->onCheckpoint)
+			this->onCheckpoint(round);
+	}
+
+	void AlgoGeneric::endCheckpoints()
+	{
+		if (!this->checkpointPath.empty())
+			std::remove(this->checkpointPath.c_str());
+	}
+
+	void AlgoGeneric::saveTree(const std::string& path, int round) const
+	{
+		std::unordered_set<const Node*> inTable;
+		for (const auto& entry : this->transpositions)
+			if (auto node = entry.second.lock())
+				inTable.insert(node.get());
+
+		// breadth-first, a shared node numbered when first reached
+		std::vector<const Node*> order{ this->root.get() };
+		std::unordered_map<const Node*, std::uint32_t> indices{ { this->root.get(), 0 } };
+		std::vector<NodeRecord> nodes;
+		std::vector<EdgeRecord> edges;
+		std::string fens;
+		for (std::size_t i = 0; i < order.size(); i++) {
+			const Node* node = order[i];
+			NodeRecord record = {};
+			record.score = node->score;
+			record.hash = node->hash;
+			record.depth = node->depth;
+			record.direction = node->direction;
+			record.firstEdge = std::uint32_t(edges.size());
+			record.numEdges = std::uint32_t(node->children.size());
+			record.transposition = inTable.count(node) ? 1 : 0;
+			if (node->board.has_value()) {
+				std::string fen = Fen::fromBoard(node->board.value(), 0, 0).fen;
+				record.fenOffset = std::uint32_t(fens.size());
+				record.fenLength = std::uint32_t(fen.size());
+				fens += fen;
+			}
+			nodes.push_back(record);
+
+			for (const auto& mc : node->children) {
+				auto inserted = indices.emplace(mc.second.get(), std::uint32_t(order.size()));
+				if (inserted.second)
+					order.push_back(mc.second.get());
+				const Move& move = mc.first;
+				EdgeRecord edge = {};
+				edge.sourceRank = std::int8_t(move.sourceRank);
+				edge.sourceFile = std::int8_t(move.sourceFile);
+				edge.destinationRank = std::int8_t(move.destinationRank);
+				edge.destinationFile = std::int8_t(move.destinationFile);
+				edge.promotedPiece = std::int8_t(move.promotedPiece);
+				edge.child = inserted.first->second;
+				edges.push_back(edge);
+			}
+		}
+
+		TreeHeader header = {};
+		std::memcpy(header.magic, treeMagic, sizeof header.magic);
+		header.version = treeVersion;
+		header.rootHash = this->root->hash;
+		header.evalKey = this->getEvalKey();
+		header.round = std::uint32_t(round);
+		header.shareTranspositions = this->shareTranspositions ? 1 : 0;
+		header.numNodes = nodes.size();
+		header.numEdges = edges.size();
+		header.fenBytes = fens.size();
+		header.leafExpansions = this->stats.leafExpansions;
+		header.nodesCreated = this->stats.nodesCreated;
+		header.transpositionHits = this->stats.transpositionHits;
+		header.evaluations = this->evaluations.load();
+		header.evalCacheHits = this->evalCacheHits.load();
+		header.evalCacheMisses = this->evalCacheMisses.load();
+		header.evalMissNanoseconds = this->evalMissNanoseconds.load();
+
+		std::size_t nodeBytes = nodes.size() * sizeof(NodeRecord), edgeBytes = edges.size() * sizeof(EdgeRecord);
+		replaceFile(path, sizeof header + nodeBytes + edgeBytes + fens.size(), [&](char* data) {
+			std::memcpy(data, &header, sizeof header);
+			data += sizeof header;
+			std::memcpy(data, nodes.data(), nodeBytes);
+			data += nodeBytes;
+			if (edgeBytes > 0)
+				std::memcpy(data, edges.data(), edgeBytes);
+			data += edgeBytes;
+			if (!fens.empty())
+				std::memcpy(data, fens.data(), fens.size());
+		});
+	}
+
+	std::optional<int> AlgoGeneric::loadTree(const std::string& path, const IBoard::Ptr& board)
+	{
+		if (!std::ifstream(path).good())
+			return std::nullopt;
+		MappedFile file(path, MappedFile::Mode::Read);
+		TreeHeader header;
+		if (file.size() < sizeof header)
+			throw std::runtime_error("Not a search tree snapshot: " + path);
+		std::memcpy(&header, file.data(), sizeof header);
+		if (std::memcmp(header.magic, treeMagic, sizeof header.magic) != 0 || header.version != treeVersion)
+			throw std::runtime_error("Not a search tree snapshot of version 2: " + path);
+		if (header.rootHash != board->getHash() || header.evalKey != this->getEvalKey()
+			|| header.shareTranspositions != (this->shareTranspositions ? 1u : 0u))
+			return std::nullopt;
+		if (header.numNodes == 0
+			|| file.size() != sizeof header + header.numNodes * sizeof(NodeRecord) + header.numEdges * sizeof(EdgeRecord) + header.fenBytes)
+			throw std::runtime_error("Search tree snapshot " + path + " has the wrong size");
+
+		// the records are read in place, the boards parsed from their FEN
+		const NodeRecord* records = reinterpret_cast<const NodeRecord*>(file.data() + sizeof header);
+		const EdgeRecord* edges = reinterpret_cast<const EdgeRecord*>(records + header.numNodes);
+		const char* fens = reinterpret_cast<const char*>(edges + header.numEdges);
+		std::vector<Node::Ptr> nodes(header.numNodes);
+		for (std::size_t i = 0; i < nodes.size(); i++) {
+			const NodeRecord& record = records[i];
+			if (record.fenLength > 0) {
+				IBoard::Ptr nodeBoard = BoardImpl::fromFen(Fen(std::string(fens + record.fenOffset, record.fenLength)));
+				nodes[i] = std::make_shared<Node>(Node(nodeBoard, record.score, record.depth));
+			}
+			else
+				nodes[i] = std::make_shared<Node>(Node(record.score, record.depth, record.direction, record.hash));
+		}
+
+		this->transpositions.clear();
+		for (auto& node : nodes)
+			node->parents = 0;
+		nodes[0]->parents = 1; // the root, on every line
+		for (std::size_t i = 0; i < nodes.size(); i++) {
+			const NodeRecord& record = records[i];
+			for (std::uint32_t k = 0; k < record.numEdges; k++) {
+				const EdgeRecord& edge = edges[record.firstEdge + k];
+				Move move(edge.sourceRank, edge.sourceFile, edge.destinationRank, edge.destinationFile, PieceType(edge.promotedPiece));
+				nodes[i]->children[move] = nodes[edge.child];
+				++nodes[edge.child]->parents;
+			}
+			if (record.transposition)
+				this->transpositions[record.hash ^ depthKey(record.depth)] = nodes[i];
+		}
+
+		this->root = nodes[0];
+		this->stats = Stats();
+		this->stats.leafExpansions = int(header.leafExpansions);
+		this->stats.nodesCreated = int(header.nodesCreated);
+		this->stats.transpositionHits = int(header.transpositionHits);
+		this->evaluations = header.evaluations;
+		this->evalCacheHits = header.evalCacheHits;
+		this->evalCacheMisses = header.evalCacheMisses;
+		this->evalMissNanoseconds = header.evalMissNanoseconds;
+		this->pass = 0;
+		return int(header.round);
+	}
+
 
 
 
@@ -205,24 +689,60 @@ namespace space {
 
 
 
-	Algo442::Algo442()
+	AlgoGeneric::FeatureMap AlgoGeneric::getDefaultWeights()
 	{
+		FeatureMap wts;
 		//feature with wts
-		this->wts[std::make_shared<Feature_Piece>(Feature_Piece(PieceType::Pawn))] = 1;
-		this->wts[std::make_shared<Feature_Piece>(Feature_Piece(PieceType::Knight))] = 3;
-		this->wts[std::make_shared<Feature_Piece>(Feature_Piece(PieceType::Bishop))] = 3.2;
-		this->wts[std::make_shared<Feature_Piece>(Feature_Piece(PieceType::Rook))] = 5;
-		this->wts[std::make_shared<Feature_Piece>(Feature_Piece(PieceType::Queen))] = 9;
+		wts[std::make_shared<Feature_Piece>(Feature_Piece(PieceType::Pawn))] = 1;
+		wts[std::make_shared<Feature_Piece>(Feature_Piece(PieceType::Knight))] = 3;
+		wts[std::make_shared<Feature_Piece>(Feature_Piece(PieceType::Bishop))] = 3.2;
+		wts[std::make_shared<Feature_Piece>(Feature_Piece(PieceType::Rook))] = 5;
+		wts[std::make_shared<Feature_Piece>(Feature_Piece(PieceType::Queen))] = 9;
 		
 		for(int file = 0; file< 8; file++)
-			this->wts[std::make_shared<Feature_PawnRank>(Feature_PawnRank(file))] = 0.2;
+			wts[std::make_shared<Feature_PawnRank>(Feature_PawnRank(file))] = 0.2;
 
-		//this->wts[std::make_shared<Feature_PassedPawn>(Feature_PassedPawn())] = 0.2;
-		
-		
-		// this->wts[std::make_shared<Feature_MoveCount>(Feature_MoveCount())] = 0.1;
+		//wts[std::make_shared<Feature_PassedPawn>(Feature_PassedPawn())] = 0.2;
 		
 		
+		// wts[std::make_shared<Feature_MoveCount>(Feature_MoveCount())] = 0.1;
+
+		return wts;
+	}
+
+
+
+	AlgoGeneric::FeatureMap AlgoGeneric::loadWeights(const std::string& path)
+	{
+		std::ifstream in(path);
+		if (!in)
+			throw std::runtime_error("Cannot open weights file " + path);
+		nlohmann::json config;
+		in >> config;
+		space_assert(config.is_object(), "A weights file holds an object of feature name to weight");
+
+		FeatureMap result;
+		for (const auto& item : config.items())
+			result[Feature::fromString(item.key())] = item.value().get<double>();
+		return result;
+	}
+
+	void AlgoGeneric::saveWeights(const FeatureMap& v_wts, const std::string& path)
+	{
+		nlohmann::json config = nlohmann::json::object();
+		for (const auto& fw : v_wts)
+			config[fw.first->toString()] = fw.second;
+		std::ofstream out(path);
+		out << config.dump(4) << std::endl;
+		if (!out)
+			throw std::runtime_error("Cannot write weights file " + path);
+	}
+
+
+
+	Algo442::Algo442()
+	{
+		this->setWeights(getDefaultWeights());
 
 		// pruning
 		this->prune = std::make_shared<Pruning_Cutoff>(Pruning_Cutoff(8, 10, true));
@@ -236,37 +756,13 @@ namespace space {
 
 	Move Algo442::getNextMove(IBoard::Ptr board)
 	{
-		root = std::make_shared<Node>(Node(board, 
-											this->getLinearScore(board),
-											0));
-
-	/*	for (int k = 0; k < 8; k++) {
+		const int rounds = 4;
+		for (int round = resumeRoot(board); round < rounds; round++) {
 			expand();
 			refresh();
-		}  */
-
-		int gameTreeSize;
-
-		expand(); 
-		gameTreeSize = root->familySize();
-		refresh();
-		gameTreeSize = root->familySize();
-		
-		expand();
-		gameTreeSize = root->familySize();
-		refresh();
-		gameTreeSize = root->familySize();
-		
-		expand();
-		gameTreeSize = root->familySize();
-		refresh();
-		gameTreeSize = root->familySize();
-
-		expand();
-		gameTreeSize = root->familySize();
-		refresh();
-		gameTreeSize = root->familySize();
-
+			checkpoint(round + 1);
+		}
+		endCheckpoints();
 
 		return this->root->bestMove();
 	}
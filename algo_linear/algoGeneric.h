@@ -6,6 +6,13 @@
 #include <common/base.h>
 
 #include "feature.h"
+#include "evalCache.h"
+#include "nnue.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <unordered_map>
 
 
 
@@ -24,6 +31,9 @@ namespace space {
 
 		NodeMap children;
 		Score score;
+		std::uint64_t hash = 0; // position hash of the board
+		unsigned int visitedPass = 0; // last expand/refresh pass that reached this node
+		unsigned int parents = 1; // edges into this node, more than one once shared as a transposition
 
 		Node() 
 		{
@@ -32,9 +42,11 @@ namespace space {
 		Node& operator=(const Node&) = default;
 		Node(const Node&) = default;
 		Node(IBoard::Ptr v_board, double s, unsigned int v_depth);
+		Node(double s, unsigned int v_depth, int v_direction, std::uint64_t v_hash); // without board, as restored from a snapshot
 
 		Move bestMove(); // move with best score among children
-		int familySize() const; // for analysis only
+		int familySize() const; // for analysis only, counts shared nodes once per path
+		int uniqueFamilySize() const; // for analysis only, counts shared nodes once
 
 		static int objectCount;
 
@@ -100,29 +112,100 @@ namespace space {
 
 		AlgoGeneric() {}
 		AlgoGeneric(FeatureMap v_wts, Pruning::Ptr v_pr, Fold::Ptr v_rc) :
-		   wts(v_wts), prune(v_pr), rec(v_rc){}
+		   wts(v_wts), evaluator(v_wts), prune(v_pr), rec(v_rc){}
 
 		static constexpr Score scoreMax = 1e8; 
 		
-		Score getLinearScore(IBoard::Ptr board);
+		Score getLinearScore(IBoard::Ptr board); // through the eval cache
+		// batch of the cache misses
+		void getLinearScores(const std::vector<IBoard::Ptr>& boards, std::vector<Score>& scores);
+		// children of parent by move; a network updates them from the accumulator of parent
+		void getLinearScores(const IBoard& parent, const std::vector<std::pair<Move, IBoard::Ptr>>& children, std::vector<Score>& scores);
+		void setWeights(const FeatureMap& v_wts);
+		void setEvalCache(EvalCache::Ptr cache) { evalCache = cache; } // nullptr evaluates every time
+		void setNnue(NnueEvaluator::Ptr network) { nnue = network; } // replaces the linear score, nullptr restores it
+		static FeatureMap getDefaultWeights(); // hand-set weights of Algo442
+		// JSON object of feature name to weight, as written by the Texel tuner
+		static FeatureMap loadWeights(const std::string& path);
+		static void saveWeights(const FeatureMap& v_wts, const std::string& path);
+
+		struct Stats {
+			int leafExpansions = 0;    // calls to getValidMoves
+			int nodesCreated = 0;
+			int transpositionHits = 0; // children linked to an existing node instead of created
+			long long evaluations = 0;
+			long long evalCacheHits = 0;
+			double evalSecondsSaved = 0; // estimated from the average cost of this search's misses
+		};
+		Stats getStats() const;
+
+		// Share nodes between move orders that reach the same position at the
+		// same depth, turning the game tree into a DAG. A move repeating a
+		// position of its line is a draw only for the lines through that
+		// position: it is scored as one when the nodes below the repeated
+		// position have a single parent, which then stop being shared; below
+		// a node already shared the repetition is searched like any move.
+		void setShareTranspositions(bool share) { shareTranspositions = share; }
+
+		// Snapshots of the tree after expand/refresh rounds, at most every
+		// `seconds`, for resuming a long search that was interrupted: a later
+		// search from the same position with the same evaluation loads the tree
+		// and goes on with the next round. The file is removed once the search
+		// ends; an empty path takes no snapshot. onSaved, optional, follows each.
+		void setCheckpoint(const std::string& path, double seconds = 0, std::function<void(int round)> onSaved = nullptr);
 
 
 	protected:
 		FeatureMap wts;
+		LinearEvaluator evaluator; // wts flattened, set together with wts
 		Pruning::Ptr prune;
 		Fold::Ptr rec;
+		EvalCache::Ptr evalCache = EvalCache::getShared();
+		NnueEvaluator::Ptr nnue;
+		std::atomic<long long> evaluations{ 0 };   // atomic, as threads of AlgoMcts evaluate concurrently
+		std::atomic<long long> evalCacheHits{ 0 };
+		std::atomic<long long> evalCacheMisses{ 0 };     // evaluated for the cache, and their time
+		std::atomic<long long> evalMissNanoseconds{ 0 };
 
 
 		// storage objects
 		Node::Ptr root;
+		Stats stats;
+		bool shareTranspositions = false;
+		unsigned int pass = 0;
+		std::unordered_map<std::uint64_t, std::weak_ptr<Node>> transpositions; // by position hash and depth
+		std::string checkpointPath;
+		double checkpointSeconds = 0;
+		std::function<void(int round)> onCheckpoint;
+		std::chrono::steady_clock::time_point lastCheckpoint;
 
 
 		// helper functions
+		std::uint64_t getEvalKey() const { return nnue ? nnue->getKey() : evaluator.getKey(); }
+		Score evaluate(const IBoard::Ptr& board) const; // uncached, network or linear
+		void countMisses(std::size_t count, std::chrono::duration<double> elapsed); // evaluated for the cache
+		// parent and moves, when given, let a network update the children incrementally
+		void getScores(const std::vector<IBoard::Ptr>& boards, std::vector<Score>& scores,
+			const IBoard* parent, const std::vector<Move>* moves); // through the eval cache
+		void evaluateBatch(const std::vector<IBoard::Ptr>& boards, std::vector<Score>& scores,
+			const IBoard* parent, const std::vector<Move>* moves) const; // uncached
+		void resetRoot(IBoard::Ptr board); // new root, clears stats and transpositions
 		void expand();
-		void expand(Node::Ptr node); // expand all leaf nodes to one more level
-		void expandLeafNode(Node::Ptr node); // expand leaf node one level to all possible subsequent moves
+		void expand(Node::Ptr node, std::vector<Node*>& path); // expand all leaf nodes to one more level
+		void expandLeafNode(Node::Ptr node, const std::vector<Node*>& path); // expand leaf node one level to all possible subsequent moves
+		bool isRepetitionDraw(Node* node, const std::vector<Node*>& path, std::uint64_t childHash); // unshares the line it depends on
 		void refresh(); // pruning & folding alternately from bottom-up
 		void refreshNode(Node::Ptr node); // for a single node
+		int treeSize() const;
+
+		// The tree in one file of fixed-size records: a header, the nodes in
+		// breadth-first order, shared ones once, the moves to their children as
+		// node indices, then the FEN of the leaf boards.
+		void saveTree(const std::string& path, int round) const;
+		std::optional<int> loadTree(const std::string& path, const IBoard::Ptr& board); // rounds done; nullopt when absent or of another search
+		int resumeRoot(IBoard::Ptr board); // rounds done by the checkpoint resumed, or 0 with a new root
+		void checkpoint(int round);        // snapshot after round when one is due
+		void endCheckpoints();
 
 	};
 
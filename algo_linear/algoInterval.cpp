@@ -1,38 +1,95 @@
 #include "algoInterval.h"
 
+#include "algoGeneric.h"
+#include "evalCache.h"
+
+#include <chess/algo_factory.h>
+
 #include <algorithm>
 
 
+namespace {
+
+	// bounds of an interval as seen by the player moving in direction
+	inline double optimisticFor(int direction, const space::Interval& i) {
+		return direction > 0 ? i.right : i.left;
+	}
+	inline double pessimisticFor(int direction, const space::Interval& i) {
+		return direction > 0 ? i.left : i.right;
+	}
+
+} // end anonymous namespace
+
 
 namespace space {
-	NodeInterval::NodeInterval(IBoard::Ptr v_board, unsigned int v_depth)
+
+	int NodeInterval::objectCount;
+
+	NodeInterval::NodeInterval(IBoard::Ptr v_board, unsigned int v_depth) :
+		board(v_board), depth(v_depth), iscore{ 0, 0 }
 	{
-		//TODO;
+		this->direction = colorToSign(v_board->whoPlaysNext());
+		++this->objectCount;
 	}
+
 	int space::NodeInterval::familySize() const
 	{
-		return 0;  //TODO
+		int count = 1;
+		for (const auto& child : this->children)
+			count += child.second->familySize();
+		return count;
 	}
 
 
 
-	void AlgoInterval::prune(NodeInterval::Ptr)
-	{  //TODO
+	// B* pruning: a child whose optimistic bound is worse than the
+	// pessimistic bound of a sibling can never become the best move.
+	void AlgoInterval::prune(NodeInterval::Ptr node)
+	{
+		if (node->children.size() < 2)
+			return;
+		int direction = node->direction;
+		double bestPessimistic = -scoreMax * 2;
+		for (const auto& child : node->children)
+			bestPessimistic = std::max(bestPessimistic, direction * pessimisticFor(direction, child.second->iscore));
+
+		for (auto it = node->children.begin(); it != node->children.end(); ) {
+			if (direction * optimisticFor(direction, it->second->iscore) < bestPessimistic)
+				it = node->children.erase(it);
+			else
+				++it;
+		}
 	}
 
-	void AlgoInterval::fold(NodeInterval::Ptr)
-	{  //TODO
+	// both bounds of a node are the best bound the player to move can get from a child
+	void AlgoInterval::fold(NodeInterval::Ptr node)
+	{
+		if (node->children.size() == 0)
+			return;
+		int direction = node->direction;
+		auto first = node->children.begin()->second->iscore;
+		Interval result = first;
+		for (const auto& child : node->children) {
+			const Interval& ci = child.second->iscore;
+			if (direction * (ci.left - result.left) > 0)
+				result.left = ci.left;
+			if (direction * (ci.right - result.right) > 0)
+				result.right = ci.right;
+		}
+		node->iscore = result;
 	}
 
 	void AlgoInterval::expand()
-	{  
+	{
 		this->expand(this->root);
 	}
 
 	void AlgoInterval::expand(NodeInterval::Ptr node)
-	{  
-		if (node->children.size() == 0)
-			this->expandLeafNode(node);
+	{
+		if (node->children.size() == 0) {
+			if (node->board.has_value()) // terminal nodes lose their board only when they have children
+				this->expandLeafNode(node);
+		}
 		else {
 			for (auto& mn : node->children) {
 				this->expand(mn.second);
@@ -40,12 +97,33 @@ namespace space {
 		}
 	}
 
+	// Children get interval scores straight away; mate and stalemate are
+	// only discovered when a node is expanded, which makes its score exact.
 	void AlgoInterval::expandLeafNode(NodeInterval::Ptr node)
-	{  //TODO
+	{
+		space_assert(node->board.has_value(), "A leaf node must have board object");
+		IBoard::Ptr board = node->board.value();
+		IBoard::MoveMap allMoves = board->getValidMoves();
+		++this->numExpansions;
+
+		if (allMoves.empty()) {
+			double score = board->isUnderCheck(board->whoPlaysNext())
+				? -AlgoInterval::scoreMax * node->direction
+				: 0;
+			node->iscore = { score, score };
+			return;
+		}
+
+		for (const auto& mb : allMoves) {
+			auto child = std::make_shared<NodeInterval>(mb.second, node->depth + 1);
+			child->iscore = this->getIntervalScore(mb.second);
+			node->children[mb.first] = child;
+		}
+		node->board = std::nullopt;
 	}
 
 	void AlgoInterval::refresh()
-	{  
+	{
 		this->refreshNode(this->root);
 	}
 
@@ -61,7 +139,144 @@ namespace space {
 		this->fold(node);
 	}
 
-}
 
+	//-------------------------------------------------------------------------
+	// B* search
+
+	bool AlgoInterval::isRootSeparated() const
+	{
+		if (this->root->children.size() < 2)
+			return true;
+		int direction = this->root->direction;
+
+		// the best candidate has the best optimistic bound
+		auto best = this->root->children.begin()->second;
+		for (const auto& child : this->root->children)
+			if (direction * (optimisticFor(direction, child.second->iscore) - optimisticFor(direction, best->iscore)) > 0)
+				best = child.second;
 
+		double bestPessimistic = direction * pessimisticFor(direction, best->iscore);
+		for (const auto& child : this->root->children)
+			if (child.second != best && direction * optimisticFor(direction, child.second->iscore) > bestPessimistic)
+				return false;
+		return true;
+	}
 
+	void AlgoInterval::expandAlongBestLine(NodeInterval::Ptr node)
+	{
+		if (node->children.size() == 0) {
+			if (node->board.has_value())
+				this->expandLeafNode(node);
+		}
+		else {
+			// the player to move follows the child it hopes most from
+			int direction = node->direction;
+			NodeInterval::Ptr next;
+			for (const auto& child : node->children) {
+				if (child.second->isExact())
+					continue;
+				if (!next || direction * (optimisticFor(direction, child.second->iscore) - optimisticFor(direction, next->iscore)) > 0)
+					next = child.second;
+			}
+			if (next)
+				this->expandAlongBestLine(next);
+		}
+		this->prune(node);
+		this->fold(node);
+	}
+
+	Move AlgoInterval::bestFirstSearch(IBoard::Ptr board, int maxExpansions)
+	{
+		this->root = std::make_shared<NodeInterval>(board, 0);
+		this->root->iscore = this->getIntervalScore(board);
+		this->numExpansions = 0;
+		this->expandLeafNode(this->root);
+		space_assert(this->root->children.size() > 0, "No moves available");
+		this->prune(this->root);
+		this->fold(this->root);
+
+		int direction = this->root->direction;
+		while (this->numExpansions < maxExpansions && !this->isRootSeparated()) {
+			// best: best optimistic bound, rival: best optimistic bound among the rest
+			NodeInterval::Ptr best, rival;
+			for (const auto& child : this->root->children) {
+				double value = direction * optimisticFor(direction, child.second->iscore);
+				if (!best || value > direction * optimisticFor(direction, best->iscore)) {
+					rival = best;
+					best = child.second;
+				}
+				else if (!rival || value > direction * optimisticFor(direction, rival->iscore))
+					rival = child.second;
+			}
+
+			// PROVEBEST raises the pessimistic bound of the best move,
+			// DISPROVEREST lowers the optimistic bound of its rival.
+			// Work on whichever is less certain.
+			auto width = [](const NodeInterval::Ptr& n) { return n->iscore.right - n->iscore.left; };
+			bool proveBest = !best->isExact() && (rival->isExact() || width(best) >= width(rival));
+			auto target = proveBest ? best : rival;
+			if (target->isExact())
+				break;
+
+			this->expandAlongBestLine(target);
+			this->prune(this->root);
+			this->fold(this->root);
+		}
+
+		// play the move with the best guaranteed score
+		using NodePair = std::pair<const Move, NodeInterval::Ptr>;
+		auto worse = [direction](const NodePair& a, const NodePair& b) {
+			double pa = direction * pessimisticFor(direction, a.second->iscore);
+			double pb = direction * pessimisticFor(direction, b.second->iscore);
+			if (pa != pb)
+				return pa < pb;
+			return direction * optimisticFor(direction, a.second->iscore) < direction * optimisticFor(direction, b.second->iscore);
+		};
+		return std::max_element(this->root->children.begin(), this->root->children.end(), worse)->first;
+	}
+
+
+
+	//-------------------------------------------------------------------------
+	// AlgoBStar
+
+	AlgoBStar::AlgoBStar() : AlgoBStar(nlohmann::json::object()) {}
+
+	AlgoBStar::AlgoBStar(const nlohmann::json& config) :
+		maxExpansions(config.value(getMaxExpansionsField(), 200)),
+		margin(config.value(getMarginField(), 0.5)),
+		checkMargin(config.value(getCheckMarginField(), 1.0))
+	{
+		space_assert(this->maxExpansions > 0, "AlgoBStar needs a positive expansion budget");
+		space_assert(this->margin > 0, "AlgoBStar needs a positive margin");
+
+		std::string weightsFile = config.value(getWeightsFileField(), std::string());
+		this->evaluator = LinearEvaluator(weightsFile.empty() ? AlgoGeneric::getDefaultWeights() : AlgoGeneric::loadWeights(weightsFile));
+	}
+
+	Move AlgoBStar::getNextMove(IBoard::Ptr board)
+	{
+		return this->bestFirstSearch(board, this->maxExpansions);
+	}
+
+	// linear score, widened more when the side to move is in check
+	Interval AlgoBStar::getIntervalScore(IBoard::Ptr board)
+	{
+		bool hit;
+		double score = EvalCache::getShared()->getOrCompute(board->getHash(), this->evaluator.getKey(),
+			[this, &board]() { return this->evaluator.evaluate(board); }, hit);
+
+		double width = this->margin;
+		if (board->isUnderCheck(board->whoPlaysNext()))
+			width += this->checkMargin;
+		return { score - width, score + width };
+	}
+
+	std::string AlgoBStar::getAlgoName() { return "AlgoBStar"; }
+	std::string AlgoBStar::getMaxExpansionsField() { return "MaxExpansions"; }
+	std::string AlgoBStar::getMarginField() { return "Margin"; }
+	std::string AlgoBStar::getCheckMarginField() { return "CheckMargin"; }
+	std::string AlgoBStar::getWeightsFileField() { return "WeightsFile"; }
+	bool AlgoBStar::s_algoMachineRegistration = AlgoFactory::registerAlgoMachine(AlgoBStar::getAlgoName(), AlgoBStar::createFromConfig);
+
+}
@@ -7,16 +7,19 @@
 
 #include "feature.h"
 
+#include <nlohmann/json.hpp>
+
 
 
 namespace space {
 
+	// Score bounds from White's point of view:
+	// left is the pessimistic (lower) bound, right is the optimistic (upper) bound.
 	struct Interval {
 		double left, right;
 	};
 
 	class NodeInterval {
-		//TODO
 	public:
 		using Ptr = std::shared_ptr<NodeInterval>;
 		using NodeMap = std::map<Move, Ptr>;
@@ -25,7 +28,7 @@ namespace space {
 		// std::string fen;  // for analysis only
 		std::optional<IBoard::Ptr> board;   // removed to save space when possible
 		int direction = 1; // 1 for White, -1 for Black   //TODO const
-		const unsigned int depth = 0; // starts at zero        
+		const unsigned int depth = 0; // starts at zero
 
 		NodeMap children;
 		Interval iscore;
@@ -36,6 +39,11 @@ namespace space {
 		} // just for initialization of algo
 		NodeInterval(IBoard::Ptr v_board, unsigned int v_depth);
 
+		// bounds seen by the player to move at this node
+		Score optimistic() const { return direction > 0 ? iscore.right : iscore.left; }
+		Score pessimistic() const { return direction > 0 ? iscore.left : iscore.right; }
+		bool isExact() const { return iscore.left >= iscore.right; } // nothing left to learn
+
 		int familySize() const; // for analysis only
 
 		static int objectCount;
@@ -45,9 +53,11 @@ namespace space {
 	// abstract class, getNextMove not implemented
 	class AlgoInterval : public IAlgo {
 	public:
-		virtual Interval getIntervalScore()=0;
-		void prune(NodeInterval::Ptr);
-		void fold(NodeInterval::Ptr);
+		static constexpr double scoreMax = 1e8;
+
+		virtual Interval getIntervalScore(IBoard::Ptr board)=0;
+		void prune(NodeInterval::Ptr); // drop children that can no longer be the best move
+		void fold(NodeInterval::Ptr);  // back up child bounds into the node
 		void expand();
 		void expand(NodeInterval::Ptr node); // expand all leaf nodes to one more level
 		void expandLeafNode(NodeInterval::Ptr node); // expand leaf node one level to all possible subsequent moves
@@ -57,8 +67,44 @@ namespace space {
 
 	protected:
 		NodeInterval::Ptr root;
+		int numExpansions = 0;
+
+		// B* search: expand only along the line that can separate the
+		// best root move from the rest, until it is separated or the
+		// expansion budget runs out.
+		Move bestFirstSearch(IBoard::Ptr board, int maxExpansions);
+		bool isRootSeparated() const;
+		void expandAlongBestLine(NodeInterval::Ptr node); // descend by optimistic bounds, expand the leaf, fold back
+
+	};
+
+
+	// B* engine using a linear evaluation widened into an interval
+	class AlgoBStar final : public AlgoInterval {
+	public:
+		AlgoBStar();
+		AlgoBStar(const nlohmann::json& config);
+
+		Move getNextMove(IBoard::Ptr board) override;
+		Interval getIntervalScore(IBoard::Ptr board) override;
+
+		static IAlgo::Ptr createFromConfig(const nlohmann::json& config) {
+			return std::make_shared<AlgoBStar>(config);
+		}
+
+		static std::string getAlgoName();
+		static std::string getMaxExpansionsField();
+		static std::string getMarginField();
+		static std::string getCheckMarginField();
+		static std::string getWeightsFileField();
 
+	private:
+		LinearEvaluator evaluator;
+		int maxExpansions;
+		double margin;      // half width of the interval around the linear score
+		double checkMargin; // extra width when the side to move is in check
 
+		static bool s_algoMachineRegistration;
 	};
 
 
@@ -53,16 +53,10 @@ namespace space {
 
 	AlgoLinearDepthOne::Score AlgoLinearDepthOne::getScore(IBoard::Ptr board)
 	{
-		auto signum = [](Color c) { return c == Color::White ? 1 : -1; };
 		Score s = 0;
-
-		for (int i = 0; i < 8; i++)
-			for (int j = 0; j < 8; j++) {
-				std::optional<Piece> p = board->getPiece({ i, j });
-				if (p.has_value()) {
-					s += signum(p.value().color) * this->weights[p.value().pieceType];
-				}
-			}
+		for (Color color : { Color::White, Color::Black })
+			for (const auto& w : this->weights)
+				s += colorToSign(color) * board->getPieceCount(color, w.first) * w.second;
 		return s;
 	}
 
@@ -76,48 +70,47 @@ namespace space {
 		space_assert(_breadth > 0, "Breadth must be positive");
 		space_assert(wtsVec.size() == 5, "Need 5 weights");
 		this->breadth = _breadth;
-		this->weights[PieceType::Pawn] = wtsVec[0];
-		this->weights[PieceType::Rook] = wtsVec[1];
-		this->weights[PieceType::Knight] = wtsVec[2];
-		this->weights[PieceType::Bishop] = wtsVec[3];
-		this->weights[PieceType::Queen] = wtsVec[4];		
+		// a pawn is worth 1, plus the pawn weight for each rank it has advanced
+		this->evaluator = LinearEvaluator({
+			{ std::make_shared<Feature_Piece>(PieceType::Pawn), 1.0 },
+			{ std::make_shared<Feature_PawnAdvance>(), wtsVec[0] },
+			{ std::make_shared<Feature_Piece>(PieceType::Rook), wtsVec[1] },
+			{ std::make_shared<Feature_Piece>(PieceType::Knight), wtsVec[2] },
+			{ std::make_shared<Feature_Piece>(PieceType::Bishop), wtsVec[3] },
+			{ std::make_shared<Feature_Piece>(PieceType::Queen), wtsVec[4] } });
 	}
 
 
 	AlgoLinearDepthTwoExt::Score AlgoLinearDepthTwoExt::getLinearScore(IBoard::Ptr board)
 	{
-		Score s = 0;
-		for (int i = 0; i < 8; i++)
-			for (int j = 0; j < 8; j++) {
-				std::optional<Piece> pMaybe = board->getPiece({ i, j });
-				if (!pMaybe.has_value()) {
-					continue;
-				}
-				Piece p = pMaybe.value();
-				int sign = p.color == Color::White ? 1 : -1;
-				if (p.pieceType == PieceType::Pawn) {
-					s += sign * (1 + this->weights[p.pieceType] * (sign == 1 ? (i - 1) : (6 - i)));
-				}
-				else {
-					s += sign * this->weights[p.pieceType];
-				}
-			}
-		return s;
+		return this->evaluator.evaluate(board);
 	}
 
 	std::vector<AlgoLinearDepthTwoExt::ScoreTriple> AlgoLinearDepthTwoExt::getAllScores(IBoard::Ptr board)
 	{
-		IBoard::MoveMap moveMap = board->getValidMoves();
 		std::vector<ScoreTriple> allScores;
-		for (const auto& mb : moveMap) {
-			allScores.push_back(std::make_tuple(mb.first,
-				mb.second,
-				this->getLinearScore(mb.second)));
-		}
-
+		this->getAllScores(board, allScores);
 		return allScores;
 	}
 
+	void AlgoLinearDepthTwoExt::getAllScores(IBoard::Ptr board, std::vector<ScoreTriple>& allScores)
+	{
+		// buffers keep their capacity from one call to the next
+		thread_local std::vector<IBoard::Ptr> children;
+		thread_local std::vector<Score> scores;
+		IBoard::MoveMap moveMap = board->getValidMoves();
+		children.clear();
+		for (const auto& mb : moveMap)
+			children.push_back(mb.second);
+		this->evaluator.evaluateBatch(children, scores);
+		children.clear(); // do not hold on to the boards
+
+		allScores.clear();
+		std::size_t i = 0;
+		for (const auto& mb : moveMap)
+			allScores.push_back(std::make_tuple(mb.first, mb.second, scores[i++]));
+	}
+
 	AlgoLinearDepthTwoExt::ScorePair AlgoLinearDepthTwoExt::findBestLinearMove(IBoard::Ptr board)
 	{
 		std::vector<ScoreTriple> allScores = this->getAllScores(board);
@@ -176,4 +169,101 @@ namespace space {
 
 	}
 
+
+
+// Beam search
+
+
+	AlgoLinearBeam::AlgoLinearBeam(const std::vector<std::size_t>& _widths, const std::vector<double> wtsVec, bool _alphaBeta) :
+		AlgoLinearDepthTwoExt(_widths.empty() ? 1 : _widths.front(), wtsVec),
+		widths(_widths), alphaBeta(_alphaBeta)
+	{
+		space_assert(!_widths.empty(), "Need at least one beam width");
+		for (std::size_t width : _widths)
+			space_assert(width > 0, "Beam widths must be positive");
+		this->plyScores.resize(_widths.size() + 1);
+	}
+
+	void AlgoLinearBeam::fillBeam(IBoard::Ptr board, std::size_t ply)
+	{
+		std::vector<ScoreTriple>& allScores = this->plyScores[ply];
+		this->getAllScores(board, allScores);
+		this->numScored += allScores.size();
+
+		int direction = colorToSign(board->whoPlaysNext());
+		auto cmp = [direction](const ScoreTriple& a, const ScoreTriple& b) {
+			return direction * (std::get<2>(a) - std::get<2>(b)) > 0;
+		}; // a better than b
+		std::sort(allScores.begin(), allScores.end(), cmp);
+		allScores.resize(std::min(allScores.size(), this->widths[ply]));
+	}
+
+	// minimax value of board from White's point of view, within (alpha, beta) when cutting
+	AlgoLinearBeam::Score AlgoLinearBeam::searchBeam(IBoard::Ptr board, std::size_t ply, Score alpha, Score beta)
+	{
+		int direction = colorToSign(board->whoPlaysNext());
+		bool last = ply == this->widths.size();
+		std::vector<ScoreTriple>& allScores = this->plyScores[ply];
+		if (last) {
+			this->getAllScores(board, allScores);
+			this->numScored += allScores.size();
+		}
+		else
+			this->fillBeam(board, ply);
+
+		if (allScores.empty())
+			return AlgoLinearDepthTwoExt::scoreMax * direction * -1.0;
+
+		Score best = AlgoLinearDepthTwoExt::scoreMax * direction * -2.0;
+		for (const auto& v : allScores) {
+			Score s = last ? std::get<2>(v) : this->searchBeam(std::get<1>(v), ply + 1, alpha, beta);
+			if (direction * (s - best) > 0)
+				best = s;
+			if (this->alphaBeta) {
+				if (direction > 0)
+					alpha = std::max(alpha, best);
+				else
+					beta = std::min(beta, best);
+				if (alpha >= beta)
+					break;
+			}
+		}
+		return best;
+	}
+
+	Move AlgoLinearBeam::getNextMove(IBoard::Ptr board)
+	{
+		this->numScored = 0;
+		this->fillBeam(board, 0);
+		std::vector<ScoreTriple>& rootScores = this->plyScores[0];
+		if (rootScores.empty()) {
+			return Move();
+		}
+
+		// ties go to the lowest move, as in AlgoLinearDepthTwoExt
+		std::sort(rootScores.begin(), rootScores.end(), [](const ScoreTriple& a, const ScoreTriple& b) {
+			return std::get<0>(a) < std::get<0>(b);
+		});
+
+		int direction = colorToSign(board->whoPlaysNext());
+		Score alpha = -AlgoLinearDepthTwoExt::scoreMax * 2;
+		Score beta = AlgoLinearDepthTwoExt::scoreMax * 2;
+		Move bestMove = std::get<0>(rootScores.front());
+		Score best = AlgoLinearDepthTwoExt::scoreMax * direction * -2.0;
+		for (const auto& v : rootScores) { // deeper plies use their own buffers
+			Score s = this->searchBeam(std::get<1>(v), 1, alpha, beta);
+			if (direction * (s - best) > 0) {
+				best = s;
+				bestMove = std::get<0>(v);
+			}
+			if (this->alphaBeta) {
+				if (direction > 0)
+					alpha = std::max(alpha, best);
+				else
+					beta = std::min(beta, best);
+			}
+		}
+		return bestMove;
+	}
+
 }
@@ -7,6 +7,8 @@
 
 #include "common/base.h"
 
+#include "feature.h"
+
 #include <string>
 #include <vector>
 
@@ -36,14 +38,36 @@ namespace space {
 
 	protected:
 		std::size_t breadth;
-		std::map<PieceType, double> weights;
+		LinearEvaluator evaluator; // material, and pawns by how far they have advanced
 		const Score scoreMax = 1e8;
 		Score getLinearScore(IBoard::Ptr board);
 		std::vector<ScoreTriple> getAllScores(IBoard::Ptr board);
+		void getAllScores(IBoard::Ptr board, std::vector<ScoreTriple>& allScores); // refills allScores, scored as one batch
 		ScorePair findBestLinearMove(IBoard::Ptr board);
 
 	};
 
+	// Beam search to any depth: at ply i only the widths[i] moves with the
+	// best linear score are searched further, and the ply after the last
+	// beam takes the best linear score over all replies.
+	// Widths {n} plays like AlgoLinearDepthTwoExt(n).
+	class AlgoLinearBeam : public AlgoLinearDepthTwoExt {
+	public:
+		AlgoLinearBeam(const std::vector<std::size_t>& _widths, const std::vector<double> wtsVec, bool _alphaBeta = true);
+		Move getNextMove(IBoard::Ptr board) override;
+
+		std::size_t getNumScored() const { return numScored; } // boards scored by the last search
+
+	protected:
+		std::vector<std::size_t> widths;
+		bool alphaBeta; // cut beams that cannot change the result
+		std::vector<std::vector<ScoreTriple>> plyScores; // one buffer per ply, reused across searches
+		std::size_t numScored = 0;
+
+		void fillBeam(IBoard::Ptr board, std::size_t ply); // sorted best first, cut to the width
+		Score searchBeam(IBoard::Ptr board, std::size_t ply, Score alpha, Score beta);
+	};
+
 
 	
 }
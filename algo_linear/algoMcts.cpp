@@ -0,0 +1,158 @@
+#include "algoMcts.h"
+
+#include <chess/algo_factory.h>
+
+#include <cmath>
+#include <limits>
+#include <thread>
+
+
+namespace {
+
+	// std::atomic<double>::fetch_add is C++20
+	void atomicAdd(std::atomic<double>& target, double value)
+	{
+		double expected = target.load(std::memory_order_relaxed);
+		while (!target.compare_exchange_weak(expected, expected + value, std::memory_order_relaxed))
+		{ }
+	}
+
+} // end anonymous namespace
+
+
+namespace space {
+
+	MctsNode::MctsNode(IBoard::Ptr v_board, Move v_move) :
+		board(v_board), move(v_move)
+	{ }
+
+
+
+	AlgoMcts::AlgoMcts() : AlgoMcts(nlohmann::json::object()) {}
+
+	AlgoMcts::AlgoMcts(const nlohmann::json& config) :
+		playouts(config.value(getPlayoutsField(), 2000)),
+		threads(config.value(getThreadsField(), 1)),
+		exploration(config.value(getExplorationField(), 1.4)),
+		virtualLoss(config.value(getVirtualLossField(), 1)),
+		scoreScale(config.value(getScoreScaleField(), 4.0))
+	{
+		space_assert(this->playouts > 0, "AlgoMcts needs a positive playout budget");
+		space_assert(this->threads > 0, "AlgoMcts needs at least one thread");
+		space_assert(this->scoreScale > 0, "AlgoMcts needs a positive score scale");
+		std::string weightsFile = config.value(getWeightsFileField(), std::string());
+		this->setWeights(weightsFile.empty() ? getDefaultWeights() : loadWeights(weightsFile));
+		std::string nnueFile = config.value(getNnueFileField(), std::string());
+		if (!nnueFile.empty())
+			this->setNnue(NnueEvaluator::load(nnueFile));
+	}
+
+	Move AlgoMcts::getNextMove(IBoard::Ptr board)
+	{
+		MctsNode root(board, Move());
+		this->expandNode(&root);
+		space_assert(!root.terminal, "No moves available");
+
+		std::atomic<int> playoutCounter{ 0 };
+		std::vector<std::thread> workers;
+		for (int i = 1; i < this->threads; ++i)
+			workers.emplace_back([this, &root, &playoutCounter]() { this->runPlayouts(&root, playoutCounter); });
+		this->runPlayouts(&root, playoutCounter);
+		for (auto& worker : workers)
+			worker.join();
+
+		// most visited move is the most robust choice
+		MctsNode* best = root.children.front().get();
+		for (const auto& child : root.children)
+			if (child->visits.load() > best->visits.load())
+				best = child.get();
+		return best->move;
+	}
+
+	void AlgoMcts::runPlayouts(MctsNode* root, std::atomic<int>& playoutCounter)
+	{
+		while (playoutCounter.fetch_add(1) < this->playouts)
+			this->playout(root);
+	}
+
+	// select down to a node not visited yet, value it, back the value up
+	void AlgoMcts::playout(MctsNode* root)
+	{
+		std::vector<MctsNode*> path{ root };
+		MctsNode* node = root;
+		while (true) {
+			if (!node->expanded.load(std::memory_order_acquire))
+				this->expandNode(node);
+			if (node->terminal || (node != root && node->visits.load(std::memory_order_relaxed) == 0))
+				break;
+			node = this->selectChild(node);
+			node->inFlight.fetch_add(1, std::memory_order_relaxed);
+			path.push_back(node);
+		}
+
+		double value = node->terminal ? node->terminalValue : this->evaluate(node);
+		for (auto it = path.rbegin(); it != path.rend(); ++it) {
+			MctsNode* n = *it;
+			atomicAdd(n->valueSum, value);
+			n->visits.fetch_add(1, std::memory_order_relaxed);
+			if (n != root)
+				n->inFlight.fetch_sub(1, std::memory_order_relaxed);
+			value = 1 - value;
+		}
+	}
+
+	// UCT, with each in-flight playout counted as virtualLoss lost visits
+	MctsNode* AlgoMcts::selectChild(MctsNode* node) const
+	{
+		double logParentVisits = std::log(1.0 + node->visits.load(std::memory_order_relaxed));
+		MctsNode* best = nullptr;
+		double bestScore = -std::numeric_limits<double>::infinity();
+		for (const auto& child : node->children) {
+			int n = child->visits.load(std::memory_order_relaxed)
+				+ this->virtualLoss * child->inFlight.load(std::memory_order_relaxed);
+			if (n == 0)
+				return child.get();
+			double score = child->valueSum.load(std::memory_order_relaxed) / n
+				+ this->exploration * std::sqrt(logParentVisits / n);
+			if (score > bestScore) {
+				bestScore = score;
+				best = child.get();
+			}
+		}
+		return best;
+	}
+
+	void AlgoMcts::expandNode(MctsNode* node)
+	{
+		std::lock_guard<std::mutex> lock(node->expandMutex);
+		if (node->expanded.load(std::memory_order_relaxed))
+			return;
+
+		IBoard::MoveMap allMoves = node->board->getValidMoves();
+		if (allMoves.empty()) {
+			node->terminal = true;
+			// the player who moved here either gave mate or stalemate
+			node->terminalValue = node->board->isUnderCheck(node->board->whoPlaysNext()) ? 1.0 : 0.5;
+		}
+		for (const auto& mb : allMoves)
+			node->children.push_back(std::make_unique<MctsNode>(mb.second, mb.first));
+		node->expanded.store(true, std::memory_order_release);
+	}
+
+	double AlgoMcts::evaluate(MctsNode* node)
+	{
+		double whiteWins = 1.0 / (1.0 + std::exp(-this->getLinearScore(node->board) / this->scoreScale));
+		return node->board->whoPlaysNext() == Color::Black ? whiteWins : 1.0 - whiteWins;
+	}
+
+	std::string AlgoMcts::getAlgoName() { return "AlgoMcts"; }
+	std::string AlgoMcts::getPlayoutsField() { return "Playouts"; }
+	std::string AlgoMcts::getThreadsField() { return "Threads"; }
+	std::string AlgoMcts::getExplorationField() { return "Exploration"; }
+	std::string AlgoMcts::getVirtualLossField() { return "VirtualLoss"; }
+	std::string AlgoMcts::getScoreScaleField() { return "ScoreScale"; }
+	std::string AlgoMcts::getNnueFileField() { return "NnueFile"; }
+	std::string AlgoMcts::getWeightsFileField() { return "WeightsFile"; }
+	bool AlgoMcts::s_algoMachineRegistration = AlgoFactory::registerAlgoMachine(AlgoMcts::getAlgoName(), AlgoMcts::createFromConfig);
+
+} // end namespace space
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "algoGeneric.h"
+
+#include <nlohmann/json.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+
+namespace space {
+
+	// Node of the Monte Carlo search tree, shared by all worker threads.
+	// Values are from the point of view of the player who moved into the node.
+	class MctsNode {
+	public:
+		using Ptr = std::unique_ptr<MctsNode>;
+
+		MctsNode(IBoard::Ptr v_board, Move v_move);
+
+		IBoard::Ptr board;
+		Move move;                        // move leading here from the parent
+		std::vector<Ptr> children;        // only read once expanded is set
+
+		std::atomic<int> visits{ 0 };     // finished playouts through this node
+		std::atomic<int> inFlight{ 0 };   // playouts currently passing through (virtual loss)
+		std::atomic<double> valueSum{ 0 };
+		std::atomic<bool> expanded{ false };
+		bool terminal = false;            // no moves, value is exact
+		double terminalValue = 0;
+
+		std::mutex expandMutex;
+	};
+
+
+	// UCT search with tree parallelism: workers share one tree and steer
+	// apart with virtual losses on the nodes they are exploring.
+	// Leaves are valued by the linear score of AlgoGeneric, or by a network
+	// loaded from NnueFile, squashed to [0, 1].
+	class AlgoMcts final : public AlgoGeneric {
+	public:
+		AlgoMcts();
+		AlgoMcts(const nlohmann::json& config);
+		Move getNextMove(IBoard::Ptr board) override;
+
+		static IAlgo::Ptr createFromConfig(const nlohmann::json& config) {
+			return std::make_shared<AlgoMcts>(config);
+		}
+
+		static std::string getAlgoName();
+		static std::string getPlayoutsField();
+		static std::string getThreadsField();
+		static std::string getExplorationField();
+		static std::string getVirtualLossField();
+		static std::string getScoreScaleField();
+		static std::string getNnueFileField();
+		static std::string getWeightsFileField();
+
+	private:
+		int playouts;
+		int threads;
+		double exploration;   // UCT constant
+		int virtualLoss;      // losses charged per in-flight playout
+		double scoreScale;    // linear score giving roughly 73% win chance
+
+		void runPlayouts(MctsNode* root, std::atomic<int>& playoutCounter);
+		void playout(MctsNode* root);
+		MctsNode* selectChild(MctsNode* node) const;
+		void expandNode(MctsNode* node);
+		double evaluate(MctsNode* node); // value for the player who moved into node
+
+		static bool s_algoMachineRegistration;
+	};
+
+} // end namespace space
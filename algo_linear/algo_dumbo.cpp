@@ -3,6 +3,7 @@
 #include <chess/board.h>
 #include <chess/board_impl.h>
 #include <bitset>
+#include <cstdio>
 #include <stdexcept>
 #include <set>
 
@@ -18,7 +19,10 @@ namespace space {
 		knightScore(3),
 		bishopScore(3),
 		queenScore(8),
-		validMoveScore(1)
+		validMoveScore(1),
+		threads(1),
+		canonicalize(false),
+		checkpointSeconds(60)
 	{ }
 
 	space::AlgoDumboConfig::AlgoDumboConfig(const nlohmann::json& config)
@@ -37,8 +41,15 @@ namespace space {
 			throw std::runtime_error("Cannot find next move for a board on stale mate.");
 
 		std::vector<std::pair<Move, State> > movesAndStates;
-		StateScores stateScores;
+		StateScores stateScores(m_config.spillFile);
 		StateSet stateSet;
+		Checkpoint checkpoint;
+		checkpoint.path = m_config.checkpointFile;
+		checkpoint.key = getCheckpointKey(*board, m_config);
+		checkpoint.seconds = m_config.checkpointSeconds;
+		bool checkpointing = !checkpoint.path.empty();
+		if (checkpointing)
+			stateScores.load(checkpoint.path, checkpoint.key); // resumes a search that was interrupted
 		
 		for (const auto& moveXboard: board->getValidMoves()) {
 			State state = boardToState(*moveXboard.second);
@@ -49,12 +60,15 @@ namespace space {
 		if (movesAndStates.empty())
 			throw std::runtime_error("Assertion error: if no checkmate and stalemate, then there should have been valid moves.");
 
-		exploreStates(
+		m_stats = exploreStates(
 				stateScores,
 				stateSet,
 				0,
 				board->whoPlaysNext(),
-				m_config);
+				m_config,
+				checkpointing ? &checkpoint : nullptr);
+		if (checkpointing)
+			std::remove(checkpoint.path.c_str());
 
 		double bestScore = getScore(stateScores, movesAndStates.front().second, 0);
 		Move bestMove = movesAndStates.front().first;
@@ -9,7 +9,7 @@ namespace space {
 
 	struct AlgoDumboConfig {
 		int maxDepth;
-		int maxNumStates;
+		int maxNumStates; // states of the store past which the rest of a level, in its order, is not expanded
 		double maxScore;
 		double pawnScore;
 		double rookScore;
@@ -17,10 +17,22 @@ namespace space {
 		double bishopScore;
 		double queenScore;
 		double validMoveScore;
+		int threads; // a level of exploreStates is split between them
+		bool canonicalize; // store one of the mirror images of each state, see algo_dumbo_impl::canonicalize
+		std::string spillFile; // path prefix of the files the state store is mapped to; empty keeps it in memory
+		std::string checkpointFile; // snapshot of the state store while searching, resumed from and removed at the end; empty for none
+		double checkpointSeconds; // least time between two snapshots
 		AlgoDumboConfig();
 		AlgoDumboConfig(const nlohmann::json& config);
 	};
 
+	// Eval cache use of the basic scores of a search, as AlgoGeneric::Stats has it
+	struct AlgoDumboStats {
+		long long evaluations = 0;
+		long long evalCacheHits = 0;
+		double evalSecondsSaved = 0; // estimated from the average cost of this search's misses
+	};
+
 	class AlgoDumbo: public IAlgo {
 		public:
 			using Ptr = std::shared_ptr<AlgoDumbo>;
@@ -28,9 +40,11 @@ namespace space {
 
 			AlgoDumbo();
 			AlgoDumbo(const nlohmann::json& config);
+			AlgoDumboStats getStats() const { return m_stats; } // of the last getNextMove
 
 		private:
 			AlgoDumboConfig m_config;
+			AlgoDumboStats m_stats;
 
 	};
 
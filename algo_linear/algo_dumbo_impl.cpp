@@ -1,177 +1,370 @@
 
 #include "algo_dumbo_impl.h"
+#include "evalCache.h"
 #include <chess/board_impl.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
 #include <limits>
+#include <optional>
+#include <type_traits>
 
 
 namespace algo_dumbo_impl {
 
-	void exploreStates(
-			StateScores & stateScores,
-			const StateSet& stateSet,
-			int curDepth,
-			space::Color whoPlaysNext,
-			const space::AlgoDumboConfig & config)
-	{
-		// termination of recursion
-		if (curDepth >= config.maxDepth || stateSet.empty())
+	namespace {
+
+		// what one thread found while expanding its slice of a level: the
+		// expanded states in level order, and their children, numChildren
+		// states each (none for a state whose edges were recorded before)
+		struct Expansion {
+			std::uint32_t index;
+			std::uint32_t numChildren;
+		};
+		struct LevelBuffer {
+			std::vector<Expansion> expansions;
+			std::vector<CanonicalState> children; // flipped only with config.canonicalize
+		};
+
+		space::Color otherColor(space::Color color)
 		{
+			return color == space::Color::Black ? space::Color::White : space::Color::Black;
+		}
+
+		// the snapshots of a Checkpoint, the interval counted from the start of exploreStates
+		class Checkpointer {
+		public:
+			explicit Checkpointer(const Checkpoint& v_checkpoint) :
+				checkpoint(v_checkpoint), last(std::chrono::steady_clock::now())
+			{ }
+
+			void levelDone(const StateScores& stateScores, int depth)
+			{
+				std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - this->last;
+				if (elapsed.count() < this->checkpoint.seconds)
+					return;
+				stateScores.save(this->checkpoint.path, this->checkpoint.key);
+				this->last = std::chrono::steady_clock::now();
+				if (this->checkpoint.onSaved)
+					this->checkpoint.onSaved(depth);
+			}
+
+		private:
+			const Checkpoint& checkpoint;
+			std::chrono::steady_clock::time_point last;
+		};
+
+		// levelSide is the side to move of the states of this level that are
+		// not color-flipped; whoPlaysNext is that of exploreStates for those,
+		// and the other color for the flipped ones
+		void exploreLevel(
+				StateScores & stateScores,
+				const StateSet& stateSet,
+				int curDepth,
+				space::Color whoPlaysNext,
+				space::Color levelSide,
+				const space::AlgoDumboConfig & config,
+				Checkpointer* checkpointer,
+				EvalCounters& counters)
+		{
+			int threads = std::max(config.threads, 1);
+			auto whoPlaysNextFor = [whoPlaysNext, levelSide](const State& state)
+			{
+				return getSideToMove(state) == levelSide ? whoPlaysNext : otherColor(whoPlaysNext);
+			};
+
+			// termination of recursion
+			if (curDepth >= config.maxDepth || stateSet.empty())
+			{
+				forEachState(
+						stateSet,
+						threads,
+						[&config, curDepth, &counters](int, StateHandle stateHandle)
+						{
+							if (!std::isnan(getScore(stateHandle, curDepth)))
+								return; // scored before the snapshot the search resumed from
+							double score = computeBasicScore(getState(stateHandle), config, &counters);
+							setScore(stateHandle, curDepth, score);
+
+						});
+				return;
+			}
+
+
+			// expand the states of this level in parallel; the store is only read
+			// (and the scores of each thread's own states written) until the
+			// children are merged into it below
+			std::vector<LevelBuffer> buffers(threads);
+			std::size_t numStates = getNumUniqueStates(stateScores); // once merged, duplicates included
+			bool overBudget = numStates > std::size_t(config.maxNumStates);
 			forEachState(
 					stateSet,
-					[&config, curDepth](StateHandle stateHandle)
+					threads,
+					[&stateScores, curDepth, &config, &whoPlaysNextFor, &buffers, overBudget, &counters] (int thread, StateHandle stateHandle)
 					{
-						double score = computeBasicScore(getState(stateHandle), config);
-						setScore(stateHandle, curDepth, score);
+						LevelBuffer& buffer = buffers[thread];
+						const auto & state = getState(stateHandle);
+						if (!std::isnan(getScore(stateHandle, curDepth)))
+							return; // scored before the snapshot the search resumed from
+						if (stateScores.hasChildren(stateHandle.index))
+						{
+							// expanded at a shallower depth, or before the snapshot; adds no state
+							buffer.expansions.push_back({ stateHandle.index, 0 });
+							return;
+						}
+						if (overBudget)
+						{
+							double score = computeBasicScore(getState(stateHandle), config, &counters);
+							setScore(stateHandle, curDepth, score);
+							return;
+						}
 
+						space::BoardImpl board;
+						stateToBoard(state, board);
+						if (board.isCheckMate())
+						{
+							double score = config.maxScore * getScoreFactorForColor(whoPlaysNextFor(state));
+							setScore(stateHandle, curDepth, score);
+						}
+						else if (board.isStaleMate())
+						{
+							setScore(stateHandle, curDepth, 0);
+						}
+						else
+						{
+							auto validMoves = board.getValidMoves();
+							for (const auto & mxb: validMoves)
+							{
+								const auto & board = mxb.second;
+								auto state = boardToState(*board);
+								buffer.children.push_back(config.canonicalize ? canonicalize(state) : CanonicalState{ state, false });
+							}
+							buffer.expansions.push_back({ stateHandle.index, std::uint32_t(validMoves.size()) });
+						}
 					});
-			return;
-		}
 
 
-		// collect states for next level
-		StateSet nextLevel;
-		forEachState(
-				stateSet,
-				[&stateScores, curDepth, &config, whoPlaysNext, &nextLevel] (StateHandle stateHandle)
+			// collect states for next level, in the order of this level whatever the number of threads;
+			// the states past config.maxNumStates in that order keep the basic score instead, so the
+			// cutoff does not depend on the threads either
+			StateSet nextLevel, unexpanded;
+			std::vector<std::uint32_t> children;
+			for (const LevelBuffer& buffer : buffers)
+			{
+				std::size_t nextChild = 0;
+				for (const Expansion& expansion : buffer.expansions)
 				{
-					const auto & state = getState(stateHandle);
-					auto board = stateToBoard(state);
-					if (getNumUniqueStates(stateScores) > config.maxNumStates)
+					if (stateScores.hasChildren(expansion.index))
 					{
-						double score = computeBasicScore(getState(stateHandle), config);
-						setScore(stateHandle, curDepth, score);
+						for (std::uint32_t i = 0; i < stateScores.numChildren(expansion.index); ++i)
+							addState(nextLevel, { &stateScores, stateScores.child(expansion.index, i) });
+						continue;
 					}
-					else if (board->isCheckMate())
+					if (numStates > std::size_t(config.maxNumStates))
 					{
-						double score = config.maxScore * getScoreFactorForColor(whoPlaysNext);
-						setScore(stateHandle, curDepth, score);
+						addState(unexpanded, { &stateScores, expansion.index });
+						nextChild += expansion.numChildren;
+						continue;
 					}
-					else if (board->isStaleMate())
+					numStates += expansion.numChildren;
+					children.clear();
+					for (std::uint32_t i = 0; i < expansion.numChildren; ++i)
 					{
-						setScore(stateHandle, curDepth, 0);
+						const CanonicalState& child = buffer.children[nextChild++];
+						std::uint32_t index = addState(stateScores, nextLevel, child.state, config.maxDepth).index;
+						children.push_back(child.flipped ? index | StateScores::flippedEdge : index);
 					}
-					else
+					stateScores.setChildren(expansion.index, children);
+				}
+			}
+			buffers.clear();
+			forEachState(
+					unexpanded,
+					threads,
+					[&config, curDepth, &counters](int, StateHandle stateHandle)
 					{
-						auto validMoves = board->getValidMoves();
-						for (const auto & mxb: validMoves)
+						setScore(stateHandle, curDepth, computeBasicScore(getState(stateHandle), config, &counters));
+					});
+			if (checkpointer)
+				checkpointer->levelDone(stateScores, curDepth);
+
+
+			// recurse into next level
+			exploreLevel(stateScores, nextLevel, curDepth + 1, otherColor(whoPlaysNext), otherColor(levelSide), config, checkpointer, counters);
+
+
+
+			// compute best score for each state, the scores of flipped children changing sign
+			forEachState(
+					stateSet,
+					threads,
+					[&stateScores, curDepth, &whoPlaysNextFor](int, StateHandle stateHandle){
+						if (!std::isnan(getScore(stateHandle, curDepth)))
+							return;
+						Comparator secondScoreBetterForMe = getComparatorForColor(whoPlaysNextFor(getState(stateHandle)));
+						// children recorded by the expansion above, no moves generated again
+						double bestNextScore = NAN;
+						for (std::uint32_t i = 0; i < stateScores.numChildren(stateHandle.index); ++i)
 						{
-							const auto & board = mxb.second;
-							auto state = boardToState(*board);
-							addState(stateScores, nextLevel, state, config.maxDepth);
+							double nextScore = stateScores.score(stateScores.child(stateHandle.index, i), curDepth + 1);
+							if (stateScores.isChildFlipped(stateHandle.index, i))
+								nextScore = -nextScore;
+							if (std::isnan(bestNextScore) || secondScoreBetterForMe(bestNextScore, nextScore))
+								bestNextScore = nextScore;
 						}
-					}
-				});
+						setScore(stateHandle, curDepth, bestNextScore);
+					});
+			if (checkpointer)
+				checkpointer->levelDone(stateScores, curDepth);
+		}
 
+	} // end anonymous namespace
 
-		// recurse into next level
-		space::Color opponent = (whoPlaysNext == space::Color::Black ? space::Color::White : space::Color::Black);
-		exploreStates(stateScores, nextLevel, curDepth + 1, opponent, config);
+	space::AlgoDumboStats exploreStates(
+			StateScores & stateScores,
+			const StateSet& stateSet,
+			int curDepth,
+			space::Color whoPlaysNext,
+			const space::AlgoDumboConfig & config,
+			const Checkpoint* checkpoint)
+	{
+		space::Color levelSide = stateSet.empty() ? whoPlaysNext : getSideToMove(getState(stateSet[0]));
+		std::optional<Checkpointer> checkpointer;
+		if (checkpoint)
+			checkpointer.emplace(*checkpoint);
+		EvalCounters counters;
+		exploreLevel(stateScores, stateSet, curDepth, whoPlaysNext, levelSide, config, checkpointer ? &*checkpointer : nullptr, counters);
+		return counters.stats();
+	}
 
+	namespace {
 
+		// identifies the score weights of a config in the eval cache
+		std::uint64_t getConfigKey(const space::AlgoDumboConfig& config)
+		{
+			std::uint64_t key = 0xCBF29CE484222325ULL;
+			for (double v : { config.maxScore, config.pawnScore, config.rookScore, config.knightScore,
+							  config.bishopScore, config.queenScore, config.validMoveScore })
+			{
+				std::uint64_t bits;
+				std::memcpy(&bits, &v, sizeof bits);
+				key = (key ^ bits) * 0x100000001B3ULL;
+			}
+			return key;
+		}
 
-		// compute best score for each state
-		Comparator secondScoreBetterForMe = getComparatorForColor(whoPlaysNext);
-		forEachState(
-				stateSet,
-				[&stateScores, curDepth, secondScoreBetterForMe](StateHandle stateHandle){
-					if (!std::isnan(getScore(stateHandle, curDepth)))
-						return;
-					const auto & state = getState(stateHandle);
-					auto board = stateToBoard(state);
-					auto validMoves = board->getValidMoves();
-					double bestNextScore = NAN;
-					for (const auto & mxb: validMoves)
-					{
-						const auto & nextBoard = mxb.second;
-						auto nextState = boardToState(*nextBoard);
-						double nextScore = getScore(stateScores, nextState, curDepth + 1);
-						if (std::isnan(bestNextScore) || secondScoreBetterForMe(bestNextScore, nextScore))
-							bestNextScore = nextScore;
-					}
-					setScore(stateHandle, curDepth, bestNextScore);
-				});
-		
-	}
+		double computeBasicScoreUncached(
+				const space::IBoard& board,
+				const space::AlgoDumboConfig& config)
+		{
+			double myScoreFactor = getScoreFactorForColor(board.whoPlaysNext());
+			double oppScoreFactor = myScoreFactor * -1;
 
-	double computeBasicScore(
-			const State& state,
-			const space::AlgoDumboConfig& config)
-	{
-		auto board = stateToBoard(state);
-		double myScoreFactor = getScoreFactorForColor(board->whoPlaysNext());
-		double oppScoreFactor = myScoreFactor * -1;
+			// stalemate is a draw
+			if (board.isStaleMate())
+				return 0;
+
+			// checkmate is maxScore
+			if (board.isCheckMate())
+				// if i'm under check mate then i lost
+				return config.maxScore * oppScoreFactor;
 
-		// stalemate is a draw
-		if (board->isStaleMate())
-			return 0;
 
-		// checkmate is maxScore
-		if (board->isCheckMate())
-			// if i'm under check mate then i lost
-			return config.maxScore * oppScoreFactor;
+			// init resulting total score to 0
+			double totalScore = 0;
 
+			// score per each valid move of current player
+			auto validMoves = board.getValidMoves();
+			totalScore += validMoves.size() * config.validMoveScore * myScoreFactor;
 
-		// init resulting total score to 0
-		double totalScore = 0;
+			// get score for valid moves of opponent in next state
+			// averaged across all moves i can make right now
+			for (const auto & move_x_board : validMoves)
+			{
+				const auto & nextBoard = *move_x_board.second;
+				if (nextBoard.isCheckMate())
+					// i have a move that forces checkmate, i win
+					return config.maxScore * myScoreFactor;
+
+				totalScore +=
+					config.validMoveScore               // score per valid move
+					* nextBoard.countLegalMoves()       // number of valid moves for that state
+					* oppScoreFactor                    // score factor for opponent
+					/ validMoves.size();                // average out across all possible next states
+			}
 
-		// score per each valid move of current player
-		auto validMoves = board->getValidMoves();
-		totalScore += validMoves.size() * config.validMoveScore * myScoreFactor;
 
-		// get score for valid moves of opponent in next state
-		// averaged across all moves i can make right now
-		for (const auto & move_x_board : validMoves)
-		{
-			const auto & nextBoard = *move_x_board.second;
-			if (nextBoard.isCheckMate())
-				// i have a move that forces checkmate, i win
-				return config.maxScore * myScoreFactor;
-
-			totalScore +=
-				config.validMoveScore               // score per valid move
-				* nextBoard.getValidMoves().size()  // number of valid moves for that state
-				* oppScoreFactor                    // score factor for opponent
-				/ validMoves.size();                // average out across all possible next states
+			// TODO: compute score for protecting/threatening pieces		
+
+
+			// score for pieces, from the counts kept by the board
+			for (space::Color color : { space::Color::White, space::Color::Black })
+			{
+				double scoreFactor = getScoreFactorForColor(color);
+				totalScore += scoreFactor * (
+					board.getPieceCount(color, space::PieceType::Pawn) * config.pawnScore
+					+ board.getPieceCount(color, space::PieceType::Rook) * config.rookScore
+					+ board.getPieceCount(color, space::PieceType::Knight) * config.knightScore
+					+ board.getPieceCount(color, space::PieceType::Bishop) * config.bishopScore
+					+ board.getPieceCount(color, space::PieceType::Queen) * config.queenScore);
+			}
+			return totalScore;
 		}
 
+	} // end anonymous namespace
 
-		// TODO: compute score for protecting/threatening pieces		
+	std::uint64_t getCheckpointKey(const space::IBoard& board, const space::AlgoDumboConfig& config)
+	{
+		std::uint64_t key = getConfigKey(config);
+		for (std::uint64_t v : { board.getHash(), std::uint64_t(config.maxDepth), std::uint64_t(config.maxNumStates), std::uint64_t(config.canonicalize) })
+			key = (key ^ v) * 0x100000001B3ULL;
+		return key;
+	}
 
+	space::AlgoDumboStats EvalCounters::stats() const
+	{
+		space::AlgoDumboStats result;
+		result.evaluations = evaluations.load();
+		result.evalCacheHits = hits.load();
+		long long numMisses = misses.load();
+		if (numMisses > 0)
+			result.evalSecondsSaved = result.evalCacheHits * (missNanoseconds.load() * 1e-9 / numMisses);
+		return result;
+	}
 
-		// score for pieces
-		for (int rank = 0; rank < 8; ++rank)
-		{
-			for (int file = 0; file < 8; ++file)
-			{
-				space::Position pos(rank, file);
-				auto optPiece = board->getPiece(pos);
-				if (optPiece)
+	double computeBasicScore(
+			const State& state,
+			const space::AlgoDumboConfig& config,
+			EvalCounters* counters)
+	{
+		space::BoardImpl board; // decoded in place, a cache hit allocates nothing
+		stateToBoard(state, board);
+		bool hit;
+		double score = space::EvalCache::getShared()->getOrCompute(
+				board.getHash(),
+				getConfigKey(config),
+				[&board, &config, counters]()
 				{
-					double scoreFactor = getScoreFactorForColor(optPiece->color);
-					switch (optPiece->pieceType)
+					auto start = std::chrono::steady_clock::now();
+					double computed = computeBasicScoreUncached(board, config);
+					if (counters)
 					{
-						case space::PieceType::Pawn:
-							totalScore += scoreFactor * config.pawnScore;
-							break;
-						case space::PieceType::Rook:
-							totalScore += scoreFactor * config.rookScore;
-							break;
-						case space::PieceType::Knight:
-							totalScore += scoreFactor * config.knightScore;
-							break;
-						case space::PieceType::Bishop:
-							totalScore += scoreFactor * config.bishopScore;
-							break;
-						case space::PieceType::Queen:
-							totalScore += scoreFactor * config.queenScore;
-							break;
-						default:
-							break;
+						std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+						counters->misses.fetch_add(1, std::memory_order_relaxed);
+						counters->missNanoseconds.fetch_add((long long)(elapsed.count() * 1e9), std::memory_order_relaxed);
 					}
-				}
-			}
+					return computed;
+				},
+				hit);
+		if (counters)
+		{
+			counters->evaluations.fetch_add(1, std::memory_order_relaxed);
+			if (hit)
+				counters->hits.fetch_add(1, std::memory_order_relaxed);
 		}
-		return totalScore;
+		return score;
 	}
 
 
@@ -179,52 +372,105 @@ namespace algo_dumbo_impl {
 
 
 
+
 	//-----------------------------------------------------------------------
-	// state to board
-	inline bool getBool(const State& state, int& idx)
-	{
-		return state[idx++];
-	}
-	inline int getInteger(const State& state, int& idx, int numBits)
-	{
-		int result = 0;
-		while(numBits-- > 0)
+	// packing, a word of 16 squares at a time
+	namespace {
+
+		const std::uint64_t emptyNibble = static_cast<std::uint64_t>(space::PieceType::None) | 8;
+
+		std::uint64_t toNibble(const std::optional<space::Piece>& piece)
 		{
-			result = result * 2 + (getBool(state, idx) ? 1 : 0);
+			if (!piece)
+				return emptyNibble;
+			return static_cast<std::uint64_t>(piece->pieceType) | (piece->color == space::Color::Black ? 8 : 0);
 		}
-		return result;
-	}
-	inline space::PieceType getPieceType(const State& state, int& idx)
+
+		space::Piece fromNibble(std::uint64_t nibble)
+		{
+			return space::Piece(static_cast<space::PieceType>(nibble & 7),
+				(nibble & 8) ? space::Color::Black : space::Color::White);
+		}
+
+		// the 8 squares of a rank, one nibble each, file a lowest
+		std::uint32_t getRank(const PackedState& packed, int rank)
+		{
+			return std::uint32_t(packed.squares[rank / 2] >> (32 * (rank % 2)));
+		}
+
+		void setRank(PackedState& packed, int rank, std::uint32_t squares)
+		{
+			packed.squares[rank / 2] |= std::uint64_t(squares) << (32 * (rank % 2));
+		}
+
+		// black pieces white and white pieces black, empty squares left alone
+		std::uint32_t swapColors(std::uint32_t squares)
+		{
+			const std::uint32_t emptyTypes = 0x66666666u;
+			std::uint32_t same = ~(squares ^ emptyTypes) & 0x77777777u; // type bits equal to those of an empty square
+			std::uint32_t empty = same & (same >> 1) & (same >> 2) & 0x11111111u;
+			return squares ^ ((~empty & 0x11111111u) << 3);
+		}
+
+		// file a to h and h to a
+		std::uint32_t mirrorRank(std::uint32_t squares)
+		{
+			squares = ((squares & 0x0F0F0F0Fu) << 4) | ((squares >> 4) & 0x0F0F0F0Fu);
+			return (squares >> 24) | ((squares >> 8) & 0xFF00u) | ((squares << 8) & 0xFF0000u) | (squares << 24);
+		}
+
+	} // end anonymous namespace
+
+	PackedState pack(const State& state)
 	{
-		return static_cast<space::PieceType>(getInteger(state, idx, 3));
+		const State word(~std::uint64_t(0));
+		PackedState packed;
+		for (int k = 0; k < 4; ++k)
+			packed.squares[k] = ((state >> (64 * k)) & word).to_ullong();
+		packed.flags = unsigned((state >> 256).to_ulong());
+		return packed;
 	}
-	inline space::Color getColor(const State& state, int& idx)
+
+	State unpack(const PackedState& packed)
 	{
-		return (getBool(state, idx) ? space::Color::Black : space::Color::White);
+		State state(packed.flags);
+		for (int k = 3; k >= 0; --k)
+		{
+			state <<= 64;
+			state |= State(packed.squares[k]);
+		}
+		return state;
 	}
-	space::IBoard::Ptr stateToBoard(const State& state)
+
+
+
+
+	//-----------------------------------------------------------------------
+	// state to board
+	void stateToBoard(const State& state, space::BoardImpl& board)
 	{
+		PackedState packed = pack(state);
 		std::array<std::array<space::Piece, 8>, 8> pieces;
-		int si = 0;
 		for (int rank = 0; rank < 8; ++rank)
-			for (int file = 0; file < 8; ++file)
-			{
-				auto pieceType = getPieceType(state, si);
-				auto color = getColor(state, si);
-				pieces[rank][file] = space::Piece{ pieceType, color };
-			}
-		bool canWhiteCastleLeft = getBool(state, si);
-		bool canWhiteCastleRight = getBool(state, si);
-		bool canBlackCastleLeft = getBool(state, si);
-		bool canBlackCastleRight = getBool(state, si);
-		space::Color whoPlaysNext = getColor(state, si);
-		return std::make_shared<space::BoardImpl>(
+		{
+			std::uint32_t squares = getRank(packed, rank);
+			for (int file = 0; file < 8; ++file, squares >>= 4)
+				pieces[rank][file] = fromNibble(squares & 15);
+		}
+		board.assign(
 				pieces,
-				canWhiteCastleLeft,
-				canWhiteCastleRight,
-				canBlackCastleLeft,
-				canBlackCastleRight,
-				whoPlaysNext);
+				(packed.flags & PackedState::whiteLeft) != 0,
+				(packed.flags & PackedState::whiteRight) != 0,
+				(packed.flags & PackedState::blackLeft) != 0,
+				(packed.flags & PackedState::blackRight) != 0,
+				(packed.flags & PackedState::blackToMove) ? space::Color::Black : space::Color::White);
+	}
+
+	space::IBoard::Ptr stateToBoard(const State& state)
+	{
+		auto board = std::make_shared<space::BoardImpl>();
+		stateToBoard(state, *board);
+		return board;
 	}
 
 
@@ -233,81 +479,296 @@ namespace algo_dumbo_impl {
 
     //-----------------------------------------------------------------------
 	// board to state
-	void setBool(State& state, int& si, bool b)
+	State boardToState(const space::IBoard& board)
 	{
-		state[si++] = b;
+		PackedState packed;
+		for (int rank = 0; rank < 8; ++rank)
+		{
+			std::uint32_t squares = 0;
+			for (int file = 7; file >= 0; --file)
+				squares = (squares << 4) | std::uint32_t(toNibble(board.getPiece(space::Position(rank, file))));
+			setRank(packed, rank, squares);
+		}
+		packed.flags =
+			(board.canCastleLeft(space::Color::White) ? PackedState::whiteLeft : 0u)
+			| (board.canCastleRight(space::Color::White) ? PackedState::whiteRight : 0u)
+			| (board.canCastleLeft(space::Color::Black) ? PackedState::blackLeft : 0u)
+			| (board.canCastleRight(space::Color::Black) ? PackedState::blackRight : 0u)
+			| (board.whoPlaysNext() == space::Color::Black ? PackedState::blackToMove : 0u);
+		return unpack(packed);
 	}
-	void setInteger(State& state, int& si, int numBits, int integer)
+
+
+
+
+
+
+
+	//-----------------------------------------------------------------------
+	// symmetries
+	State transformState(const State& state, bool flipColors, bool mirrorFiles)
 	{
-		int reverseInteger = 0;
-		for (int i = 0; i < numBits; ++i)
+		PackedState packed = pack(state);
+		PackedState result;
+		for (int rank = 0; rank < 8; ++rank)
 		{
-			reverseInteger *= 2;
-			reverseInteger += (integer % 2);
-			integer /= 2;
+			std::uint32_t squares = getRank(packed, flipColors ? 7 - rank : rank);
+			if (flipColors)
+				squares = swapColors(squares);
+			if (mirrorFiles)
+				squares = mirrorRank(squares);
+			setRank(result, rank, squares);
 		}
-		while(numBits--)
+		// left and right are from each player's point of view: White's left rook
+		// is on file a, Black's on file h, which the flip turns into White's right
+		unsigned flags = packed.flags;
+		if (flipColors)
+			flags =
+				((flags & PackedState::blackRight) ? PackedState::whiteLeft : 0u)
+				| ((flags & PackedState::blackLeft) ? PackedState::whiteRight : 0u)
+				| ((flags & PackedState::whiteRight) ? PackedState::blackLeft : 0u)
+				| ((flags & PackedState::whiteLeft) ? PackedState::blackRight : 0u)
+				| ((flags & PackedState::blackToMove) ? 0u : PackedState::blackToMove);
+		result.flags = flags;
+		return unpack(result);
+	}
+
+	CanonicalState canonicalize(const State& state)
+	{
+		CanonicalState best{ state, false };
+		auto consider = [&state, &best](bool flipColors, bool mirrorFiles)
+		{
+			State candidate = transformState(state, flipColors, mirrorFiles);
+			if (StateCompare()(candidate, best.state))
+				best = { candidate, flipColors };
+		};
+		consider(true, false);
+		// castling is not symmetric, mirroring files needs all rights gone
+		bool canCastle = (pack(state).flags & PackedState::castling) != 0;
+		if (!canCastle)
 		{
-			setBool(state, si, (reverseInteger % 2 == 1));
-			reverseInteger /= 2;
+			consider(false, true);
+			consider(true, true);
 		}
+		return best;
 	}
-	void setPieceType(State& state, int& si, space::PieceType pieceType)
+
+
+
+
+
+
+
+	//-----------------------------------------------------------------------------------------
+	//state utilities
+	std::size_t StateScores::locate(const State& state, std::size_t hash) const
 	{
-		setInteger(state, si, 3, static_cast<int>(pieceType));
+		std::uint64_t tag = std::uint64_t(hash) >> 32;
+		std::size_t mask = this->slots.size() - 1;
+		for (std::size_t i = hash & mask; ; i = (i + 1) & mask) {
+			std::uint64_t slot = this->slots[i];
+			if (slot == 0)
+				return i;
+			if ((slot >> 32) == tag && this->states[std::uint32_t(slot) - 1] == state)
+				return i;
+		}
+	}
+
+	namespace {
+		template <class T> space::MappedArray<T> spillArray(const std::string& spillPath, const char* suffix)
+		{
+			return spillPath.empty() ? space::MappedArray<T>() : space::MappedArray<T>(spillPath + suffix);
+		}
 	}
-	void setColor(State& state, int & si, space::Color color)
+
+	StateScores::StateScores(const std::string& spillPath) :
+		states(spillArray<State>(spillPath, ".states")),
+		scores(spillArray<double>(spillPath, ".scores")),
+		edgeRanges(spillArray<EdgeRange>(spillPath, ".ranges")),
+		edges(spillArray<std::uint32_t>(spillPath, ".edges")),
+		slots(spillArray<std::uint64_t>(spillPath, ".slots"))
+	{ }
+
+	// rebuilt from the states rather than from the old table, so a spilled
+	// store never holds two tables at once
+	void StateScores::grow()
 	{
-		setBool(state, si, (color == space::Color::Black));
+		this->slots.assign(std::max<std::size_t>(this->slots.size() * 2, 1024), 0);
+		for (std::uint32_t index = 0; index < this->states.size(); ++index) {
+			const State& state = this->states[index];
+			std::size_t hash = std::hash<State>()(state);
+			this->slots[this->locate(state, hash)] = (std::uint64_t(hash) >> 32 << 32) | (std::uint64_t(index) + 1);
+		}
 	}
-	State boardToState(const space::IBoard& board)
+
+	std::uint32_t StateScores::find(const State& state) const
 	{
-		State state;
-		int si = 0;
-		for (int rank = 0; rank < 8; ++rank)
-			for (int file = 0; file < 8; ++file)
-			{
-				auto optPiece = board.getPiece(space::Position(rank, file));
-				space::PieceType pieceType = (optPiece ? optPiece->pieceType : space::PieceType::None);
-				space::Color color = (optPiece ? optPiece->color : space::Color::Black);
-				setPieceType(state, si, pieceType);
-				setColor(state, si, color);
-			}
-		setBool(state, si, board.canCastleLeft(space::Color::White));
-		setBool(state, si, board.canCastleRight(space::Color::White));
-		setBool(state, si, board.canCastleLeft(space::Color::Black));
-		setBool(state, si, board.canCastleRight(space::Color::Black));
-		setColor(state, si, board.whoPlaysNext());
-		return state;
+		if (this->slots.empty())
+			return npos;
+		std::uint64_t slot = this->slots[this->locate(state, std::hash<State>()(state))];
+		return slot == 0 ? npos : std::uint32_t(slot) - 1;
 	}
 
+	std::uint32_t StateScores::insert(const State& state, int maxDepth)
+	{
+		if (this->stride == 0)
+			this->stride = maxDepth + 1;
+		if (this->stride != std::size_t(maxDepth + 1))
+			throw std::runtime_error("StateScores: all states need the same maxDepth");
+		if (this->states.size() >= flippedEdge - 1)
+			throw std::runtime_error("StateScores: too many states");
+
+		// at most half full, so probe sequences stay short
+		if (2 * (this->states.size() + 1) > this->slots.size())
+			this->grow();
+		std::size_t hash = std::hash<State>()(state);
+		std::size_t i = this->locate(state, hash);
+		if (this->slots[i] != 0)
+			return std::uint32_t(this->slots[i]) - 1;
+
+		std::uint32_t index = std::uint32_t(this->states.size());
+		this->states.push_back(state);
+		this->edgeRanges.push_back({ 0, 0 });
+		this->scores.resize(this->scores.size() + this->stride, std::numeric_limits<double>::quiet_NaN());
+		this->slots[i] = (std::uint64_t(hash) >> 32 << 32) | (std::uint64_t(index) + 1);
+		return index;
+	}
 
+	namespace {
+		const char snapshotMagic[4] = { 'S', 'P', 'D', 'S' };
+		const std::uint32_t snapshotVersion = 1;
+
+		struct SnapshotHeader {
+			char magic[4];
+			std::uint32_t version;
+			std::uint64_t key;
+			std::uint64_t stride;
+			std::uint64_t numStates;
+			std::uint64_t numEdges;
+			std::uint64_t numSlots;
+		};
+
+		std::size_t padded(std::size_t bytes)
+		{
+			return (bytes + 7) & ~std::size_t(7);
+		}
+	}
 
+	void StateScores::save(const std::string& path, std::uint64_t key) const
+	{
+		SnapshotHeader header = { {}, snapshotVersion, key, this->stride, this->states.size(), this->edges.size(), this->slots.size() };
+		std::memcpy(header.magic, snapshotMagic, sizeof header.magic);
+
+		std::size_t size = padded(sizeof header);
+		auto measure = [&size](const auto& array) { size += padded(array.size() * sizeof(array[0])); };
+		measure(this->states);
+		measure(this->scores);
+		measure(this->edgeRanges);
+		measure(this->edges);
+		measure(this->slots);
+
+		space::replaceFile(path, size, [&](char* data)
+				{
+					std::memcpy(data, &header, sizeof header);
+					std::size_t offset = padded(sizeof header);
+					auto write = [data, &offset](const auto& array)
+					{
+						std::size_t bytes = array.size() * sizeof(array[0]);
+						if (bytes > 0)
+							std::memcpy(data + offset, array.data(), bytes);
+						offset += padded(bytes);
+					};
+					write(this->states);
+					write(this->scores);
+					write(this->edgeRanges);
+					write(this->edges);
+					write(this->slots);
+				});
+	}
 
+	bool StateScores::load(const std::string& path, std::uint64_t key)
+	{
+		if (!std::ifstream(path).good())
+			return false;
+		space::MappedFile file(path, space::MappedFile::Mode::Read);
+		SnapshotHeader header;
+		if (file.size() < sizeof header)
+			throw std::runtime_error("Not a state store snapshot: " + path);
+		std::memcpy(&header, file.data(), sizeof header);
+		if (std::memcmp(header.magic, snapshotMagic, sizeof header.magic) != 0 || header.version != snapshotVersion)
+			throw std::runtime_error("Not a state store snapshot of version 1: " + path);
+		if (header.key != key)
+			return false;
+
+		std::size_t expected = padded(sizeof header)
+			+ padded(header.numStates * sizeof(State))
+			+ padded(header.numStates * header.stride * sizeof(double))
+			+ padded(header.numStates * sizeof(EdgeRange))
+			+ padded(header.numEdges * sizeof(std::uint32_t))
+			+ padded(header.numSlots * sizeof(std::uint64_t));
+		if (file.size() != expected)
+			throw std::runtime_error("State store snapshot " + path + " has the wrong size");
+
+		std::size_t offset = padded(sizeof header);
+		auto read = [&file, &offset](auto& array, std::size_t count)
+		{
+			using T = std::remove_reference_t<decltype(array[0])>;
+			const T* first = reinterpret_cast<const T*>(file.data() + offset);
+			array.resize(0);
+			array.append(first, first + count);
+			offset += padded(count * sizeof(T));
+		};
+		read(this->states, header.numStates);
+		read(this->scores, header.numStates * header.stride);
+		read(this->edgeRanges, header.numStates);
+		read(this->edges, header.numEdges);
+		read(this->slots, header.numSlots);
+		this->stride = header.stride;
+		return true;
+	}
 
+	void StateScores::setChildren(std::uint32_t index, const std::vector<std::uint32_t>& children)
+	{
+		if (this->hasChildren(index))
+			return;
+		this->edgeRanges[index] = { std::uint32_t(this->edges.size()), std::uint32_t(children.size()) };
+		this->edges.append(children.begin(), children.end());
+	}
 
+	bool StateSet::insert(StateHandle stateHandle)
+	{
+		if (stateHandle.index >= this->members.size())
+			this->members.resize(std::max<std::size_t>(2 * this->members.size(), stateHandle.index + 1));
+		if (this->members[stateHandle.index])
+			return false;
+		this->members[stateHandle.index] = true;
+		this->handles.push_back(stateHandle);
+		return true;
+	}
 
-	//-----------------------------------------------------------------------------------------
-	//state utilities
 	void addState(StateScores& stateScores, const State& state, int maxDepth)
 	{
-		if (!stateScores.count(state))
-			stateScores[state] = std::vector(maxDepth + 1, std::numeric_limits<double>::quiet_NaN());
+		stateScores.insert(state, maxDepth);
 	}
 	void setScore(StateScores& stateScores, const State& state, int depth, double score)
 	{
-		stateScores[state][depth] = score;
+		std::uint32_t index = stateScores.find(state);
+		if (index == StateScores::npos)
+			throw std::runtime_error("setScore: unknown state");
+		stateScores.score(index, depth) = score;
 	}
 	double getScore(const StateScores& stateScores, const State& state, int depth)
 	{
-		return stateScores.find(state)->second.operator[](depth);
+		std::uint32_t index = stateScores.find(state);
+		if (index == StateScores::npos)
+			throw std::runtime_error("getScore: unknown state");
+		return stateScores.score(index, depth);
 	}
-	void addState(StateScores& stateScores, StateSet& stateSet, const State& state, int maxDepth)
+	StateHandle addState(StateScores& stateScores, StateSet& stateSet, const State& state, int maxDepth)
 	{
-		auto handle = stateScores.find(state);
-		if (handle == stateScores.end())
-			handle = stateScores.insert(std::make_pair(state, std::vector(maxDepth + 1, std::numeric_limits<double>::quiet_NaN()))).first;
-		stateSet.insert(handle);
+		StateHandle stateHandle{ &stateScores, stateScores.insert(state, maxDepth) };
+		stateSet.insert(stateHandle);
+		return stateHandle;
 	}
 	void addState(StateSet& stateSet, const StateHandle& stateHandle)
 	{
@@ -315,11 +776,11 @@ namespace algo_dumbo_impl {
 	}
 	void setScore(StateHandle stateHandle, int curDepth, double score)
 	{
-		stateHandle->second.operator[](curDepth) = score;
+		stateHandle.scores->score(stateHandle.index, curDepth) = score;
 	}
 	double getScore(StateHandle stateHandle, int curDepth)
 	{
-		return stateHandle->second.operator[](curDepth);
+		return stateHandle.scores->score(stateHandle.index, curDepth);
 	}
 
 } // end namespace algo_dumbo_impl
@@ -1,9 +1,17 @@
 #pragma once
 
 #include "algo_dumbo.h"
+#include <chess/board_impl.h>
+#include <common/base.h>
+#include <common/mappedFile.h>
+#include <array>
+#include <atomic>
 #include <bitset>
+#include <cstdint>
+#include <functional>
 #include <stdexcept>
-#include <set>
+#include <string>
+#include <vector>
 
 
 
@@ -21,26 +29,124 @@ namespace algo_dumbo_impl {
 			return false;
 		}
 	};
+
+	// The state as words: square rank * 8 + file in nibble square % 16 of
+	// word square / 16, holding the piece type and 8 for Black (empty squares
+	// are None and 8); then the flags. In the State these are bits 0 to 255
+	// and 256 to 260.
+	struct PackedState {
+		static constexpr unsigned whiteLeft = 1, whiteRight = 2, blackLeft = 4, blackRight = 8, castling = 15, blackToMove = 16;
+		std::array<std::uint64_t, 4> squares = {};
+		unsigned flags = 0;
+	};
+	PackedState pack(const State& state);
+	State unpack(const PackedState& packed);
+
 	space::IBoard::Ptr stateToBoard(const State& state);
+	void stateToBoard(const State& state, space::BoardImpl& board); // into an existing board, no allocation
 	State boardToState(const space::IBoard& board);
+	inline space::Color getSideToMove(const State& state) { return state[StateSize - 1] ? space::Color::Black : space::Color::White; }
+
+	// Symmetry reduction (AlgoDumboConfig::canonicalize): a state and its
+	// color-flipped mirror have opposite scores, and without castling rights a
+	// state and its left-right mirror have the same score, so the smallest of
+	// them by StateCompare stands for all of them.
+	struct CanonicalState {
+		State state;
+		bool flipped; // state is the color-flipped mirror, scores change sign
+	};
+	State transformState(const State& state, bool flipColors, bool mirrorFiles);
+	CanonicalState canonicalize(const State& state);
+
+	// States and their scores by depth, in flat arrays indexed in the order
+	// the states were added; an open-addressing table of those indices finds
+	// a state by its hash. Indices stay valid as the store grows.
+	// Given a spill path, the arrays live in files mapped into memory
+	// (spillPath + ".states", ".scores", ...), removed with the store: the
+	// page cache keeps the levels being worked on resident and writes the
+	// others out, so the store is bounded by disk rather than RAM.
+	class StateScores {
+	public:
+		static constexpr std::uint32_t npos = ~std::uint32_t(0);
+
+		StateScores() {}
+		explicit StateScores(const std::string& spillPath); // empty keeps the store in memory
+		bool isSpilled() const { return states.isMapped(); }
+
+		std::size_t size() const { return states.size(); }
+		std::uint32_t find(const State& state) const; // npos when absent
+		std::uint32_t insert(const State& state, int maxDepth); // new states start with NaN scores
+		const State& getState(std::uint32_t index) const { return states[index]; }
+		double& score(std::uint32_t index, int depth) { return scores[index * stride + depth]; }
+		double score(std::uint32_t index, int depth) const { return scores[index * stride + depth]; }
+
+		// children of an expanded state, recorded by the first expansion so
+		// the backup pass reads them instead of generating the moves again;
+		// an edge with flippedEdge set leads to the color-flipped mirror of the child
+		static constexpr std::uint32_t flippedEdge = std::uint32_t(1) << 31;
+		void setChildren(std::uint32_t index, const std::vector<std::uint32_t>& children);
+		bool hasChildren(std::uint32_t index) const { return edgeRanges[index].count != 0; }
+		std::uint32_t numChildren(std::uint32_t index) const { return edgeRanges[index].count; }
+		std::uint32_t child(std::uint32_t index, std::uint32_t i) const { return edges[edgeRanges[index].first + i] & ~flippedEdge; }
+		bool isChildFlipped(std::uint32_t index, std::uint32_t i) const { return (edges[edgeRanges[index].first + i] & flippedEdge) != 0; }
+
+		// Snapshot of the whole store for resuming a search: a header, then the
+		// arrays as they are in memory, each at a multiple of 8 bytes, so load
+		// copies them without parsing (and a snapshot only suits the build that
+		// wrote it). key tells searches apart; load leaves the store alone and
+		// returns false when the file is absent or holds another key.
+		void save(const std::string& path, std::uint64_t key) const;
+		bool load(const std::string& path, std::uint64_t key);
+
+	private:
+		struct EdgeRange {
+			std::uint32_t first;
+			std::uint32_t count;
+		};
+		space::MappedArray<State> states;
+		space::MappedArray<double> scores;         // stride values per state
+		space::MappedArray<EdgeRange> edgeRanges;  // by state
+		space::MappedArray<std::uint32_t> edges;   // child indices, contiguous per state
+		std::size_t stride = 0;                    // maxDepth + 1, fixed by the first insert
+		space::MappedArray<std::uint64_t> slots;   // high half of the hash, index + 1; 0 when empty
+		std::size_t locate(const State& state, std::size_t hash) const; // slot of state, or the empty slot it goes to
+		void grow();
+	};
 
-	using StateScores = std::map<State, std::vector<double>, StateCompare>;
-	using StateHandle = StateScores::iterator;
+	struct StateHandle {
+		StateScores* scores;
+		std::uint32_t index;
+	};
 
 	inline std::size_t getNumUniqueStates(const StateScores& stateScores) { return stateScores.size(); }
 	void addState(StateScores& stateScores, const State& state, int maxDepth);
 	void setScore(StateScores& stateScores, const State& state, int depth, double score);
 	double getScore(const StateScores& stateScores, const State& state, int depth);
-	inline const State& getState(StateHandle stateHandle) { return stateHandle->first; }
+	inline const State& getState(StateHandle stateHandle) { return stateHandle.scores->getState(stateHandle.index); }
 
 
 	struct StateHandleCompare {
 		bool operator()(StateHandle left, StateHandle right) const {
-			return StateCompare()(left->first, right->first);
+			return StateCompare()(getState(left), getState(right));
 		}
 	};
-	using StateSet = std::set<StateHandle, StateHandleCompare>;
-	void addState(StateScores& stateScores, StateSet& stateSet, const State& state, int maxDepth);
+
+	// distinct states of one level of the search, in the order they were added
+	class StateSet {
+	public:
+		bool insert(StateHandle stateHandle); // false when already present
+		bool empty() const { return handles.empty(); }
+		std::size_t size() const { return handles.size(); }
+		const StateHandle& operator[](std::size_t i) const { return handles[i]; }
+		std::vector<StateHandle>::const_iterator begin() const { return handles.begin(); }
+		std::vector<StateHandle>::const_iterator end() const { return handles.end(); }
+
+	private:
+		std::vector<StateHandle> handles;
+		std::vector<bool> members; // by state index
+	};
+
+	StateHandle addState(StateScores& stateScores, StateSet& stateSet, const State& state, int maxDepth);
 	void addState(StateSet& stateSet, const StateHandle& stateHandle);
 	void setScore(StateHandle stateHandle, int curDepth, double score);
 	double getScore(StateHandle stateHandle, int curDepth);
@@ -49,6 +155,15 @@ namespace algo_dumbo_impl {
 		for (auto stateHandle: ss)
 			tfunc(stateHandle);
 	}
+	// the states split into one contiguous slice per thread, tfunc(thread, stateHandle)
+	template<typename TFunc> void forEachState(const StateSet& ss, int threads, TFunc tfunc)
+	{
+		space::parallel_for(ss.size(), threads, [&ss, &tfunc](int thread, std::size_t begin, std::size_t end)
+				{
+					for (std::size_t i = begin; i < end; ++i)
+						tfunc(thread, ss[i]);
+				});
+	}
 
 
 
@@ -70,16 +185,45 @@ namespace algo_dumbo_impl {
 	}
 	
 
-	void exploreStates(
+	// Snapshots of the store taken by exploreStates at level boundaries, on
+	// the way down once a level is expanded and on the way up once it is
+	// scored, at most every `seconds`. The levels themselves are not saved:
+	// exploring the same states again with a loaded store skips the states
+	// already scored and follows the recorded edges, so it rebuilds them
+	// without generating a move and goes on where the snapshot stopped.
+	struct Checkpoint {
+		std::string path;
+		std::uint64_t key = 0;   // of StateScores::save
+		double seconds = 0;
+		std::function<void(int depth)> onSaved; // optional, after each snapshot
+	};
+	// of a search from board with config, for Checkpoint::key
+	std::uint64_t getCheckpointKey(const space::IBoard& board, const space::AlgoDumboConfig& config);
+
+	// Eval cache use of the basic scores, counted from the threads of an exploration
+	struct EvalCounters {
+		std::atomic<long long> evaluations{ 0 };
+		std::atomic<long long> hits{ 0 };
+		std::atomic<long long> misses{ 0 };
+		std::atomic<long long> missNanoseconds{ 0 };
+		space::AlgoDumboStats stats() const;
+	};
+
+	// The states of stateSet share a side to move. With config.canonicalize
+	// the levels below hold canonical states, whose side to move may differ.
+	// Returns the eval cache use of the basic scores computed.
+	space::AlgoDumboStats exploreStates(
 			StateScores& stateScores,
 			const StateSet& stateSet,
 			int curDepth,
 			space::Color whoPlaysNext,
-			const space::AlgoDumboConfig& config);
+			const space::AlgoDumboConfig& config,
+			const Checkpoint* checkpoint = nullptr);
 
 	double computeBasicScore(
 			const State& state,
-			const space::AlgoDumboConfig& config);
+			const space::AlgoDumboConfig& config,
+			EvalCounters* counters = nullptr);
 
 	
 
@@ -0,0 +1,94 @@
+#include "evalCache.h"
+
+#include <cstring>
+
+
+namespace {
+
+	inline std::uint64_t toBits(double score)
+	{
+		std::uint64_t bits;
+		std::memcpy(&bits, &score, sizeof bits);
+		return bits;
+	}
+
+	inline double fromBits(std::uint64_t bits)
+	{
+		double score;
+		std::memcpy(&score, &bits, sizeof score);
+		return score;
+	}
+
+} // end anonymous namespace
+
+
+namespace space {
+
+	EvalCache::EvalCache(std::size_t numEntries)
+	{
+		std::size_t size = 1;
+		while (size < numEntries)
+			size <<= 1;
+		this->slots = std::make_unique<Slot[]>(size);
+		this->mask = size - 1;
+	}
+
+	std::uint64_t EvalCache::combine(std::uint64_t positionHash, std::uint64_t evaluatorKey)
+	{
+		// the evaluator key is multiplied so that a simple xor of two hashes
+		// cannot cancel out between positions and evaluators
+		return positionHash ^ (evaluatorKey * 0x9E3779B97F4A7C15ULL);
+	}
+
+	bool EvalCache::probe(std::uint64_t positionHash, std::uint64_t evaluatorKey, double& score)
+	{
+		std::uint64_t key = combine(positionHash, evaluatorKey);
+		const Slot& slot = this->slots[key & this->mask];
+		std::uint64_t data = slot.data.load(std::memory_order_relaxed);
+		std::uint64_t check = slot.check.load(std::memory_order_relaxed);
+		if ((check ^ data) != key) {
+			this->misses.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		this->hits.fetch_add(1, std::memory_order_relaxed);
+		score = fromBits(data);
+		return true;
+	}
+
+	void EvalCache::store(std::uint64_t positionHash, std::uint64_t evaluatorKey, double score, double computeSeconds)
+	{
+		std::uint64_t key = combine(positionHash, evaluatorKey);
+		std::uint64_t data = toBits(score);
+		Slot& slot = this->slots[key & this->mask];
+		slot.data.store(data, std::memory_order_relaxed);
+		slot.check.store(key ^ data, std::memory_order_relaxed);
+		this->computeNanos.fetch_add(static_cast<long long>(computeSeconds * 1e9), std::memory_order_relaxed);
+	}
+
+	EvalCache::Stats EvalCache::getStats() const
+	{
+		Stats stats;
+		stats.hits = this->hits.load();
+		stats.misses = this->misses.load();
+		stats.computeSeconds = this->computeNanos.load() * 1e-9;
+		return stats;
+	}
+
+	void EvalCache::clear()
+	{
+		for (std::size_t i = 0; i <= this->mask; i++) {
+			this->slots[i].check.store(0, std::memory_order_relaxed);
+			this->slots[i].data.store(0, std::memory_order_relaxed);
+		}
+		this->hits = 0;
+		this->misses = 0;
+		this->computeNanos = 0;
+	}
+
+	EvalCache::Ptr EvalCache::getShared()
+	{
+		static EvalCache::Ptr shared = std::make_shared<EvalCache>();
+		return shared;
+	}
+
+}
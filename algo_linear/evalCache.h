@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+
+namespace space {
+
+	// Lossy fixed-size cache of evaluations, keyed by position hash and by a
+	// key of the evaluator (its weight set), shared by all threads and all
+	// evaluators. Slots are written without locks: each stores the score bits
+	// and the key xor the score bits, so a slot torn by two writers fails the
+	// check and reads as a miss. New entries simply replace old ones.
+	class EvalCache {
+	public:
+		using Ptr = std::shared_ptr<EvalCache>;
+
+		struct Stats {
+			long long hits = 0;
+			long long misses = 0;
+			double computeSeconds = 0; // spent evaluating the misses
+
+			double averageComputeSeconds() const { return misses > 0 ? computeSeconds / misses : 0; }
+			double estimatedSecondsSaved() const { return hits * averageComputeSeconds(); }
+		};
+
+		explicit EvalCache(std::size_t numEntries = 1 << 18); // rounded up to a power of two
+
+		bool probe(std::uint64_t positionHash, std::uint64_t evaluatorKey, double& score);
+		void store(std::uint64_t positionHash, std::uint64_t evaluatorKey, double score, double computeSeconds = 0);
+
+		// cached score, or compute() timed and stored; hit tells which
+		template <class Compute>
+		double getOrCompute(std::uint64_t positionHash, std::uint64_t evaluatorKey, Compute compute, bool& hit)
+		{
+			double score;
+			hit = this->probe(positionHash, evaluatorKey, score);
+			if (hit)
+				return score;
+			auto start = std::chrono::steady_clock::now();
+			score = compute();
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			this->store(positionHash, evaluatorKey, score, elapsed.count());
+			return score;
+		}
+
+		Stats getStats() const;
+		void clear();
+		std::size_t size() const { return mask + 1; }
+
+		static Ptr getShared(); // process-wide cache used by default
+
+	private:
+		struct Slot {
+			std::atomic<std::uint64_t> check{ 0 }; // key ^ data
+			std::atomic<std::uint64_t> data{ 0 };  // score bits
+		};
+		std::unique_ptr<Slot[]> slots;
+		std::size_t mask;
+
+		std::atomic<long long> hits{ 0 };
+		std::atomic<long long> misses{ 0 };
+		std::atomic<long long> computeNanos{ 0 };
+
+		static std::uint64_t combine(std::uint64_t positionHash, std::uint64_t evaluatorKey);
+	};
+
+}
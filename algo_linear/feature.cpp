@@ -1,22 +1,121 @@
 #include "feature.h"
 
+#include "linearKernel.h"
+
+#include <algorithm>
+#include <stdexcept>
+
 
 
 namespace space {
 
+	//=== CLASS  BoardScan
+
+	BoardScan::BoardScan(IBoard::Ptr v_board) : board(v_board)
+	{
+		board->getCounts(this->pieceCount, this->pawnRanks);
+		for (int c = 0; c < 2; c++)
+			for (int t = 0; t < int(PieceType::None); t++)
+				this->numPieces += this->pieceCount[c][t];
+	}
+
+	const PawnStructure& BoardScan::pawns() const
+	{
+		if (!this->pawnStructure.has_value())
+			this->pawnStructure = PawnTable::probe(this->board->getPawnHash(), this->pawnRanks);
+		return this->pawnStructure.value();
+	}
+
+
+	//=== CLASS  BatchScan
+
+	void BatchScan::assign(const IBoard::Ptr* boards, std::size_t count)
+	{
+		this->scans.clear();
+		for (std::size_t i = 0; i < count; i++)
+			this->scans.emplace_back(boards[i]);
+		for (int c = 0; c < 2; c++)
+			for (int t = 0; t < int(PieceType::None); t++) {
+				std::vector<double>& row = this->pieceCount[c][t];
+				row.resize(count);
+				for (std::size_t i = 0; i < count; i++)
+					row[i] = this->scans[i].pieceCount[c][t];
+			}
+	}
+
+	void BatchScan::clear()
+	{
+		this->scans.clear();
+	}
+
+
+	//=== CLASS  Feature
+
+	double Feature::getValue(IBoard::Ptr board, Color color)
+	{
+		return this->getValue(BoardScan(board), color);
+	}
+
+	void Feature::getDifferences(const BatchScan& batch, double* values)
+	{
+		for (std::size_t i = 0; i < batch.size(); i++)
+			values[i] = this->getValue(batch.scans[i], Color::White) - this->getValue(batch.scans[i], Color::Black);
+	}
+
+	Feature::Ptr Feature::fromString(const std::string& name)
+	{
+		auto withIndex = [&name](const std::string& prefix, int limit) -> std::optional<int> {
+			if (name.size() != prefix.size() + 1 || name.compare(0, prefix.size(), prefix) != 0)
+				return std::nullopt;
+			int index = name.back() - '0';
+			if (index < 0 || index >= limit)
+				return std::nullopt;
+			return index;
+		};
+
+		if (auto t = withIndex("Feature_Piece", int(PieceType::None)))
+			return std::make_shared<Feature_Piece>(PieceType(*t));
+		if (auto file = withIndex("Feature_PawnRank", 8))
+			return std::make_shared<Feature_PawnRank>(*file);
+		if (name == "Feature_PawnAdvance")
+			return std::make_shared<Feature_PawnAdvance>();
+		if (name == "Feature_PassedPawn")
+			return std::make_shared<Feature_PassedPawn>();
+		if (name == "Feature_DoubledPawn")
+			return std::make_shared<Feature_DoubledPawn>();
+		if (name == "Feature_IsolatedPawn")
+			return std::make_shared<Feature_IsolatedPawn>();
+		if (name == "Feature_MinorBalance")
+			return std::make_shared<Feature_MinorBalance>();
+		if (name == "Feature_Dummy")
+			return std::make_shared<Feature_Dummy>();
+		if (name == "Feature_MoveCount")
+			return std::make_shared<Feature_MoveCount>();
+		if (name == "Feature_Mobility")
+			return std::make_shared<Feature_Mobility>();
+		if (name == "Feature_HangingPieces")
+			return std::make_shared<Feature_HangingPieces>();
+		if (name == "Feature_KingZoneAttacks")
+			return std::make_shared<Feature_KingZoneAttacks>();
+		if (name == "Feature_PieceMove")
+			return std::make_shared<Feature_PieceMove>();
+		throw std::runtime_error("Unknown feature " + name);
+	}
+
+
 	//=== CLASS  Feature_Piece
 
-	double Feature_Piece::getValue(IBoard::Ptr board, Color color)
+	double Feature_Piece::getValue(const BoardScan& scan, Color color)
 	{
-		double counter = 0;
-		for(int i = 0; i < 8; i++)
-			for (int j = 0; j < 8; j++) {
-				std::optional<Piece> p = board->getPiece({ i,j });
-				if (p.has_value())
-					if (p.value().pieceType == this->piecetype && p.value().color == color)
-						counter+= 1;
-			}		
-		return counter;
+		return scan.count(color, this->piecetype);
+	}
+
+	void Feature_Piece::getDifferences(const BatchScan& batch, double* values)
+	{
+		const double* white = batch.pieceCount[int(Color::White)][int(this->piecetype)].data();
+		const double* black = batch.pieceCount[int(Color::Black)][int(this->piecetype)].data();
+		for (std::size_t i = 0; i < batch.size(); i++)
+			values[i] = white[i] - black[i];
 	}
 
 	std::string Feature_Piece::toString()
@@ -28,23 +127,18 @@ namespace space {
 	
 	//=== CLASS  Feature_PawnRank
 
-	// includes discounts for multiple pawns in a file
-	double Feature_PawnRank::getValue(IBoard::Ptr board, Color color)
-	{
-		double counter = 0;
-		const double discountFactor = 0.75;
-		double DF = 1;
-		int direction = colorToSign(color);
-		for (int i = 4 *(1 + direction); (i>=0) && (i < 8) ; i-= direction) {
-			std::optional<Piece> p = board->getPiece({ i, this->file });
-			if (p.has_value()
-				&& p.value().color == color
-				&& (p.value().pieceType == PieceType::Pawn) ) {
-				counter += (color == Color::White ? i : 7 - i) * DF;
-				DF *= discountFactor;
-			}
+	// includes discounts for multiple pawns in a file, most advanced pawn first
+	double Feature_PawnRank::getValue(const BoardScan& scan, Color color)
+	{
+		return scan.pawns().fileRank[int(color)][this->file];
+	}
+
+	void Feature_PawnRank::getDifferences(const BatchScan& batch, double* values)
+	{
+		for (std::size_t i = 0; i < batch.size(); i++) {
+			const PawnStructure& pawns = batch.scans[i].pawns();
+			values[i] = pawns.fileRank[int(Color::White)][this->file] - pawns.fileRank[int(Color::Black)][this->file];
 		}
-		return counter;
 	}
 
 	std::string Feature_PawnRank::toString()
@@ -54,40 +148,43 @@ namespace space {
 	}
 
 
+	//=== CLASS  Feature_PawnAdvance
+
+	// pawns start on rank 1 for White and rank 6 for Black
+	static int pawnAdvance(const BoardScan& scan, Color color)
+	{
+		int ranks = 0;
+		for (int j = 0; j < 8; j++)
+			for (int rank = 0, pawns = scan.pawnRanks[int(color)][j]; pawns; rank++, pawns >>= 1)
+				if (pawns & 1)
+					ranks += color == Color::White ? rank - 1 : 6 - rank;
+		return ranks;
+	}
+
+	double Feature_PawnAdvance::getValue(const BoardScan& scan, Color color)
+	{
+		return pawnAdvance(scan, color);
+	}
+
+	void Feature_PawnAdvance::getDifferences(const BatchScan& batch, double* values)
+	{
+		for (std::size_t i = 0; i < batch.size(); i++)
+			values[i] = pawnAdvance(batch.scans[i], Color::White) - pawnAdvance(batch.scans[i], Color::Black);
+	}
+
+	std::string Feature_PawnAdvance::toString()
+	{
+		return std::string("Feature_PawnAdvance");
+	}
+
+
 	//=== CLASS  Feature_PassedPawn
 
 	// number of pawns of color, which are beyond any pawns of opposite color, 
 	// ie. no more pawns in front in same or adjacent file
-	double Feature_PassedPawn::getValue(IBoard::Ptr board, Color color)
-	{
-		double counter = 0;
-		for(int i = 0; i < 8; i++)
-			for (int j = 0; j < 8; j++) {
-				std::optional<Piece> p = board->getPiece({ i, j });
-				if (p.has_value()
-					&& p.value().color == color
-					&& (p.value().pieceType == PieceType::Pawn) )
-				{
-					int flag = 1;
-					int direction = colorToSign(color);
-					for (int k = i + direction; (k > 0) && (k < 8); k+= direction)
-						for (int l = j - 1; l <= j + 1; l++) 
-						{
-							if (l < 0 || l >= 8) {
-								break;
-							}
-							std::optional<Piece> pOpp = board->getPiece({ k, l });
-							if (p.has_value()
-								&& p.value().color != color
-								&& (p.value().pieceType == PieceType::Pawn)) 
-							{
-								flag = 0;
-							}
-						}
-					counter += flag;
-				}
-			}
-		return counter;
+	double Feature_PassedPawn::getValue(const BoardScan& scan, Color color)
+	{
+		return scan.pawns().passed[int(color)];
 	}
 
 	std::string Feature_PassedPawn::toString()
@@ -96,28 +193,42 @@ namespace space {
 	}
 
 
+	//=== CLASS  Feature_DoubledPawn
+
+	// pawns behind another pawn of the same color on their file
+	double Feature_DoubledPawn::getValue(const BoardScan& scan, Color color)
+	{
+		return scan.pawns().doubled[int(color)];
+	}
+
+	std::string Feature_DoubledPawn::toString()
+	{
+		return std::string("Feature_DoubledPawn");
+	}
+
+
+	//=== CLASS  Feature_IsolatedPawn
+
+	// pawns without a pawn of the same color on the adjacent files
+	double Feature_IsolatedPawn::getValue(const BoardScan& scan, Color color)
+	{
+		return scan.pawns().isolated[int(color)];
+	}
+
+	std::string Feature_IsolatedPawn::toString()
+	{
+		return std::string("Feature_IsolatedPawn");
+	}
+
+
 	//=== CLASS  Feature_MinorBalance
 
 
-	double Feature_MinorBalance::getValue(IBoard::Ptr board, Color color)
-	{
-		int pawnCounter = 0, bishopCounter = 0, knightCounter = 0;
-		for (int i = 0; i < 8; i++)
-			for (int j = 0; j < 8; j++) {
-				std::optional<Piece> p = board->getPiece({ i,j });
-				if (p.has_value())
-				{
-					if (p.value().pieceType == PieceType::Pawn)
-						++pawnCounter;
-					else if (p.value().color == color) 
-					{
-						if (p.value().pieceType == PieceType::Bishop)
-							++bishopCounter;
-						else if (p.value().pieceType == PieceType::Knight)
-							++knightCounter;
-					}
-				}	
-			}
+	double Feature_MinorBalance::getValue(const BoardScan& scan, Color color)
+	{
+		int pawnCounter = scan.count(PieceType::Pawn);
+		int bishopCounter = scan.count(color, PieceType::Bishop);
+		int knightCounter = scan.count(color, PieceType::Knight);
 		return (knightCounter - bishopCounter) * (pawnCounter-8);
 	}
 
@@ -129,20 +240,10 @@ namespace space {
 
 	//=== CLASS  Feature_Dummy
 
-	double Feature_Dummy::getValue(IBoard::Ptr board, Color color)
-	{
-		int pieceCounter = 0, kingRank = 0;
-		for (int i = 0; i < 8; i++)
-			for (int j = 0; j < 8; j++) {
-				std::optional<Piece> p = board->getPiece({ i,j });
-				if (p.has_value())
-				{
-					++pieceCounter;
-					if (p.value().color == Color::White &&
-						p.value().pieceType == PieceType::King)
-						kingRank = i;
-				}
-			}
+	double Feature_Dummy::getValue(const BoardScan& scan, Color color)
+	{
+		int pieceCounter = scan.numPieces;
+		int kingRank = scan.board->getKingPosition(Color::White).rank;
 		return (10.0 - pieceCounter) * (color == Color::White ? kingRank : 7 - kingRank);
 	}
 
@@ -155,10 +256,10 @@ namespace space {
 	//=== CLASS  Feature_MoveCount
 
 
-	double Feature_MoveCount::getValue(IBoard::Ptr board, Color color)
+	double Feature_MoveCount::getValue(const BoardScan& scan, Color color)
 	{
-		if (board->whoPlaysNext() == color)
-			return (board->getValidMoves().size());
+		if (scan.board->whoPlaysNext() == color)
+			return scan.board->countLegalMoves();
 		return 0.0;
 	}
 
@@ -169,10 +270,73 @@ namespace space {
 
 
 
+	//=== CLASS  Feature_Mobility
+
+	double Feature_Mobility::getValue(const BoardScan& scan, Color color)
+	{
+		return scan.board->countPseudoLegalMoves(color);
+	}
+
+	std::string Feature_Mobility::toString()
+	{
+		return std::string("Feature_Mobility");
+	}
+
+
+
+	//=== CLASS  Feature_HangingPieces
+
+	double Feature_HangingPieces::getValue(const BoardScan& scan, Color color)
+	{
+		const IBoard& board = *scan.board;
+		Color other = color == Color::White ? Color::Black : Color::White;
+		std::uint64_t threatened = board.getAttackedSquares(other) & ~board.getAttackedSquares(color);
+		int count = 0;
+		for (int square = 0; square < 64; ++square) {
+			if (!((threatened >> square) & 1))
+				continue;
+			auto piece = board.getPiece(Position(square / 8, square % 8));
+			if (piece && piece->color == color && piece->pieceType != PieceType::King)
+				++count;
+		}
+		return count;
+	}
+
+	std::string Feature_HangingPieces::toString()
+	{
+		return std::string("Feature_HangingPieces");
+	}
+
+
+
+	//=== CLASS  Feature_KingZoneAttacks
+
+	double Feature_KingZoneAttacks::getValue(const BoardScan& scan, Color color)
+	{
+		if (scan.count(color, PieceType::King) == 0)
+			return 0.0;
+		const IBoard& board = *scan.board;
+		Color other = color == Color::White ? Color::Black : Color::White;
+		std::uint64_t attacked = board.getAttackedSquares(other);
+		Position king = board.getKingPosition(color);
+		int count = 0;
+		for (int rank = std::max(king.rank - 1, 0); rank <= std::min(king.rank + 1, 7); ++rank)
+			for (int file = std::max(king.file - 1, 0); file <= std::min(king.file + 1, 7); ++file)
+				count += int((attacked >> (rank * 8 + file)) & 1);
+		return count;
+	}
+
+	std::string Feature_KingZoneAttacks::toString()
+	{
+		return std::string("Feature_KingZoneAttacks");
+	}
+
+
+
 	//=== CLASS  Feature_PieceMove
 
 
-	double Feature_PieceMove::getValue(IBoard::Ptr board, Color color)
+	double Feature_PieceMove::getValue(const BoardScan& scan, Color color)
 	{
 		return 0.0; // TODO
 	}
@@ -184,6 +348,71 @@ namespace space {
 
 
 
+	//=== CLASS  LinearEvaluator
+
+	LinearEvaluator::LinearEvaluator(const std::map<Feature::Ptr, double>& wts)
+	{
+		// the map is ordered by pointer, so features are sorted by name: the same
+		// weights then give the same order, sums and key in every run
+		std::vector<std::pair<std::string, std::pair<Feature::Ptr, double>>> named;
+		for (const auto& v : wts)
+			named.push_back({ v.first->toString(), v });
+		std::stable_sort(named.begin(), named.end(),
+			[](const auto& a, const auto& b) { return a.first < b.first; });
+
+		// FNV-1a over names and weight bits
+		std::uint64_t hash = 0xCBF29CE484222325ULL;
+		auto mix = [&hash](const void* data, std::size_t size) {
+			const unsigned char* bytes = static_cast<const unsigned char*>(data);
+			for (std::size_t i = 0; i < size; i++)
+				hash = (hash ^ bytes[i]) * 0x100000001B3ULL;
+		};
+		for (const auto& nw : named) {
+			this->features.push_back(nw.second.first);
+			this->weights.push_back(nw.second.second);
+			mix(nw.first.data(), nw.first.size());
+			mix(&nw.second.second, sizeof nw.second.second);
+		}
+		this->key = hash;
+	}
+
+	double LinearEvaluator::evaluate(IBoard::Ptr board) const
+	{
+		BoardScan scan(board);
+		double score = 0;
+		for (std::size_t k = 0; k < this->features.size(); k++)
+			score += this->weights[k] * (this->features[k]->getValue(scan, Color::White) - this->features[k]->getValue(scan, Color::Black));
+		return score;
+	}
+
+	void LinearEvaluator::extract(const BoardScan& scan, double* values) const
+	{
+		for (std::size_t k = 0; k < this->features.size(); k++)
+			values[k] = this->features[k]->getValue(scan, Color::White) - this->features[k]->getValue(scan, Color::Black);
+	}
+
+	void LinearEvaluator::evaluateBatch(const IBoard::Ptr* boards, std::size_t count, double* scores) const
+	{
+		// buffers keep their capacity from one batch to the next
+		thread_local BatchScan batch;
+		thread_local std::vector<double> values;
+		batch.assign(boards, count);
+		values.resize(this->features.size() * count);
+
+		for (std::size_t k = 0; k < this->features.size(); k++)
+			this->features[k]->getDifferences(batch, values.data() + k * count);
+		linearKernel(values.data(), count, this->weights.data(), this->features.size(), count, scores);
+		batch.clear(); // do not hold on to the boards
+	}
+
+	void LinearEvaluator::evaluateBatch(const std::vector<IBoard::Ptr>& boards, std::vector<double>& scores) const
+	{
+		scores.resize(boards.size());
+		this->evaluateBatch(boards.data(), boards.size(), scores.data());
+	}
+
+
+
 	//=== CLASS FEATURE comparison
 	/*
 	bool Feature::operator<(const Feature& that) const
@@ -4,25 +4,69 @@
 #include "chess/board.h"
 #include "chess/algo.h"
 
+#include "pawnTable.h"
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
 
 
 namespace space {
 
+	// Everything the features need, read once from the counts the board keeps
+	struct BoardScan {
+		IBoard::Ptr board;
+		int pieceCount[2][7] = {};         // by color and piece type
+		std::uint8_t pawnRanks[2][8] = {}; // by color and file, bit r set for a pawn on rank r
+		int numPieces = 0;
+
+		explicit BoardScan(IBoard::Ptr v_board);
+
+		const PawnStructure& pawns() const; // from the pawn table, probed on first use
+
+		int count(Color color, PieceType pieceType) const {
+			return pieceCount[int(color)][int(pieceType)];
+		}
+		int count(PieceType pieceType) const {
+			return count(Color::White, pieceType) + count(Color::Black, pieceType);
+		}
+
+	private:
+		mutable std::optional<PawnStructure> pawnStructure;
+	};
+
+	// Scans of many positions. The piece counts are also laid out count by
+	// count across the positions, so a feature can fill a batch in one loop.
+	struct BatchScan {
+		std::vector<BoardScan> scans;
+		std::vector<double> pieceCount[2][7]; // by color and piece type, then position
+
+		void assign(const IBoard::Ptr* boards, std::size_t count);
+		void clear(); // keeps the capacity, drops the boards
+		std::size_t size() const { return scans.size(); }
+	};
+
 	class Feature {
 	public:
 		using Ptr = std::shared_ptr<Feature>;
-		virtual double getValue(IBoard::Ptr board, Color color) = 0;
+		virtual double getValue(const BoardScan& scan, Color color) = 0;
+		virtual double getValue(IBoard::Ptr board, Color color); // scans the board for a single value
+		virtual void getDifferences(const BatchScan& batch, double* values); // White minus Black value of each position
 		virtual std::string toString()=0;
+		static Ptr fromString(const std::string& name); // inverse of toString, throws on unknown names
 
 		// virtual ~Feature() = 0;   //  -- gives LNK2019, CHK
-		
+
 		//bool operator <(const Feature& that) const;
 	};
 
 	class Feature_Piece : public Feature {
 	public:
 		Feature_Piece(PieceType p) : piecetype(p) {}
-		double getValue(IBoard::Ptr board, Color color) override;
+		using Feature::getValue;
+		double getValue(const BoardScan& scan, Color color) override;
+		void getDifferences(const BatchScan& batch, double* values) override;
 		std::string toString() override;
 
 	private:
@@ -33,49 +77,135 @@ namespace space {
 	class Feature_PawnRank : public Feature {
 	public:
 		Feature_PawnRank(int v_file) : file(v_file) {}
-		double getValue(IBoard::Ptr board, Color color) override;
+		using Feature::getValue;
+		double getValue(const BoardScan& scan, Color color) override;
+		void getDifferences(const BatchScan& batch, double* values) override;
 		std::string toString() override;
 
 	private:
 		int file;
 	};
 
-	
+
+	// ranks each pawn of color has advanced from its starting rank
+	class Feature_PawnAdvance : public Feature {
+	public:
+		using Feature::getValue;
+		double getValue(const BoardScan& scan, Color color) override;
+		void getDifferences(const BatchScan& batch, double* values) override;
+		std::string toString() override;
+	};
+
+
 	class Feature_PassedPawn : public Feature {
 	public:
-		double getValue(IBoard::Ptr board, Color color) override;
+		using Feature::getValue;
+		double getValue(const BoardScan& scan, Color color) override;
+		std::string toString() override;
+
+	};
+
+	class Feature_DoubledPawn : public Feature {
+	public:
+		using Feature::getValue;
+		double getValue(const BoardScan& scan, Color color) override;
+		std::string toString() override;
+	};
+
+	class Feature_IsolatedPawn : public Feature {
+	public:
+		using Feature::getValue;
+		double getValue(const BoardScan& scan, Color color) override;
 		std::string toString() override;
-	
 	};
 
 	class Feature_MinorBalance : public Feature {
 	public:
-		double getValue(IBoard::Ptr board, Color color) override;
+		using Feature::getValue;
+		double getValue(const BoardScan& scan, Color color) override;
 		std::string toString() override;
 	};
 
 	class Feature_Dummy : public Feature {
 	public:
-		double getValue(IBoard::Ptr board, Color color) override;
+		using Feature::getValue;
+		double getValue(const BoardScan& scan, Color color) override;
 		std::string toString() override;
 
 	};
-	
+
 
 	class Feature_MoveCount : public Feature {
 	public:
-		double getValue(IBoard::Ptr board, Color color) override;
+		using Feature::getValue;
+		double getValue(const BoardScan& scan, Color color) override;
+		std::string toString() override;
+	};
+
+
+	// moves of each side, ignoring checks on its own king: an approximate
+	// mobility that, unlike Feature_MoveCount, counts both sides
+	class Feature_Mobility : public Feature {
+	public:
+		using Feature::getValue;
+		double getValue(const BoardScan& scan, Color color) override;
+		std::string toString() override;
+	};
+
+
+	// pieces of color, other than the king, attacked and not defended
+	class Feature_HangingPieces : public Feature {
+	public:
+		using Feature::getValue;
+		double getValue(const BoardScan& scan, Color color) override;
+		std::string toString() override;
+	};
+
+
+	// squares around the king of color that the other color attacks
+	class Feature_KingZoneAttacks : public Feature {
+	public:
+		using Feature::getValue;
+		double getValue(const BoardScan& scan, Color color) override;
 		std::string toString() override;
 	};
 
 
 	class Feature_PieceMove : public Feature {
 	public :
-		double getValue(IBoard::Ptr board, Color color) override;
+		using Feature::getValue;
+		double getValue(const BoardScan& scan, Color color) override;
 		std::string toString() override;
 	};
 
 
 
+	// Weighted features flattened into vectors. A position is scanned once,
+	// each feature fills one slot with its White minus Black value, and the
+	// score is the dot product with the weights.
+	class LinearEvaluator {
+	public:
+		LinearEvaluator() {}
+		LinearEvaluator(const std::map<Feature::Ptr, double>& wts);
+
+		double evaluate(IBoard::Ptr board) const;
+		void extract(const BoardScan& scan, double* values) const; // size() values
+
+		// Scores of many positions in one call. The positions are scanned
+		// together, each feature fills its row of White minus Black values
+		// across the batch and linearKernel combines the rows.
+		void evaluateBatch(const IBoard::Ptr* boards, std::size_t count, double* scores) const;
+		void evaluateBatch(const std::vector<IBoard::Ptr>& boards, std::vector<double>& scores) const;
+		std::size_t size() const { return features.size(); }
+		const std::vector<double>& getWeights() const { return weights; }
+		const std::vector<Feature::Ptr>& getFeatures() const { return features; } // sorted by name, the order of extract
+		std::uint64_t getKey() const { return key; } // identifies the feature and weight set, for caches
+
+	private:
+		std::vector<Feature::Ptr> features;
+		std::vector<double> weights;
+		std::uint64_t key = 0;
+	};
+
 
 }
@@ -0,0 +1,123 @@
+#include "linearKernel.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SPACE_KERNEL_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// AVX2 is compiled per function and chosen at run time, so the
+// binary still runs on CPUs without it
+#if defined(SPACE_KERNEL_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#define SPACE_KERNEL_AVX2 1
+#include <immintrin.h>
+#endif
+
+
+namespace {
+
+	using space::linearKernelScalar;
+
+	using Kernel = void(*)(const double*, std::size_t, const double*, std::size_t, std::size_t, double*);
+
+#ifdef SPACE_KERNEL_SSE2
+	void linearKernelSse2(const double* values, std::size_t stride,
+		const double* weights, std::size_t numFeatures,
+		std::size_t count, double* scores)
+	{
+		std::size_t i = 0;
+		for (; i + 2 <= count; i += 2) {
+			__m128d sum = _mm_setzero_pd();
+			for (std::size_t k = 0; k < numFeatures; k++)
+				sum = _mm_add_pd(sum, _mm_mul_pd(_mm_set1_pd(weights[k]), _mm_loadu_pd(values + k * stride + i)));
+			_mm_storeu_pd(scores + i, sum);
+		}
+		if (i < count)
+			linearKernelScalar(values + i, stride, weights, numFeatures, count - i, scores + i);
+	}
+#endif
+
+#ifdef SPACE_KERNEL_AVX2
+	__attribute__((target("avx2,fma")))
+	void linearKernelAvx2(const double* values, std::size_t stride,
+		const double* weights, std::size_t numFeatures,
+		std::size_t count, double* scores)
+	{
+		std::size_t i = 0;
+		for (; i + 8 <= count; i += 8) { // two accumulators hide the fma latency
+			__m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+			for (std::size_t k = 0; k < numFeatures; k++) {
+				__m256d w = _mm256_set1_pd(weights[k]);
+				const double* row = values + k * stride + i;
+				sum0 = _mm256_fmadd_pd(w, _mm256_loadu_pd(row), sum0);
+				sum1 = _mm256_fmadd_pd(w, _mm256_loadu_pd(row + 4), sum1);
+			}
+			_mm256_storeu_pd(scores + i, sum0);
+			_mm256_storeu_pd(scores + i + 4, sum1);
+		}
+		for (; i + 4 <= count; i += 4) {
+			__m256d sum = _mm256_setzero_pd();
+			for (std::size_t k = 0; k < numFeatures; k++)
+				sum = _mm256_fmadd_pd(_mm256_set1_pd(weights[k]), _mm256_loadu_pd(values + k * stride + i), sum);
+			_mm256_storeu_pd(scores + i, sum);
+		}
+		if (i < count)
+			linearKernelSse2(values + i, stride, weights, numFeatures, count - i, scores + i);
+	}
+#endif
+
+	struct KernelChoice {
+		Kernel kernel;
+		const char* name;
+	};
+
+	KernelChoice chooseKernel()
+	{
+#ifdef SPACE_KERNEL_AVX2
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+			return { linearKernelAvx2, "avx2" };
+#endif
+#ifdef SPACE_KERNEL_SSE2
+		return { linearKernelSse2, "sse2" };
+#else
+		return { linearKernelScalar, "scalar" };
+#endif
+	}
+
+	const KernelChoice& getKernel()
+	{
+		static const KernelChoice choice = chooseKernel();
+		return choice;
+	}
+
+} // end anonymous namespace
+
+
+namespace space {
+
+	void linearKernel(const double* values, std::size_t stride,
+		const double* weights, std::size_t numFeatures,
+		std::size_t count, double* scores)
+	{
+		getKernel().kernel(values, stride, weights, numFeatures, count, scores);
+	}
+
+	void linearKernelScalar(const double* values, std::size_t stride,
+		const double* weights, std::size_t numFeatures,
+		std::size_t count, double* scores)
+	{
+		for (std::size_t i = 0; i < count; i++)
+			scores[i] = 0;
+		for (std::size_t k = 0; k < numFeatures; k++) {
+			const double* row = values + k * stride;
+			for (std::size_t i = 0; i < count; i++)
+				scores[i] += weights[k] * row[i];
+		}
+	}
+
+	std::string linearKernelName()
+	{
+		return getKernel().name;
+	}
+
+}
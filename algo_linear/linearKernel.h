@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+
+namespace space {
+
+	// scores[i] = sum over k of weights[k] * values[k * stride + i], for i < count.
+	// values are laid out feature by feature (structure of arrays), stride >= count.
+	// Picks the widest kernel the CPU supports on first use.
+	void linearKernel(const double* values, std::size_t stride,
+		const double* weights, std::size_t numFeatures,
+		std::size_t count, double* scores);
+
+	// same result without SIMD, for reference
+	void linearKernelScalar(const double* values, std::size_t stride,
+		const double* weights, std::size_t numFeatures,
+		std::size_t count, double* scores);
+
+	std::string linearKernelName(); // "avx2", "sse2" or "scalar"
+
+}
@@ -0,0 +1,279 @@
+#include "mateSolver.h"
+
+#include <chess/algo_factory.h>
+#include <common/base.h>
+
+#include <algorithm>
+#include <memory>
+
+
+namespace {
+
+	constexpr unsigned int infinity = 1u << 30;
+
+	inline unsigned int saturatedAdd(unsigned int a, unsigned int b) {
+		return std::min(infinity, a + b);
+	}
+
+	// tables of solves for White and Black attackers share one map
+	constexpr std::uint64_t blackAttackerKey = 0x9e3779b97f4a7c15ULL;
+
+} // end anonymous namespace
+
+
+namespace space {
+
+	// OR node when the attacker is to move, AND node otherwise.
+	// proof/disproof numbers: how many leaves must still be solved to
+	// prove/disprove a mate below this node.
+	struct MateSolver::PnNode {
+		IBoard::Ptr board;        // dropped once expanded
+		Move move;
+		PnNode* parent = nullptr;
+		std::vector<std::unique_ptr<PnNode>> children;
+		std::uint64_t key = 0;
+		int depth = 0;
+		bool attacker = true;
+		bool expanded = false;
+		unsigned int pn = 1;
+		unsigned int dn = 1;
+		int matePlies = -1;       // set once proven
+
+		void setProven(int plies) { pn = 0; dn = infinity; matePlies = plies; }
+		void setDisproven() { pn = infinity; dn = 0; }
+	};
+
+
+	MateSolverConfig::MateSolverConfig() :
+		maxNodes(100 * 1000),
+		maxPlies(9)
+	{ }
+
+	MateSolverConfig::MateSolverConfig(const nlohmann::json& config) :
+		maxNodes(config.value("MaxNodes", 100 * 1000)),
+		maxPlies(config.value("MaxPlies", 9))
+	{ }
+
+
+
+	MateSolver::MateSolver() : MateSolver(MateSolverConfig()) {}
+
+	MateSolver::MateSolver(const MateSolverConfig& config) :
+		m_config(config)
+	{
+		space_assert(config.maxNodes > 0, "MateSolver needs a positive node budget");
+		space_assert(config.maxPlies > 0, "MateSolver needs a positive ply limit");
+	}
+
+	MateResult MateSolver::solve(IBoard::Ptr board)
+	{
+		if (m_table.size() > static_cast<std::size_t>(m_config.maxNodes) * 4)
+			m_table.clear();
+		m_attacker = board->whoPlaysNext();
+		m_nodes = 0;
+
+		MateResult result;
+		// the attacker moves on odd plies, so only odd limits can end in mate
+		for (int plies = 1; plies <= m_config.maxPlies; plies += 2) {
+			PnNode root;
+			root.board = board;
+			root.key = this->tableKey(*board);
+			bool proven = this->search(root, plies);
+			if (proven) {
+				result.isMate = true;
+				result.matePlies = root.matePlies;
+				this->collectLine(root, result.line);
+				break;
+			}
+			if (root.dn != 0) { // neither proven nor disproven
+				result.budgetExhausted = true;
+				break;
+			}
+		}
+		result.nodes = m_nodes;
+		return result;
+	}
+
+	bool MateSolver::looksForcing(IBoard::Ptr board)
+	{
+		if (board->isUnderCheck(board->whoPlaysNext()))
+			return true;
+		for (const auto& mb : board->getValidMoves())
+			if (mb.second->isUnderCheck(mb.second->whoPlaysNext()))
+				return true;
+		return false;
+	}
+
+	std::uint64_t MateSolver::tableKey(const IBoard& board) const
+	{
+		return board.getHash() ^ (m_attacker == Color::Black ? blackAttackerKey : 0);
+	}
+
+	bool MateSolver::search(PnNode& root, int maxPlies)
+	{
+		this->expand(root, maxPlies);
+		this->update(&root, maxPlies);
+		while (root.pn != 0 && root.dn != 0 && m_nodes < m_config.maxNodes) {
+			// most proving node: cheapest proof at OR nodes, cheapest disproof at AND nodes
+			PnNode* node = &root;
+			while (node->expanded && !node->children.empty()) {
+				PnNode* next = nullptr;
+				for (const auto& child : node->children) {
+					if (!next || (node->attacker ? child->pn < next->pn : child->dn < next->dn))
+						next = child.get();
+				}
+				node = next;
+			}
+			if (node->expanded) // only when proof numbers saturated
+				break;
+			this->expand(*node, maxPlies);
+			this->update(node, maxPlies);
+		}
+		return root.pn == 0;
+	}
+
+	// Children are solved on creation when they are mate, beyond the ply
+	// limit or already in the table; everything else starts at pn = dn = 1.
+	void MateSolver::expand(PnNode& node, int maxPlies)
+	{
+		IBoard::MoveMap allMoves = node.board->getValidMoves();
+		node.expanded = true;
+		if (allMoves.empty()) {
+			bool mated = node.board->isUnderCheck(node.board->whoPlaysNext());
+			if (mated && !node.attacker)
+				node.setProven(0);
+			else
+				node.setDisproven();
+			return;
+		}
+
+		for (const auto& mb : allMoves) {
+			auto child = std::make_unique<PnNode>();
+			child->board = mb.second;
+			child->move = mb.first;
+			child->parent = &node;
+			child->key = this->tableKey(*mb.second);
+			child->depth = node.depth + 1;
+			child->attacker = !node.attacker;
+			++m_nodes;
+
+			int remaining = maxPlies - child->depth;
+			auto it = m_table.find(child->key);
+			if (mb.second->isCheckMate()) {
+				child->expanded = true;
+				if (child->attacker)
+					child->setDisproven();
+				else
+					child->setProven(0);
+			}
+			else if (remaining <= 0)
+				child->setDisproven();
+			else if (it != m_table.end() && it->second.provenPlies >= 0 && it->second.provenPlies <= remaining)
+				child->setProven(it->second.provenPlies);
+			else if (it != m_table.end() && it->second.disprovenRemaining >= remaining)
+				child->setDisproven();
+			node.children.push_back(std::move(child));
+		}
+		node.board.reset();
+	}
+
+	// back up proof numbers to the root, recording solved nodes in the table
+	void MateSolver::update(PnNode* node, int maxPlies)
+	{
+		for (; node != nullptr; node = node->parent) {
+			if (!node->children.empty()) {
+				unsigned int minPn = infinity, minDn = infinity, sumPn = 0, sumDn = 0;
+				int shortest = -1, longest = -1;
+				for (const auto& child : node->children) {
+					minPn = std::min(minPn, child->pn);
+					minDn = std::min(minDn, child->dn);
+					sumPn = saturatedAdd(sumPn, child->pn);
+					sumDn = saturatedAdd(sumDn, child->dn);
+					if (child->pn == 0) {
+						if (shortest < 0 || child->matePlies < shortest)
+							shortest = child->matePlies;
+						longest = std::max(longest, child->matePlies);
+					}
+				}
+				node->pn = node->attacker ? minPn : sumPn;
+				node->dn = node->attacker ? sumDn : minDn;
+				if (node->pn == 0)
+					node->matePlies = 1 + (node->attacker ? shortest : longest);
+			}
+
+			if (node->pn == 0) {
+				TTEntry& entry = m_table[node->key];
+				if (entry.provenPlies < 0 || node->matePlies < entry.provenPlies)
+					entry.provenPlies = node->matePlies;
+			}
+			else if (node->dn == 0) {
+				TTEntry& entry = m_table[node->key];
+				entry.disprovenRemaining = std::max(entry.disprovenRemaining, maxPlies - node->depth);
+				node->children.clear(); // nothing to extract from a refuted line
+			}
+		}
+	}
+
+	// Shortest mate for the attacker, longest defence for the defender.
+	// Leaves proven by the table have no subtree, they are solved again
+	// with a tighter limit to extend the line.
+	void MateSolver::collectLine(PnNode& root, std::vector<Move>& line)
+	{
+		PnNode* node = &root;
+		while (node->matePlies > 0 && !node->children.empty()) {
+			PnNode* next = nullptr;
+			for (const auto& child : node->children) {
+				if (child->pn != 0)
+					continue;
+				if (!next || (node->attacker ? child->matePlies < next->matePlies : child->matePlies > next->matePlies))
+					next = child.get();
+			}
+			line.push_back(next->move);
+			node = next;
+		}
+		if (node->matePlies > 0 && node->board) {
+			PnNode subRoot;
+			subRoot.board = node->board;
+			subRoot.key = node->key;
+			subRoot.attacker = node->attacker;
+			if (this->search(subRoot, node->matePlies))
+				this->collectLine(subRoot, line);
+		}
+	}
+
+
+
+	//-------------------------------------------------------------------------
+	// AlgoMateOracle
+
+	AlgoMateOracle::AlgoMateOracle(IAlgo::Ptr fallback, const MateSolverConfig& config) :
+		m_fallback(fallback), m_solver(config)
+	{
+		space_assert(m_fallback != nullptr, "AlgoMateOracle needs a fallback algo");
+	}
+
+	AlgoMateOracle::AlgoMateOracle(const nlohmann::json& config) :
+		m_solver(MateSolverConfig(config))
+	{
+		auto fallbackIt = config.find(getFallbackField());
+		space_assert(fallbackIt != config.end(), "AlgoMateOracle needs a fallback algo");
+		auto fallback = AlgoFactory::tryCreateAlgo(*fallbackIt);
+		space_assert(fallback.has_value(), "AlgoMateOracle fallback algo is unknown");
+		m_fallback = fallback.value();
+	}
+
+	Move AlgoMateOracle::getNextMove(IBoard::Ptr board)
+	{
+		if (MateSolver::looksForcing(board)) {
+			MateResult result = m_solver.solve(board);
+			if (result.isMate && !result.line.empty())
+				return result.line.front();
+		}
+		return m_fallback->getNextMove(board);
+	}
+
+	std::string AlgoMateOracle::getAlgoName() { return "AlgoMateOracle"; }
+	std::string AlgoMateOracle::getFallbackField() { return "Fallback"; }
+	bool AlgoMateOracle::s_algoMachineRegistration = AlgoFactory::registerAlgoMachine(AlgoMateOracle::getAlgoName(), AlgoMateOracle::createFromConfig);
+
+} // end namespace space
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <chess/board.h>
+#include <chess/algo.h>
+
+#include <nlohmann/json.hpp>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+
+namespace space {
+
+	struct MateSolverConfig {
+		int maxNodes;   // node budget across all iterations of one solve
+		int maxPlies;   // longest mate looked for
+		MateSolverConfig();
+		MateSolverConfig(const nlohmann::json& config);
+	};
+
+	struct MateResult {
+		bool isMate = false;          // the side to move forces mate
+		bool budgetExhausted = false; // stopped by the node budget, absence of mate is not proven
+		int matePlies = 0;            // length of the shortest mate, in plies
+		std::vector<Move> line;       // mating line, with the longest defence
+		int nodes = 0;                // nodes created
+	};
+
+	// Proof-number search for a forced mate by the side to move.
+	// Deepens the ply limit one move at a time, so the first mate proven is
+	// the shortest one. Solved positions are kept in a transposition table
+	// keyed by position hash, and reused across iterations.
+	class MateSolver {
+	public:
+		MateSolver();
+		MateSolver(const MateSolverConfig& config);
+
+		MateResult solve(IBoard::Ptr board);
+
+		// in check, or has a checking move: worth asking the solver
+		static bool looksForcing(IBoard::Ptr board);
+
+	private:
+		struct PnNode;
+		struct TTEntry {
+			int provenPlies = -1;       // mate found in this many plies
+			int disprovenRemaining = -1; // no mate within this many plies
+		};
+
+		MateSolverConfig m_config;
+		std::unordered_map<std::uint64_t, TTEntry> m_table; // kept across solves
+		Color m_attacker = Color::White;
+		int m_nodes = 0;
+
+		// one proof-number search with a ply limit; true if mate was proven
+		bool search(PnNode& root, int maxPlies);
+		void expand(PnNode& node, int maxPlies);
+		void update(PnNode* node, int maxPlies);
+		void collectLine(PnNode& root, std::vector<Move>& line);
+		std::uint64_t tableKey(const IBoard& board) const;
+	};
+
+
+	// Plays the mating move when the solver finds one in a forcing position,
+	// otherwise asks the wrapped algo.
+	class AlgoMateOracle final : public IAlgo {
+	public:
+		AlgoMateOracle(IAlgo::Ptr fallback, const MateSolverConfig& config);
+		AlgoMateOracle(const nlohmann::json& config);
+		Move getNextMove(IBoard::Ptr board) override;
+
+		static IAlgo::Ptr createFromConfig(const nlohmann::json& config) {
+			return std::make_shared<AlgoMateOracle>(config);
+		}
+
+		static std::string getAlgoName();
+		static std::string getFallbackField();
+
+	private:
+		IAlgo::Ptr m_fallback;
+		MateSolver m_solver;
+
+		static bool s_algoMachineRegistration;
+	};
+
+} // end namespace space
@@ -0,0 +1,344 @@
+#include "nnue.h"
+
+#include <common/base.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SPACE_NNUE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// as in linearKernel.cpp, AVX2 is compiled per function and chosen at run time
+#if defined(SPACE_NNUE_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#define SPACE_NNUE_AVX2 1
+#include <immintrin.h>
+#endif
+
+
+namespace {
+
+	// out[r] = sum over i < n of input[i] * weights[r * n + i], for r < rows;
+	// n a multiple of 32, rows a multiple of 4
+	using DenseKernel = void(*)(const std::uint8_t*, const std::int8_t*, int, int, std::int32_t*);
+
+	[[maybe_unused]] void denseScalar(const std::uint8_t* input, const std::int8_t* weights, int n, int rows, std::int32_t* out)
+	{
+		for (int r = 0; r < rows; r++) {
+			const std::int8_t* row = weights + std::size_t(r) * n;
+			std::int32_t sum = 0;
+			for (int i = 0; i < n; i++)
+				sum += std::int32_t(input[i]) * row[i];
+			out[r] = sum;
+		}
+	}
+
+	// Rows are done four at a time, so the multiply-adds of different rows
+	// overlap instead of waiting on one accumulator.
+#ifdef SPACE_NNUE_SSE2
+	inline std::int32_t horizontalSum(__m128i sum)
+	{
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+		return _mm_cvtsi128_si32(sum);
+	}
+
+	// 16 int8 weights times 16 uint8 inputs, widened to int16 (SSE2 has no maddubs)
+	inline __m128i multiplyAdd16(__m128i xLow, __m128i xHigh, const std::int8_t* w)
+	{
+		__m128i weights = _mm_loadu_si128(reinterpret_cast<const __m128i*>(w));
+		__m128i wLow = _mm_srai_epi16(_mm_unpacklo_epi8(weights, weights), 8);
+		__m128i wHigh = _mm_srai_epi16(_mm_unpackhi_epi8(weights, weights), 8);
+		return _mm_add_epi32(_mm_madd_epi16(xLow, wLow), _mm_madd_epi16(xHigh, wHigh));
+	}
+
+	void denseSse2(const std::uint8_t* input, const std::int8_t* weights, int n, int rows, std::int32_t* out)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		for (int r = 0; r < rows; r += 4) {
+			const std::int8_t* row = weights + std::size_t(r) * n;
+			__m128i sum0 = zero, sum1 = zero, sum2 = zero, sum3 = zero;
+			for (int i = 0; i < n; i += 16) {
+				__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+				__m128i xLow = _mm_unpacklo_epi8(x, zero), xHigh = _mm_unpackhi_epi8(x, zero);
+				sum0 = _mm_add_epi32(sum0, multiplyAdd16(xLow, xHigh, row + i));
+				sum1 = _mm_add_epi32(sum1, multiplyAdd16(xLow, xHigh, row + n + i));
+				sum2 = _mm_add_epi32(sum2, multiplyAdd16(xLow, xHigh, row + 2 * n + i));
+				sum3 = _mm_add_epi32(sum3, multiplyAdd16(xLow, xHigh, row + 3 * n + i));
+			}
+			out[r] = horizontalSum(sum0);
+			out[r + 1] = horizontalSum(sum1);
+			out[r + 2] = horizontalSum(sum2);
+			out[r + 3] = horizontalSum(sum3);
+		}
+	}
+#endif
+
+#ifdef SPACE_NNUE_AVX2
+	// 32 uint8 inputs times 32 int8 weights, in 8 int32 lanes; the int16 pairs
+	// of maddubs cannot saturate, as inputs are at most 127
+	__attribute__((target("avx2")))
+	inline __m256i multiplyAdd32(__m256i x, const std::int8_t* w, __m256i ones)
+	{
+		__m256i weights = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w));
+		return _mm256_madd_epi16(_mm256_maddubs_epi16(x, weights), ones);
+	}
+
+	__attribute__((target("avx2")))
+	inline std::int32_t horizontalSum(__m256i sum)
+	{
+		return horizontalSum(_mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1)));
+	}
+
+	__attribute__((target("avx2")))
+	void denseAvx2(const std::uint8_t* input, const std::int8_t* weights, int n, int rows, std::int32_t* out)
+	{
+		const __m256i ones = _mm256_set1_epi16(1);
+		for (int r = 0; r < rows; r += 4) {
+			const std::int8_t* row = weights + std::size_t(r) * n;
+			__m256i sum0 = _mm256_setzero_si256(), sum1 = sum0, sum2 = sum0, sum3 = sum0;
+			for (int i = 0; i < n; i += 32) {
+				__m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + i));
+				sum0 = _mm256_add_epi32(sum0, multiplyAdd32(x, row + i, ones));
+				sum1 = _mm256_add_epi32(sum1, multiplyAdd32(x, row + n + i, ones));
+				sum2 = _mm256_add_epi32(sum2, multiplyAdd32(x, row + 2 * n + i, ones));
+				sum3 = _mm256_add_epi32(sum3, multiplyAdd32(x, row + 3 * n + i, ones));
+			}
+			out[r] = horizontalSum(sum0);
+			out[r + 1] = horizontalSum(sum1);
+			out[r + 2] = horizontalSum(sum2);
+			out[r + 3] = horizontalSum(sum3);
+		}
+	}
+#endif
+
+	struct DenseChoice {
+		DenseKernel kernel;
+		const char* name;
+	};
+
+	DenseChoice chooseDense()
+	{
+#ifdef SPACE_NNUE_AVX2
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			return { denseAvx2, "avx2" };
+#endif
+#ifdef SPACE_NNUE_SSE2
+		return { denseSse2, "sse2" };
+#else
+		return { denseScalar, "scalar" };
+#endif
+	}
+
+	const DenseChoice& getDense()
+	{
+		static const DenseChoice choice = chooseDense();
+		return choice;
+	}
+
+	const int denseShift = 6; // dense sums are scaled down by 2^6 before the clipped ReLU
+
+	inline std::uint8_t clippedRelu(std::int32_t x)
+	{
+		return static_cast<std::uint8_t>(std::clamp(x, 0, 127));
+	}
+
+	template <class T>
+	void readArray(std::istream& in, std::vector<T>& v, std::size_t size)
+	{
+		v.resize(size);
+		in.read(reinterpret_cast<char*>(v.data()), size * sizeof(T));
+	}
+
+	template <class T>
+	void writeArray(std::ostream& out, const std::vector<T>& v)
+	{
+		out.write(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(T));
+	}
+
+	template <class T>
+	void mixArray(std::uint64_t& hash, const std::vector<T>& v)
+	{
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(v.data());
+		for (std::size_t i = 0; i < v.size() * sizeof(T); i++)
+			hash = (hash ^ bytes[i]) * 0x100000001B3ULL;
+	}
+
+	const char fileMagic[4] = { 'S', 'P', 'N', 'N' };
+	const std::uint32_t fileVersion = 1;
+
+} // end anonymous namespace
+
+
+namespace space {
+
+	NnueEvaluator::NnueEvaluator(Weights v_weights) : weights(std::move(v_weights))
+	{
+		int h = this->weights.hidden;
+		space_assert(h > 0 && h % 16 == 0 && h <= maxHidden, "NnueEvaluator hidden size must be a positive multiple of 16, at most 512");
+		space_assert(this->weights.inputWeights.size() == std::size_t(numInputs) * h
+			&& this->weights.inputBias.size() == std::size_t(h)
+			&& this->weights.denseWeights.size() == std::size_t(numDense) * 2 * h
+			&& this->weights.denseBias.size() == std::size_t(numDense)
+			&& this->weights.outputWeights.size() == std::size_t(numDense),
+			"NnueEvaluator weights do not match the hidden size");
+		space_assert(this->weights.outputScale != 0, "NnueEvaluator needs a nonzero output scale");
+
+		std::uint64_t hash = 0xCBF29CE484222325ULL;
+		mixArray(hash, std::vector<double>{ double(h), this->weights.outputScale, double(this->weights.outputBias) });
+		mixArray(hash, this->weights.inputWeights);
+		mixArray(hash, this->weights.inputBias);
+		mixArray(hash, this->weights.denseWeights);
+		mixArray(hash, this->weights.denseBias);
+		mixArray(hash, this->weights.outputWeights);
+		this->key = hash;
+	}
+
+	NnueEvaluator::Ptr NnueEvaluator::load(const std::string& path)
+	{
+		std::ifstream in(path, std::ios::binary);
+		if (!in)
+			throw std::runtime_error("Cannot open network file " + path);
+
+		char magic[4];
+		std::uint32_t version = 0, hidden = 0;
+		Weights w;
+		in.read(magic, sizeof magic);
+		in.read(reinterpret_cast<char*>(&version), sizeof version);
+		in.read(reinterpret_cast<char*>(&hidden), sizeof hidden);
+		in.read(reinterpret_cast<char*>(&w.outputScale), sizeof w.outputScale);
+		if (!in || std::memcmp(magic, fileMagic, sizeof magic) != 0 || version != fileVersion)
+			throw std::runtime_error("Not a network file of version 1: " + path);
+		if (hidden == 0 || hidden % 16 != 0 || hidden > std::uint32_t(maxHidden))
+			throw std::runtime_error("Bad hidden size in network file " + path);
+
+		w.hidden = int(hidden);
+		readArray(in, w.inputWeights, std::size_t(numInputs) * hidden);
+		readArray(in, w.inputBias, hidden);
+		readArray(in, w.denseWeights, std::size_t(numDense) * 2 * hidden);
+		readArray(in, w.denseBias, numDense);
+		readArray(in, w.outputWeights, numDense);
+		in.read(reinterpret_cast<char*>(&w.outputBias), sizeof w.outputBias);
+		if (!in)
+			throw std::runtime_error("Truncated network file " + path);
+		return std::make_shared<NnueEvaluator>(std::move(w));
+	}
+
+	void NnueEvaluator::save(const std::string& path) const
+	{
+		std::ofstream out(path, std::ios::binary);
+		std::uint32_t hidden = std::uint32_t(this->weights.hidden);
+		out.write(fileMagic, sizeof fileMagic);
+		out.write(reinterpret_cast<const char*>(&fileVersion), sizeof fileVersion);
+		out.write(reinterpret_cast<const char*>(&hidden), sizeof hidden);
+		out.write(reinterpret_cast<const char*>(&this->weights.outputScale), sizeof this->weights.outputScale);
+		writeArray(out, this->weights.inputWeights);
+		writeArray(out, this->weights.inputBias);
+		writeArray(out, this->weights.denseWeights);
+		writeArray(out, this->weights.denseBias);
+		writeArray(out, this->weights.outputWeights);
+		out.write(reinterpret_cast<const char*>(&this->weights.outputBias), sizeof this->weights.outputBias);
+		if (!out)
+			throw std::runtime_error("Cannot write network file " + path);
+	}
+
+	// each perspective sees its own pieces first and the board from its own side
+	void NnueEvaluator::addPiece(Accumulator& acc, int rank, int file, const Piece& piece, int sign) const
+	{
+		int h = this->weights.hidden;
+		int square = rank * 8 + file;
+		for (int p = 0; p < 2; p++) {
+			int own = int(piece.color) == p ? 0 : 1;
+			int index = own * 384 + int(piece.pieceType) * 64 + (p == 0 ? square : square ^ 56);
+			const std::int16_t* column = this->weights.inputWeights.data() + std::size_t(index) * h;
+			std::int16_t* values = acc.values[p];
+			if (sign > 0)
+				for (int i = 0; i < h; i++)
+					values[i] += column[i];
+			else
+				for (int i = 0; i < h; i++)
+					values[i] -= column[i];
+		}
+	}
+
+	void NnueEvaluator::refresh(const IBoard& board, Accumulator& acc) const
+	{
+		int h = this->weights.hidden;
+		for (int p = 0; p < 2; p++)
+			std::copy(this->weights.inputBias.begin(), this->weights.inputBias.begin() + h, acc.values[p]);
+		for (int rank = 0; rank < 8; rank++)
+			for (int file = 0; file < 8; file++)
+				if (auto piece = board.getPiece({ rank, file }))
+					this->addPiece(acc, rank, file, *piece, 1);
+	}
+
+	void NnueEvaluator::update(const Accumulator& parentAcc, const IBoard& parent, const Move& move, const IBoard& child, Accumulator& acc) const
+	{
+		Position source(move.sourceRank, move.sourceFile), destination(move.destinationRank, move.destinationFile);
+		std::optional<Piece> moving = parent.getPiece(source);
+		std::optional<Piece> captured = parent.getPiece(destination);
+		if (!moving) {
+			this->refresh(child, acc);
+			return;
+		}
+
+		int h = this->weights.hidden;
+		for (int p = 0; p < 2; p++)
+			std::copy(parentAcc.values[p], parentAcc.values[p] + h, acc.values[p]);
+
+		this->addPiece(acc, source.rank, source.file, *moving, -1);
+		if (captured)
+			this->addPiece(acc, destination.rank, destination.file, *captured, -1);
+		if (auto placed = child.getPiece(destination)) // differs from moving on promotion
+			this->addPiece(acc, destination.rank, destination.file, *placed, 1);
+
+		if (moving->pieceType == PieceType::King && std::abs(destination.file - source.file) == 2) {
+			int rookFrom = destination.file > source.file ? 7 : 0;
+			int rookTo = destination.file > source.file ? 5 : 3;
+			Piece rook(PieceType::Rook, moving->color);
+			this->addPiece(acc, source.rank, rookFrom, rook, -1);
+			this->addPiece(acc, source.rank, rookTo, rook, 1);
+		}
+		else if (moving->pieceType == PieceType::Pawn && source.file != destination.file && !captured) {
+			Position passed(source.rank, destination.file); // taken en passant
+			if (auto pawn = parent.getPiece(passed))
+				this->addPiece(acc, passed.rank, passed.file, *pawn, -1);
+		}
+	}
+
+	double NnueEvaluator::evaluate(const Accumulator& acc, Color sideToMove) const
+	{
+		int h = this->weights.hidden;
+		int stm = int(sideToMove);
+		alignas(32) std::uint8_t input[2 * maxHidden];
+		for (int i = 0; i < h; i++) {
+			input[i] = clippedRelu(acc.values[stm][i]);
+			input[h + i] = clippedRelu(acc.values[1 - stm][i]);
+		}
+
+		std::int32_t dense[numDense];
+		getDense().kernel(input, this->weights.denseWeights.data(), 2 * h, numDense, dense);
+		std::int32_t output = this->weights.outputBias;
+		for (int n = 0; n < numDense; n++)
+			output += clippedRelu((dense[n] + this->weights.denseBias[n]) >> denseShift) * std::int32_t(this->weights.outputWeights[n]);
+		return output / this->weights.outputScale * colorToSign(sideToMove);
+	}
+
+	double NnueEvaluator::evaluate(const IBoard::Ptr& board) const
+	{
+		Accumulator acc;
+		this->refresh(*board, acc);
+		return this->evaluate(acc, board->whoPlaysNext());
+	}
+
+	std::string NnueEvaluator::kernelName()
+	{
+		return getDense().name;
+	}
+
+}
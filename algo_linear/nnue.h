@@ -0,0 +1,71 @@
+#pragma once
+
+#include <chess/board.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace space {
+
+	// Small quantized network in the style of NNUE:
+	//   768 piece-square inputs per perspective -> hidden (int16 accumulator)
+	//   -> clipped ReLU of both perspectives, side to move first -> 32 (int8 weights)
+	//   -> clipped ReLU -> 1.
+	// The accumulator is a sum of weight columns of the pieces on the board, so a
+	// child position is updated from its parent by the few squares a move changes.
+	// Scores are from White's point of view, like the linear evaluator.
+	class NnueEvaluator {
+	public:
+		using Ptr = std::shared_ptr<const NnueEvaluator>;
+
+		static constexpr int numInputs = 2 * 6 * 64;
+		static constexpr int maxHidden = 512;
+		static constexpr int numDense = 32;
+
+		// raw quantized parameters, as stored in the weight file
+		struct Weights {
+			int hidden = 0;                         // multiple of 16, at most maxHidden
+			double outputScale = 1;                 // network output per unit of score
+			std::vector<std::int16_t> inputWeights; // numInputs x hidden, input major
+			std::vector<std::int16_t> inputBias;    // hidden
+			std::vector<std::int8_t> denseWeights;  // numDense x (2 * hidden), neuron major
+			std::vector<std::int32_t> denseBias;    // numDense
+			std::vector<std::int8_t> outputWeights; // numDense
+			std::int32_t outputBias = 0;
+		};
+
+		struct Accumulator {
+			alignas(32) std::int16_t values[2][maxHidden]; // by perspective, White first
+		};
+
+		explicit NnueEvaluator(Weights weights);
+
+		// Weight file: "SPNN", uint32 version 1, uint32 hidden, double outputScale,
+		// then the arrays of Weights in declaration order, little endian.
+		// Throws std::runtime_error on a missing or malformed file.
+		static Ptr load(const std::string& path);
+		void save(const std::string& path) const;
+
+		void refresh(const IBoard& board, Accumulator& acc) const;
+		// acc of the child reached by move, from acc of its parent: only the squares
+		// the move touches are read (both ends, the rook of a castling, a pawn taken en passant)
+		void update(const Accumulator& parentAcc, const IBoard& parent, const Move& move, const IBoard& child, Accumulator& acc) const;
+		double evaluate(const Accumulator& acc, Color sideToMove) const;
+		double evaluate(const IBoard::Ptr& board) const;
+
+		const Weights& getWeights() const { return weights; }
+		std::uint64_t getKey() const { return key; } // identifies the weights, for caches
+
+		static std::string kernelName(); // "avx2", "sse2" or "scalar"
+
+	private:
+		Weights weights;
+		std::uint64_t key = 0;
+
+		void addPiece(Accumulator& acc, int rank, int file, const Piece& piece, int sign) const;
+	};
+
+}
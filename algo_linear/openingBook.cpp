@@ -0,0 +1,227 @@
+#include "openingBook.h"
+
+#include <chess/algo_factory.h>
+#include <common/base.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <tuple>
+
+
+namespace {
+
+	const char bookMagic[4] = { 'S', 'P', 'B', 'K' };
+	const std::uint32_t bookVersion = 1;
+
+	struct BookHeader {
+		char magic[4];
+		std::uint32_t version;
+		std::uint64_t numEntries;
+	};
+
+	using space::BookEntry;
+	static_assert(sizeof(BookEntry) == 24, "BookEntry is the file layout");
+
+	auto entryKey(const BookEntry& entry)
+	{
+		return std::make_tuple(entry.hash, entry.source, entry.destination, entry.promotion);
+	}
+
+	BookEntry toEntry(std::uint64_t hash, const space::Move& move)
+	{
+		BookEntry entry = {};
+		entry.hash = hash;
+		entry.source = std::uint8_t(move.sourceRank * 8 + move.sourceFile);
+		entry.destination = std::uint8_t(move.destinationRank * 8 + move.destinationFile);
+		entry.promotion = std::uint8_t(move.promotedPiece);
+		return entry;
+	}
+
+	space::Move toMove(const BookEntry& entry)
+	{
+		return space::Move(entry.source >> 3, entry.source & 7, entry.destination >> 3, entry.destination & 7,
+			space::PieceType(entry.promotion));
+	}
+
+	// sorts entries and adds up those of the same position and move
+	void mergeEntries(std::vector<BookEntry>& entries)
+	{
+		std::sort(entries.begin(), entries.end(), [](const BookEntry& a, const BookEntry& b) { return entryKey(a) < entryKey(b); });
+		std::size_t kept = 0;
+		for (std::size_t i = 0; i < entries.size(); i++) {
+			if (kept > 0 && entryKey(entries[kept - 1]) == entryKey(entries[i])) {
+				entries[kept - 1].games += entries[i].games;
+				entries[kept - 1].wins += entries[i].wins;
+				entries[kept - 1].draws += entries[i].draws;
+			}
+			else
+				entries[kept++] = entries[i];
+		}
+		entries.resize(kept);
+	}
+
+} // end anonymous namespace
+
+
+namespace space {
+
+	OpeningBook::OpeningBook(const std::string& path) :
+		file(path, MappedFile::Mode::Read)
+	{
+		BookHeader header;
+		if (this->file.size() < sizeof header)
+			throw std::runtime_error("Not an opening book: " + path);
+		std::memcpy(&header, this->file.data(), sizeof header);
+		if (std::memcmp(header.magic, bookMagic, sizeof header.magic) != 0 || header.version != bookVersion)
+			throw std::runtime_error("Not an opening book of version 1: " + path);
+		if (this->file.size() != sizeof header + header.numEntries * sizeof(BookEntry))
+			throw std::runtime_error("Opening book " + path + " is truncated");
+		this->numEntries = std::size_t(header.numEntries);
+	}
+
+	std::vector<BookMove> OpeningBook::probe(const IBoard& board) const
+	{
+		std::vector<BookMove> result;
+		if (this->numEntries == 0)
+			return result;
+		const BookEntry* begin = reinterpret_cast<const BookEntry*>(this->file.data() + sizeof(BookHeader));
+		const BookEntry* end = begin + this->numEntries;
+		std::uint64_t hash = board.getHash();
+		const BookEntry* it = std::lower_bound(begin, end, hash,
+			[](const BookEntry& entry, std::uint64_t h) { return entry.hash < h; });
+
+		for (; it != end && it->hash == hash; ++it) {
+			Move move = toMove(*it);
+			if (!board.isValidMove(move))
+				continue; // another position of the same hash
+			BookMove bookMove;
+			bookMove.move = move;
+			bookMove.games = it->games;
+			bookMove.wins = it->wins;
+			bookMove.draws = it->draws;
+			result.push_back(bookMove);
+		}
+		std::stable_sort(result.begin(), result.end(), [](const BookMove& a, const BookMove& b) { return a.games > b.games; });
+		return result;
+	}
+
+
+	//-------------------------------------------------------------------------
+	// BookBuilder
+
+	BookBuilder::BookBuilder(const BookConfig& v_config) :
+		config(v_config), limit(std::max(v_config.memoryEntries, std::size_t(1)))
+	{
+	}
+
+	std::size_t BookBuilder::add(std::istream& pgn)
+	{
+		PGNReader reader(pgn);
+		return this->add(reader);
+	}
+
+	std::size_t BookBuilder::add(PGNReader& reader)
+	{
+		std::vector<BookEntry> gameEntries;
+		std::size_t games = 0;
+		Game game;
+		while (reader.next_parsed(game)) {
+			auto result = game.result();
+			if (!result)
+				continue;
+
+			// buffered per game, so a game that does not replay leaves nothing behind
+			gameEntries.clear();
+			bool legal = game.replay([&](const IBoard::Ptr& board, const Move& move) {
+				double points = board->whoPlaysNext() == Color::White ? *result : 1 - *result;
+				BookEntry entry = toEntry(board->getHash(), move);
+				entry.games = 1;
+				entry.wins = points == 1 ? 1 : 0;
+				entry.draws = points == 0.5 ? 1 : 0;
+				gameEntries.push_back(entry);
+			}, this->config.maxPlies);
+			if (!legal)
+				continue;
+
+			this->entries.insert(this->entries.end(), gameEntries.begin(), gameEntries.end());
+			games++;
+			if (this->entries.size() >= this->limit) {
+				mergeEntries(this->entries);
+				if (this->entries.size() >= this->limit / 2)
+					this->limit *= 2; // mostly distinct: merging again soon would not pay
+			}
+		}
+		return games;
+	}
+
+	void BookBuilder::write(const std::string& path)
+	{
+		mergeEntries(this->entries);
+		std::vector<BookEntry> kept;
+		std::copy_if(this->entries.begin(), this->entries.end(), std::back_inserter(kept),
+			[this](const BookEntry& entry) { return entry.games >= this->config.minGames; });
+
+		BookHeader header = {};
+		std::memcpy(header.magic, bookMagic, sizeof header.magic);
+		header.version = bookVersion;
+		header.numEntries = kept.size();
+		replaceFile(path, sizeof header + kept.size() * sizeof(BookEntry), [&header, &kept](char* data) {
+			std::memcpy(data, &header, sizeof header);
+			if (!kept.empty())
+				std::memcpy(data + sizeof header, kept.data(), kept.size() * sizeof(BookEntry));
+		});
+	}
+
+
+	//-------------------------------------------------------------------------
+	// AlgoBook
+
+	AlgoBook::AlgoBook(IAlgo::Ptr fallback, OpeningBook::Ptr book, bool weighted) :
+		m_fallback(fallback), m_book(book), m_weighted(weighted), m_random(std::random_device()())
+	{
+		space_assert(m_fallback != nullptr, "AlgoBook needs a fallback algo");
+		space_assert(m_book != nullptr, "AlgoBook needs a book");
+	}
+
+	AlgoBook::AlgoBook(const nlohmann::json& config) :
+		m_random(std::random_device()())
+	{
+		auto bookIt = config.find(getBookFileField());
+		space_assert(bookIt != config.end(), "AlgoBook needs a book file");
+		m_book = std::make_shared<OpeningBook>(bookIt->get<std::string>());
+		m_weighted = config.value(getWeightedField(), false);
+		auto fallbackIt = config.find(getFallbackField());
+		space_assert(fallbackIt != config.end(), "AlgoBook needs a fallback algo");
+		auto fallback = AlgoFactory::tryCreateAlgo(*fallbackIt);
+		space_assert(fallback.has_value(), "AlgoBook fallback algo is unknown");
+		m_fallback = fallback.value();
+	}
+
+	Move AlgoBook::getNextMove(IBoard::Ptr board)
+	{
+		auto moves = m_book->probe(*board);
+		if (moves.empty())
+			return m_fallback->getNextMove(board);
+		if (!m_weighted)
+			return moves.front().move;
+		std::uint64_t total = 0;
+		for (const auto& bookMove : moves)
+			total += bookMove.games;
+		std::uint64_t pick = std::uniform_int_distribution<std::uint64_t>(0, total - 1)(m_random);
+		for (const auto& bookMove : moves) {
+			if (pick < bookMove.games)
+				return bookMove.move;
+			pick -= bookMove.games;
+		}
+		return moves.front().move;
+	}
+
+	std::string AlgoBook::getAlgoName() { return "AlgoBook"; }
+	std::string AlgoBook::getBookFileField() { return "BookFile"; }
+	std::string AlgoBook::getWeightedField() { return "Weighted"; }
+	std::string AlgoBook::getFallbackField() { return "Fallback"; }
+	bool AlgoBook::s_algoMachineRegistration = AlgoFactory::registerAlgoMachine(AlgoBook::getAlgoName(), AlgoBook::createFromConfig);
+
+} // end namespace space
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <chess/board.h>
+#include <chess/algo.h>
+#include <chess/pgn.h>
+#include <common/mappedFile.h>
+
+#include <nlohmann/json.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+
+namespace space {
+
+	struct BookConfig {
+		int maxPlies = 24;               // of each game that go into the book
+		std::uint32_t minGames = 2;      // a move played less often is left out
+		std::size_t memoryEntries = 1 << 22; // moves aggregated in memory before merging duplicates
+	};
+
+	// A move of a book position with the results of the games that played it,
+	// for the side making the move.
+	struct BookMove {
+		Move move;
+		std::uint32_t games = 0;
+		std::uint32_t wins = 0;
+		std::uint32_t draws = 0;
+
+		double score() const { return games ? (wins + 0.5 * draws) / games : 0.5; }
+	};
+
+	// A position hash and move of a book file, as stored
+	struct BookEntry {
+		std::uint64_t hash;
+		std::uint8_t source;      // rank * 8 + file
+		std::uint8_t destination;
+		std::uint8_t promotion;   // PieceType
+		std::uint8_t reserved;
+		std::uint32_t games;
+		std::uint32_t wins;       // for the side making the move
+		std::uint32_t draws;
+	};
+
+	// Opening book built from PGN collections: per position hash, the moves
+	// played from it and how the games went. The file is an array of entries
+	// sorted by hash and move, mapped into memory, so a probe is a binary
+	// search and loading costs nothing however large the book.
+	//
+	// File: "SPBK", uint32 version 1, uint64 number of entries, then the
+	// entries.
+	class OpeningBook {
+	public:
+		using Ptr = std::shared_ptr<OpeningBook>;
+
+		explicit OpeningBook(const std::string& path);
+
+		std::vector<BookMove> probe(const IBoard& board) const; // legal moves only, most played first
+		std::size_t size() const { return numEntries; }
+
+	private:
+		MappedFile file;
+		std::size_t numEntries = 0;
+	};
+
+
+	// Aggregates the moves of PGN collections into a book file. Duplicates are
+	// merged whenever config.memoryEntries accumulate, so memory follows the
+	// distinct moves rather than the games read.
+	class BookBuilder {
+	public:
+		explicit BookBuilder(const BookConfig& config = BookConfig());
+
+		// Games of pgn with a result are replayed up to config.maxPlies, a game
+		// that does not parse or replay is dropped. Returns the games used.
+		std::size_t add(std::istream& pgn);
+		std::size_t add(PGNReader& reader);
+		void write(const std::string& path); // moves of at least config.minGames games
+
+	private:
+		BookConfig config;
+		std::vector<BookEntry> entries;
+		std::size_t limit; // entries before the next merge
+	};
+
+
+	// Plays from the book while the position is in it, otherwise asks the
+	// wrapped algo. Picks the most played move, or one at random weighted by
+	// games when Weighted is set.
+	class AlgoBook final : public IAlgo {
+	public:
+		AlgoBook(IAlgo::Ptr fallback, OpeningBook::Ptr book, bool weighted = false);
+		AlgoBook(const nlohmann::json& config);
+		Move getNextMove(IBoard::Ptr board) override;
+
+		static IAlgo::Ptr createFromConfig(const nlohmann::json& config) {
+			return std::make_shared<AlgoBook>(config);
+		}
+
+		static std::string getAlgoName();
+		static std::string getBookFileField();
+		static std::string getWeightedField();
+		static std::string getFallbackField();
+
+	private:
+		IAlgo::Ptr m_fallback;
+		OpeningBook::Ptr m_book;
+		bool m_weighted = false;
+		std::mt19937 m_random;
+
+		static bool s_algoMachineRegistration;
+	};
+
+}
@@ -0,0 +1,113 @@
+#include "pawnTable.h"
+
+#include <vector>
+
+
+namespace {
+
+	struct Entry {
+		std::uint64_t key = 0;
+		bool used = false;
+		space::PawnStructure pawns;
+	};
+
+	struct ThreadTable {
+		std::vector<Entry> entries = std::vector<Entry>(space::PawnTable::numEntries);
+		space::PawnTable::Stats stats;
+	};
+
+	ThreadTable& getTable()
+	{
+		thread_local ThreadTable table;
+		return table;
+	}
+
+	inline int popCount(unsigned int x)
+	{
+		int count = 0;
+		for (; x; x &= x - 1)
+			++count;
+		return count;
+	}
+
+} // end anonymous namespace
+
+
+namespace space {
+
+	PawnStructure PawnStructure::compute(const std::uint8_t (&pawnRanks)[2][8])
+	{
+		PawnStructure result;
+		for (Color color : { Color::White, Color::Black }) {
+			int c = int(color), opp = 1 - c;
+			for (int j = 0; j < 8; j++) {
+				unsigned int pawns = pawnRanks[c][j];
+				if (!pawns)
+					continue;
+
+				unsigned int oppPawns = pawnRanks[opp][j];
+				unsigned int ownNeighbours = 0;
+				if (j > 0) {
+					oppPawns |= pawnRanks[opp][j - 1];
+					ownNeighbours |= pawnRanks[c][j - 1];
+				}
+				if (j < 7) {
+					oppPawns |= pawnRanks[opp][j + 1];
+					ownNeighbours |= pawnRanks[c][j + 1];
+				}
+
+				int count = popCount(pawns);
+				result.doubled[c] += count - 1;
+				if (!ownNeighbours)
+					result.isolated[c] += count;
+
+				// most advanced pawn first, each further one discounted
+				const double discountFactor = 0.75;
+				double DF = 1;
+				int direction = colorToSign(color);
+				for (int i = color == Color::White ? 7 : 0; (i >= 0) && (i < 8); i -= direction) {
+					if (!(pawns & (1u << i)))
+						continue;
+					result.fileRank[c][j] += (color == Color::White ? i : 7 - i) * DF;
+					DF *= discountFactor;
+
+					unsigned int inFront = color == Color::White
+						? (0xFFu << (i + 1)) & 0xFFu  // higher ranks
+						: (1u << i) - 1;              // lower ranks
+					if (!(oppPawns & inFront))
+						result.passed[c] += 1;
+				}
+			}
+		}
+		return result;
+	}
+
+	PawnStructure PawnTable::probe(std::uint64_t pawnHash, const std::uint8_t (&pawnRanks)[2][8])
+	{
+		ThreadTable& table = getTable();
+		Entry& entry = table.entries[pawnHash % numEntries];
+		if (entry.used && entry.key == pawnHash) {
+			++table.stats.hits;
+			return entry.pawns;
+		}
+		++table.stats.misses;
+		entry.key = pawnHash;
+		entry.used = true;
+		entry.pawns = PawnStructure::compute(pawnRanks);
+		return entry.pawns;
+	}
+
+	PawnTable::Stats PawnTable::getStats()
+	{
+		return getTable().stats;
+	}
+
+	void PawnTable::clear()
+	{
+		ThreadTable& table = getTable();
+		for (auto& entry : table.entries)
+			entry.used = false;
+		table.stats = Stats();
+	}
+
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "chess/board.h"
+
+#include <cstdint>
+
+
+namespace space {
+
+	// All pawn structure terms, by color
+	struct PawnStructure {
+		double passed[2] = {};    // no opposing pawn ahead on the same or adjacent files
+		double doubled[2] = {};   // pawns behind another pawn of the same color on their file
+		double isolated[2] = {};  // no pawn of the same color on the adjacent files
+		double fileRank[2][8] = {}; // Feature_PawnRank per file
+
+		static PawnStructure compute(const std::uint8_t (&pawnRanks)[2][8]);
+	};
+
+	// Pawn structure changes rarely inside a search, so its terms are cached
+	// by the pawn-only hash of the board. One table per thread, so no locking;
+	// a slot keeps the last structure stored in it.
+	class PawnTable {
+	public:
+		struct Stats {
+			long long hits = 0;
+			long long misses = 0;
+		};
+
+		static PawnStructure probe(std::uint64_t pawnHash, const std::uint8_t (&pawnRanks)[2][8]);
+		static Stats getStats(); // of the calling thread
+		static void clear();     // of the calling thread
+
+		static constexpr std::size_t numEntries = 1 << 12;
+	};
+
+}
@@ -0,0 +1,938 @@
+#include "tablebase.h"
+
+#include <chess/algo_factory.h>
+#include <common/base.h>
+#include <common/mappedFile.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <vector>
+
+
+namespace {
+
+	using space::PieceType;
+
+	const int White = 0, Black = 1;
+	const int maxMen = 2; // besides the kings
+
+	const char tableMagic[4] = { 'S', 'P', 'T', 'B' };
+	const std::uint32_t tableVersion = 1;
+	const char tableExtension[] = ".sptb";
+
+	const std::uint8_t drawValue = 0;
+	const std::uint8_t invalidValue = 255; // no legal placement has this index
+	const std::uint8_t neverLoses = 255;   // of the scan: a capture or promotion draws
+
+	// the letters of the men, strongest first
+	const std::string pieceLetters = "QRBNP";
+	const int pieceValues[] = { 9, 5, 3, 3, 1 };
+
+	int letterOrder(char c) { return int(pieceLetters.find(c)); }
+	int typeOrder(PieceType type) { return letterOrder(space::pieceTypeToChar(type)); }
+
+	struct Man {
+		PieceType type;
+		int color;
+		int square; // rank * 8 + file
+	};
+
+	// the kings and up to maxMen other men, with the side to move
+	struct Setup {
+		int kings[2];
+		Man men[maxMen];
+		int count = 0;
+		int toMove = White;
+	};
+
+	std::uint64_t occupancy(const Setup& setup)
+	{
+		std::uint64_t occupied = (std::uint64_t(1) << setup.kings[White]) | (std::uint64_t(1) << setup.kings[Black]);
+		for (int i = 0; i < setup.count; i++)
+			occupied |= std::uint64_t(1) << setup.men[i].square;
+		return occupied;
+	}
+
+	int manAt(const Setup& setup, int square)
+	{
+		for (int i = 0; i < setup.count; i++)
+			if (setup.men[i].square == square)
+				return i;
+		return -1;
+	}
+
+
+	//-----------------------------------------------------------------------
+	// material
+
+	// "K" and the letters of the men of color, strongest first
+	std::string sideName(const Setup& setup, int color)
+	{
+		std::string name = "K";
+		for (int i = 0; i < setup.count; i++)
+			if (setup.men[i].color == color)
+				name += space::pieceTypeToChar(setup.men[i].type);
+		std::sort(name.begin() + 1, name.end(), [](char a, char b) { return letterOrder(a) < letterOrder(b); });
+		return name;
+	}
+
+	// less material than b, or as much in weaker men
+	bool isWeaker(const std::string& a, const std::string& b)
+	{
+		auto value = [](const std::string& side) {
+			int total = 0;
+			for (std::size_t i = 1; i < side.size(); i++)
+				total += pieceValues[letterOrder(side[i])];
+			return total;
+		};
+		if (value(a) != value(b))
+			return value(a) < value(b);
+		if (a.size() != b.size())
+			return a.size() < b.size();
+		for (std::size_t i = 1; i < a.size(); i++)
+			if (a[i] != b[i])
+				return letterOrder(a[i]) > letterOrder(b[i]);
+		return false;
+	}
+
+	// the table of setup; flipped when it has the colors the other way round
+	std::string materialName(const Setup& setup, bool& flipped)
+	{
+		std::string white = sideName(setup, White), black = sideName(setup, Black);
+		flipped = isWeaker(white, black);
+		return flipped ? black + white : white + black;
+	}
+
+	Setup flipColors(const Setup& setup)
+	{
+		Setup result = setup;
+		result.kings[White] = setup.kings[Black] ^ 56;
+		result.kings[Black] = setup.kings[White] ^ 56;
+		for (int i = 0; i < setup.count; i++) {
+			result.men[i].color ^= 1;
+			result.men[i].square ^= 56;
+		}
+		result.toMove ^= 1;
+		return result;
+	}
+
+
+	//-----------------------------------------------------------------------
+	// moves
+
+	struct Geometry {
+		std::uint64_t king[64];
+		std::uint64_t knight[64];
+		std::uint64_t between[64][64]; // squares strictly between two on a line
+		bool straight[64][64];         // on a rank or a file
+		bool diagonal[64][64];
+
+		Geometry() : king(), knight(), between(), straight(), diagonal()
+		{
+			const int knightSteps[8][2] = { {1, 2}, {2, 1}, {2, -1}, {1, -2}, {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2} };
+			for (int from = 0; from < 64; from++) {
+				int rank = from >> 3, file = from & 7;
+				for (const auto& step : knightSteps) {
+					int r = rank + step[0], f = file + step[1];
+					if (r >= 0 && r < 8 && f >= 0 && f < 8)
+						this->knight[from] |= std::uint64_t(1) << (r * 8 + f);
+				}
+				for (int dr = -1; dr <= 1; dr++)
+					for (int df = -1; df <= 1; df++) {
+						if (dr == 0 && df == 0)
+							continue;
+						std::uint64_t passed = 0;
+						for (int r = rank + dr, f = file + df; r >= 0 && r < 8 && f >= 0 && f < 8; r += dr, f += df) {
+							int to = r * 8 + f;
+							if (passed == 0)
+								this->king[from] |= std::uint64_t(1) << to;
+							this->between[from][to] = passed;
+							(dr == 0 || df == 0 ? this->straight : this->diagonal)[from][to] = true;
+							passed |= std::uint64_t(1) << to;
+						}
+					}
+			}
+		}
+	};
+
+	const Geometry& geometry()
+	{
+		static const Geometry instance;
+		return instance;
+	}
+
+	bool attacks(const Man& man, int to, std::uint64_t occupied)
+	{
+		const Geometry& g = geometry();
+		switch (man.type) {
+		case PieceType::Knight:
+			return (g.knight[man.square] >> to) & 1;
+		case PieceType::Pawn:
+			return (to >> 3) == (man.square >> 3) + (man.color == White ? 1 : -1) && std::abs((to & 7) - (man.square & 7)) == 1;
+		case PieceType::Rook:
+			return g.straight[man.square][to] && !(g.between[man.square][to] & occupied);
+		case PieceType::Bishop:
+			return g.diagonal[man.square][to] && !(g.between[man.square][to] & occupied);
+		default: // queen
+			return (g.straight[man.square][to] || g.diagonal[man.square][to]) && !(g.between[man.square][to] & occupied);
+		}
+	}
+
+	bool inCheck(const Setup& setup, int color)
+	{
+		int king = setup.kings[color];
+		if ((geometry().king[setup.kings[color ^ 1]] >> king) & 1)
+			return true;
+		std::uint64_t occupied = occupancy(setup);
+		for (int i = 0; i < setup.count; i++)
+			if (setup.men[i].color != color && attacks(setup.men[i], king, occupied))
+				return true;
+		return false;
+	}
+
+	// rays of the men that slide, by rank and file step
+	const int straightSteps[4][2] = { {1, 0}, {-1, 0}, {0, 1}, {0, -1} };
+	const int diagonalSteps[4][2] = { {1, 1}, {1, -1}, {-1, 1}, {-1, -1} };
+
+	template <class F> void forEachRaySquare(int from, PieceType type, F f) // f(square) is false to stop the ray
+	{
+		auto rays = [from, &f](const int (*steps)[2]) {
+			for (int k = 0; k < 4; k++)
+				for (int r = (from >> 3) + steps[k][0], fl = (from & 7) + steps[k][1];
+					r >= 0 && r < 8 && fl >= 0 && fl < 8; r += steps[k][0], fl += steps[k][1])
+					if (!f(r * 8 + fl))
+						break;
+		};
+		if (type == PieceType::Rook || type == PieceType::Queen)
+			rays(straightSteps);
+		if (type == PieceType::Bishop || type == PieceType::Queen)
+			rays(diagonalSteps);
+	}
+
+	template <class F> void forEachBit(std::uint64_t bits, F f)
+	{
+		for (int square = 0; bits; square++, bits >>= 1)
+			if (bits & 1)
+				f(square);
+	}
+
+	// The legal moves of the side to move, f(child, leaves): leaves is set for
+	// a capture or a promotion, which lead to another table. No castling, no
+	// en passant.
+	template <class F> void forEachMove(const Setup& setup, F f)
+	{
+		const Geometry& g = geometry();
+		int side = setup.toMove;
+		std::uint64_t occupied = occupancy(setup);
+
+		// mover is the index of a man, or -1 for the king
+		auto play = [&setup, &f, side](int mover, int to, PieceType promotion) {
+			if (to == setup.kings[White] || to == setup.kings[Black])
+				return;
+			int captured = manAt(setup, to);
+			if (captured >= 0 && setup.men[captured].color == side)
+				return;
+			Setup child = setup;
+			if (mover < 0)
+				child.kings[side] = to;
+			else {
+				child.men[mover].square = to;
+				if (promotion != PieceType::None)
+					child.men[mover].type = promotion;
+			}
+			if (captured >= 0) {
+				for (int i = captured; i + 1 < child.count; i++)
+					child.men[i] = child.men[i + 1];
+				child.count--;
+			}
+			child.toMove = side ^ 1;
+			if (!inCheck(child, side))
+				f(child, captured >= 0 || promotion != PieceType::None);
+		};
+
+		forEachBit(g.king[setup.kings[side]], [&play](int to) { play(-1, to, PieceType::None); });
+		for (int i = 0; i < setup.count; i++) {
+			const Man& man = setup.men[i];
+			if (man.color != side)
+				continue;
+			switch (man.type) {
+			case PieceType::Knight:
+				forEachBit(g.knight[man.square], [&play, i](int to) { play(i, to, PieceType::None); });
+				break;
+			case PieceType::Pawn: {
+				int step = side == White ? 8 : -8;
+				int lastRank = side == White ? 7 : 0;
+				auto pawnPlay = [&play, i, lastRank](int to) {
+					if ((to >> 3) != lastRank)
+						play(i, to, PieceType::None);
+					else
+						for (PieceType promotion : { PieceType::Queen, PieceType::Rook, PieceType::Bishop, PieceType::Knight })
+							play(i, to, promotion);
+				};
+				int to = man.square + step;
+				if (!((occupied >> to) & 1)) {
+					pawnPlay(to);
+					if ((man.square >> 3) == (side == White ? 1 : 6) && !((occupied >> (to + step)) & 1))
+						play(i, to + step, PieceType::None);
+				}
+				for (int df : { -1, 1 }) {
+					int file = (man.square & 7) + df;
+					int captured = file >= 0 && file < 8 ? manAt(setup, to + df) : -1;
+					if (captured >= 0 && setup.men[captured].color != side)
+						pawnPlay(to + df);
+				}
+				break;
+			}
+			default:
+				forEachRaySquare(man.square, man.type, [&play, occupied, i](int to) {
+					play(i, to, PieceType::None);
+					return !((occupied >> to) & 1);
+				});
+			}
+		}
+	}
+
+	// The legal placements one move before setup that reach it without a
+	// capture or a promotion, f(previous)
+	template <class F> void forEachUnmove(const Setup& setup, F f)
+	{
+		const Geometry& g = geometry();
+		int side = setup.toMove ^ 1; // who moved
+		std::uint64_t occupied = occupancy(setup);
+
+		auto unplay = [&setup, &f, side, occupied](int mover, int from) {
+			if ((occupied >> from) & 1)
+				return;
+			Setup previous = setup;
+			if (mover < 0)
+				previous.kings[side] = from;
+			else
+				previous.men[mover].square = from;
+			previous.toMove = side;
+			if (!inCheck(previous, side ^ 1))
+				f(previous);
+		};
+
+		forEachBit(g.king[setup.kings[side]], [&unplay](int from) { unplay(-1, from); });
+		for (int i = 0; i < setup.count; i++) {
+			const Man& man = setup.men[i];
+			if (man.color != side)
+				continue;
+			switch (man.type) {
+			case PieceType::Knight:
+				forEachBit(g.knight[man.square], [&unplay, i](int from) { unplay(i, from); });
+				break;
+			case PieceType::Pawn: {
+				int step = side == White ? -8 : 8;
+				int from = man.square + step;
+				int rank = from >> 3;
+				if (rank < 1 || rank > 6 || ((occupied >> from) & 1))
+					break;
+				unplay(i, from);
+				if (rank == (side == White ? 2 : 5))
+					unplay(i, from + step);
+				break;
+			}
+			default:
+				forEachRaySquare(man.square, man.type, [&unplay, occupied, i](int from) {
+					if ((occupied >> from) & 1)
+						return false;
+					unplay(i, from);
+					return true;
+				});
+			}
+		}
+	}
+
+
+	//-----------------------------------------------------------------------
+	// indexing
+
+	int numSymmetries(bool pawns)
+	{
+		return pawns ? 2 : 8; // pawns only allow mirroring the files
+	}
+
+	// symmetry bits: 1 mirrors the files, 2 the ranks, 4 swaps ranks and files
+	int transformSquare(int square, int symmetry)
+	{
+		int rank = square >> 3, file = square & 7;
+		if (symmetry & 4)
+			std::swap(rank, file);
+		if (symmetry & 1)
+			file = 7 - file;
+		if (symmetry & 2)
+			rank = 7 - rank;
+		return rank * 8 + file;
+	}
+
+	// men by color, strength and square, the order of the table
+	void sortMen(Setup& setup)
+	{
+		static_assert(maxMen == 2, "sortMen orders two men");
+		auto before = [](const Man& a, const Man& b) {
+			if (a.color != b.color)
+				return a.color < b.color;
+			if (a.type != b.type)
+				return typeOrder(a.type) < typeOrder(b.type);
+			return a.square < b.square;
+		};
+		if (setup.count == 2 && before(setup.men[1], setup.men[0]))
+			std::swap(setup.men[0], setup.men[1]);
+	}
+
+	using PlacementKey = std::array<int, 2 + maxMen>;
+
+	PlacementKey placementKey(const Setup& setup)
+	{
+		PlacementKey key = { setup.kings[White], setup.kings[Black] };
+		for (int i = 0; i < setup.count; i++)
+			key[2 + i] = setup.men[i].square;
+		return key;
+	}
+
+	// the image of setup under the symmetries with the smallest key
+	Setup canonical(const Setup& setup, int symmetries)
+	{
+		auto imageOf = [&setup](int symmetry) {
+			Setup image = setup;
+			for (int color : { White, Black })
+				image.kings[color] = transformSquare(setup.kings[color], symmetry);
+			for (int i = 0; i < image.count; i++)
+				image.men[i].square = transformSquare(setup.men[i].square, symmetry);
+			sortMen(image);
+			return image;
+		};
+		Setup best = imageOf(0);
+		PlacementKey bestKey = placementKey(best);
+		for (int symmetry = 1; symmetry < symmetries; symmetry++) {
+			Setup image = imageOf(symmetry);
+			PlacementKey key = placementKey(image);
+			if (key < bestKey) {
+				best = image;
+				bestKey = key;
+			}
+		}
+		return best;
+	}
+
+	// The king placements of a table, one of each class under the symmetries:
+	// the 462 without pawns, 1806 with them
+	struct KingPairs {
+		std::vector<std::int32_t> index;        // by white king * 64 + black king; -1 when not one
+		std::vector<std::array<int, 2>> pairs;  // by index
+
+		explicit KingPairs(int symmetries) : index(64 * 64, -1)
+		{
+			for (int white = 0; white < 64; white++)
+				for (int black = 0; black < 64; black++) {
+					if (white == black || ((geometry().king[white] >> black) & 1))
+						continue;
+					bool smallest = true;
+					for (int symmetry = 1; symmetry < symmetries; symmetry++) {
+						std::array<int, 2> image = { transformSquare(white, symmetry), transformSquare(black, symmetry) };
+						if (image < std::array<int, 2>{ white, black })
+							smallest = false;
+					}
+					if (!smallest)
+						continue;
+					this->index[white * 64 + black] = std::int32_t(this->pairs.size());
+					this->pairs.push_back({ white, black });
+				}
+		}
+	};
+
+	const KingPairs& kingPairs(bool pawns)
+	{
+		static const KingPairs pawnless(numSymmetries(false)), withPawns(numSymmetries(true));
+		return pawns ? withPawns : pawnless;
+	}
+
+	struct TableHeader {
+		char magic[4];
+		std::uint32_t version;
+		char material[8];
+		std::uint64_t size; // placements per side to move
+	};
+
+	space::TablebaseResult toResult(std::uint8_t value)
+	{
+		space::TablebaseResult result;
+		if (value != drawValue) {
+			result.pliesToMate = value - 1;
+			result.outcome = result.pliesToMate % 2 ? space::TablebaseResult::Outcome::Win : space::TablebaseResult::Outcome::Loss;
+		}
+		return result;
+	}
+
+	// the position as a setup, unless it cannot be in a table
+	std::optional<Setup> setupOf(const space::IBoard& board)
+	{
+		for (space::Color color : { space::Color::White, space::Color::Black })
+			if (board.canCastleLeft(color) || board.canCastleRight(color))
+				return std::nullopt;
+
+		Setup setup;
+		setup.toMove = board.whoPlaysNext() == space::Color::White ? White : Black;
+		setup.kings[White] = setup.kings[Black] = -1;
+		for (int square = 0; square < 64; square++) {
+			auto piece = board.getPiece(space::Position(square >> 3, square & 7));
+			if (!piece || piece->pieceType == PieceType::None)
+				continue;
+			int color = piece->color == space::Color::White ? White : Black;
+			if (piece->pieceType == PieceType::King)
+				setup.kings[color] = square;
+			else if (setup.count == maxMen)
+				return std::nullopt;
+			else
+				setup.men[setup.count++] = { piece->pieceType, color, square };
+		}
+		if (setup.kings[White] < 0 || setup.kings[Black] < 0)
+			return std::nullopt;
+
+		// an en passant square only matters to a pawn that can take there
+		if (board.enPassantSquare.has_value()) {
+			const space::Position& target = board.enPassantSquare.value();
+			int pawnRank = setup.toMove == White ? 4 : 3;
+			for (int i = 0; i < setup.count; i++) {
+				const Man& man = setup.men[i];
+				if (man.type == PieceType::Pawn && man.color == setup.toMove
+					&& (man.square >> 3) == pawnRank && std::abs((man.square & 7) - target.file) == 1)
+					return std::nullopt;
+			}
+		}
+		return setup;
+	}
+
+} // end anonymous namespace
+
+
+namespace space {
+
+	struct Tablebases::Table {
+		std::string material;
+		bool pawns = false;
+		int count = 0;                   // men besides the kings
+		PieceType types[maxMen] = {};    // in the order of sortMen
+		int colors[maxMen] = {};
+		std::size_t size = 0;            // placements per side to move
+		MappedFile file;
+		const std::uint8_t* values = nullptr; // White to move, then Black
+
+		explicit Table(const std::string& v_material) : material(v_material)
+		{
+			std::size_t second = this->material.find('K', 1);
+			for (std::size_t i = 1; i < this->material.size(); i++) {
+				if (i == second)
+					continue;
+				this->types[this->count] = charToPieceType(this->material[i]);
+				this->colors[this->count] = i < second ? White : Black;
+				this->pawns = this->pawns || this->types[this->count] == PieceType::Pawn;
+				this->count++;
+			}
+			this->size = kingPairs(this->pawns).pairs.size();
+			for (int i = 0; i < this->count; i++)
+				this->size *= base(i);
+		}
+
+		std::size_t base(int man) const { return this->types[man] == PieceType::Pawn ? 48 : 64; }
+
+		// of a canonical setup of this material; size when none
+		std::size_t index(const Setup& setup) const
+		{
+			std::int32_t pair = kingPairs(this->pawns).index[setup.kings[White] * 64 + setup.kings[Black]];
+			if (pair < 0)
+				return this->size;
+			std::size_t result = std::size_t(pair);
+			for (int i = 0; i < this->count; i++) {
+				int square = setup.men[i].square;
+				if (this->types[i] == PieceType::Pawn) {
+					if (square < 8 || square >= 56)
+						return this->size;
+					square -= 8;
+				}
+				result = result * this->base(i) + std::size_t(square);
+			}
+			return result;
+		}
+
+		// the canonical setup of index; false when the index has none
+		bool placement(std::size_t index, int toMove, Setup& setup) const
+		{
+			setup.count = this->count;
+			setup.toMove = toMove;
+			for (int i = this->count - 1; i >= 0; i--) {
+				int square = int(index % this->base(i));
+				index /= this->base(i);
+				setup.men[i] = { this->types[i], this->colors[i], this->types[i] == PieceType::Pawn ? square + 8 : square };
+			}
+			const auto& kings = kingPairs(this->pawns).pairs[index];
+			setup.kings[White] = kings[0];
+			setup.kings[Black] = kings[1];
+
+			std::uint64_t occupied = occupancy(setup);
+			int occupiedCount = 0;
+			for (; occupied; occupied &= occupied - 1)
+				occupiedCount++;
+			return occupiedCount == this->count + 2
+				&& placementKey(canonical(setup, numSymmetries(this->pawns))) == placementKey(setup);
+		}
+
+		TableStats stats() const
+		{
+			TableStats result;
+			result.material = this->material;
+			for (std::size_t i = 0; i < 2 * this->size; i++) {
+				std::uint8_t value = this->values[i];
+				if (value == invalidValue)
+					continue;
+				result.positions++;
+				TablebaseResult position = toResult(value);
+				if (position.outcome == TablebaseResult::Outcome::Draw)
+					result.draws++;
+				else if (position.outcome == TablebaseResult::Outcome::Loss)
+					result.losses++;
+				else {
+					result.wins++;
+					result.longestMate = std::max(result.longestMate, position.pliesToMate);
+				}
+			}
+			return result;
+		}
+
+		// the value of setup for its side to move, from the table of its material
+		static std::optional<std::uint8_t> lookup(const std::map<std::string, std::unique_ptr<Table>>& tables, Setup setup)
+		{
+			if (setup.count == 0)
+				return drawValue; // bare kings
+			bool flipped;
+			auto it = tables.find(materialName(setup, flipped));
+			if (it == tables.end())
+				return std::nullopt;
+			if (flipped)
+				setup = flipColors(setup);
+			const Table& table = *it->second;
+			Setup image = canonical(setup, numSymmetries(table.pawns));
+			std::size_t index = table.index(image);
+			if (index >= table.size || table.values[image.toMove * table.size + index] == invalidValue)
+				return std::nullopt;
+			return table.values[image.toMove * table.size + index];
+		}
+	};
+
+
+	Tablebases::Tablebases(const std::string& v_directory) : directory(v_directory)
+	{
+		std::error_code error;
+		for (const auto& entry : std::filesystem::directory_iterator(this->directory, error)) {
+			if (entry.path().extension() != tableExtension)
+				continue;
+			std::string material = entry.path().stem().string();
+			bool named = false;
+			try {
+				named = canonicalMaterial(material) == material;
+			}
+			catch (const std::exception&) {
+			}
+			if (named)
+				this->load(material);
+		}
+	}
+
+	Tablebases::~Tablebases() {}
+
+	std::string Tablebases::canonicalMaterial(const std::string& material)
+	{
+		std::size_t second = material.find('K', 1);
+		if (material.size() < 2 || material.size() > 2 + maxMen || material[0] != 'K' || second == std::string::npos)
+			throw std::runtime_error("Not a material set of 2 to 4 men, such as KQKR: " + material);
+		Setup setup;
+		for (std::size_t i = 1; i < material.size(); i++) {
+			if (i == second)
+				continue;
+			if (letterOrder(material[i]) < 0)
+				throw std::runtime_error("Not a material set of 2 to 4 men, such as KQKR: " + material);
+			setup.men[setup.count++] = { charToPieceType(material[i]), i < second ? White : Black, 0 };
+		}
+		bool flipped;
+		return materialName(setup, flipped);
+	}
+
+	bool Tablebases::hasTable(const std::string& material) const
+	{
+		return this->tables.count(canonicalMaterial(material)) > 0;
+	}
+
+	void Tablebases::load(const std::string& material)
+	{
+		std::string path = (std::filesystem::path(this->directory) / (material + tableExtension)).string();
+		auto table = std::make_unique<Table>(material);
+		table->file = MappedFile(path, MappedFile::Mode::Read);
+		TableHeader header;
+		if (table->file.size() < sizeof header)
+			throw std::runtime_error("Not a tablebase file: " + path);
+		std::memcpy(&header, table->file.data(), sizeof header);
+		if (std::memcmp(header.magic, tableMagic, sizeof header.magic) != 0 || header.version != tableVersion)
+			throw std::runtime_error("Not a tablebase file of version 1: " + path);
+		if (std::string(header.material, std::find(header.material, header.material + sizeof header.material, '\0')) != material
+			|| header.size != table->size || table->file.size() != sizeof header + 2 * table->size)
+			throw std::runtime_error("Tablebase file " + path + " does not hold " + material);
+		table->values = reinterpret_cast<const std::uint8_t*>(table->file.data() + sizeof header);
+		this->tables[material] = std::move(table);
+	}
+
+	Tablebases::TableStats Tablebases::generate(const std::string& material, int threads,
+		const std::function<void(const TableStats&)>& onTable)
+	{
+		std::string name = canonicalMaterial(material);
+		auto it = this->tables.find(name);
+		if (it != this->tables.end())
+			return it->second->stats();
+
+		// the tables a capture or a promotion leads to come first
+		std::size_t second = name.find('K', 1);
+		for (std::size_t i = 1; i < name.size(); i++) {
+			if (i == second)
+				continue;
+			std::string captured = name.substr(0, i) + name.substr(i + 1);
+			if (captured.size() > 2)
+				this->generate(captured, threads, onTable);
+			if (name[i] == 'P')
+				for (char promotion : { 'Q', 'R', 'B', 'N' })
+					this->generate(name.substr(0, i) + promotion + name.substr(i + 1), threads, onTable);
+		}
+
+		TableStats stats = this->generateTable(name, threads);
+		if (onTable)
+			onTable(stats);
+		return stats;
+	}
+
+	// Retrograde analysis: a scan of all placements counts the moves of each
+	// that stay in the table and looks up where its captures and promotions
+	// lead; then pass d takes the positions decided at d plies from mate
+	// (mated for d = 0) and walks their moves backwards. A position that can
+	// move to one lost at d wins at d + 1; one whose last move still undecided
+	// turns out to reach a win at d loses at d + 1, or later if a capture
+	// holds out longer. What is left undecided is drawn.
+	Tablebases::TableStats Tablebases::generateTable(const std::string& material, int threads)
+	{
+		auto start = std::chrono::steady_clock::now();
+		threads = std::max(threads, 1);
+		Table table(material);
+		const std::size_t size = table.size;
+		const int symmetries = numSymmetries(table.pawns);
+		auto indexOf = [&table, size, symmetries](const Setup& setup) {
+			Setup image = canonical(setup, symmetries);
+			return std::uint32_t(image.toMove * size + table.index(image));
+		};
+
+		std::vector<std::atomic<std::uint8_t>> values(2 * size);    // 1 + plies to mate once decided
+		std::vector<std::atomic<std::uint8_t>> remaining(2 * size); // moves in the table not yet known to lose
+		std::vector<std::uint8_t> exitWin(2 * size);  // plies to the quickest mate through a capture or promotion, 0 for none
+		std::vector<std::uint8_t> exitLoss(2 * size); // plies to the slowest mate against, 0 for none, neverLoses
+		std::vector<std::vector<std::uint32_t>> pending(256); // by plies to mate, decided by the scan
+		std::vector<std::vector<std::pair<int, std::uint32_t>>> threadPending(threads);
+
+		parallel_for(2 * size, threads, [&](int thread, std::size_t begin, std::size_t end) {
+			std::vector<std::uint32_t> children;
+			for (std::size_t i = begin; i < end; i++) {
+				Setup setup;
+				int toMove = int(i / size);
+				if (!table.placement(i % size, toMove, setup) || inCheck(setup, toMove ^ 1)) {
+					values[i] = invalidValue;
+					continue;
+				}
+				children.clear();
+				int moves = 0, win = 0, loss = 0;
+				forEachMove(setup, [&](const Setup& child, bool leaves) {
+					moves++;
+					if (!leaves) {
+						children.push_back(indexOf(child));
+						return;
+					}
+					auto value = Table::lookup(this->tables, child);
+					if (!value)
+						throw std::runtime_error("Tablebase " + material + " needs the table of a capture or promotion");
+					if (*value == drawValue)
+						loss = neverLoses;
+					else if ((*value - 1) % 2 == 0) // the opponent is mated
+						win = win == 0 ? *value : std::min(win, int(*value));
+					else if (loss != neverLoses)
+						loss = std::max(loss, *value + 0);
+				});
+				std::sort(children.begin(), children.end());
+				remaining[i] = std::uint8_t(std::unique(children.begin(), children.end()) - children.begin());
+				exitWin[i] = std::uint8_t(win);
+				exitLoss[i] = std::uint8_t(loss);
+				if (moves == 0) {
+					if (inCheck(setup, toMove))
+						threadPending[thread].push_back({ 0, std::uint32_t(i) });
+					continue; // or stalemate
+				}
+				if (win != 0)
+					threadPending[thread].push_back({ win, std::uint32_t(i) });
+				else if (remaining[i] == 0 && loss != neverLoses)
+					threadPending[thread].push_back({ loss, std::uint32_t(i) });
+			}
+		});
+		for (auto& entries : threadPending) {
+			for (const auto& entry : entries)
+				pending[entry.first].push_back(entry.second);
+			entries.clear();
+		}
+
+		std::vector<std::uint32_t> frontier;
+		std::vector<std::vector<std::uint32_t>> next(threads);
+		for (int plies = 0; plies < 254; plies++) {
+			for (std::uint32_t i : pending[plies]) {
+				std::uint8_t undecided = 0;
+				if (values[i].compare_exchange_strong(undecided, std::uint8_t(plies + 1)))
+					frontier.push_back(i);
+			}
+			pending[plies].clear();
+			if (frontier.empty()) {
+				if (std::all_of(pending.begin() + plies, pending.end(), [](const auto& level) { return level.empty(); }))
+					break;
+				continue;
+			}
+
+			parallel_for(frontier.size(), threads, [&](int thread, std::size_t begin, std::size_t end) {
+				std::vector<std::uint32_t> previous;
+				for (std::size_t k = begin; k < end; k++) {
+					Setup setup;
+					table.placement(frontier[k] % size, int(frontier[k] / size), setup);
+					previous.clear();
+					forEachUnmove(setup, [&](const Setup& before) { previous.push_back(indexOf(before)); });
+					std::sort(previous.begin(), previous.end());
+					previous.erase(std::unique(previous.begin(), previous.end()), previous.end());
+
+					for (std::uint32_t i : previous) {
+						std::uint8_t undecided = 0;
+						if (plies % 2 == 0) { // lost here, won one move before
+							if (values[i].compare_exchange_strong(undecided, std::uint8_t(plies + 2)))
+								next[thread].push_back(i);
+							continue;
+						}
+						if (values[i].load() != 0 || remaining[i].fetch_sub(1) != 1)
+							continue;
+						if (exitWin[i] != 0 || exitLoss[i] == neverLoses)
+							continue; // wins through its capture or promotion, or draws
+						if (exitLoss[i] > plies + 1)
+							threadPending[thread].push_back({ exitLoss[i], i });
+						else if (values[i].compare_exchange_strong(undecided, std::uint8_t(plies + 2)))
+							next[thread].push_back(i);
+					}
+				}
+			});
+
+			frontier.clear();
+			for (int thread = 0; thread < threads; thread++) {
+				frontier.insert(frontier.end(), next[thread].begin(), next[thread].end());
+				next[thread].clear();
+				for (const auto& entry : threadPending[thread])
+					pending[entry.first].push_back(entry.second);
+				threadPending[thread].clear();
+			}
+		}
+
+		std::filesystem::create_directories(this->directory);
+		std::string path = (std::filesystem::path(this->directory) / (material + tableExtension)).string();
+		TableHeader header = {};
+		std::memcpy(header.magic, tableMagic, sizeof header.magic);
+		header.version = tableVersion;
+		std::memcpy(header.material, material.data(), material.size());
+		header.size = size;
+		replaceFile(path, sizeof header + 2 * size, [&header, &values](char* data) {
+			std::memcpy(data, &header, sizeof header);
+			for (std::size_t i = 0; i < values.size(); i++)
+				data[sizeof header + i] = char(values[i].load(std::memory_order_relaxed));
+		});
+		this->load(material);
+
+		TableStats stats = this->tables[material]->stats();
+		stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return stats;
+	}
+
+	std::optional<TablebaseResult> Tablebases::probe(const IBoard& board) const
+	{
+		auto setup = setupOf(board);
+		if (!setup)
+			return std::nullopt;
+		auto value = Table::lookup(this->tables, setup.value());
+		if (!value)
+			return std::nullopt;
+		return toResult(value.value());
+	}
+
+	std::optional<Move> Tablebases::bestMove(const IBoard::Ptr& board) const
+	{
+		if (!this->probe(*board))
+			return std::nullopt;
+
+		// for the side to move: a mate sooner is better, one later is better when mated
+		auto merit = [](const TablebaseResult& child) {
+			switch (child.outcome) {
+			case TablebaseResult::Outcome::Loss: return 1000 - child.pliesToMate;
+			case TablebaseResult::Outcome::Win: return -1000 + child.pliesToMate;
+			default: return 0;
+			}
+		};
+		std::optional<Move> best;
+		int bestMerit = 0;
+		for (const auto& moveBoard : board->getValidMoves()) {
+			auto child = this->probe(*moveBoard.second);
+			if (!child)
+				continue; // an en passant capture the tables do not know about
+			if (!best || merit(child.value()) > bestMerit) {
+				best = moveBoard.first;
+				bestMerit = merit(child.value());
+			}
+		}
+		return best;
+	}
+
+
+	//-------------------------------------------------------------------------
+	// AlgoTablebase
+
+	AlgoTablebase::AlgoTablebase(IAlgo::Ptr fallback, Tablebases::Ptr tables) :
+		m_fallback(fallback), m_tables(tables)
+	{
+		space_assert(m_fallback != nullptr, "AlgoTablebase needs a fallback algo");
+		space_assert(m_tables != nullptr, "AlgoTablebase needs tables");
+	}
+
+	AlgoTablebase::AlgoTablebase(const nlohmann::json& config)
+	{
+		auto directoryIt = config.find(getDirectoryField());
+		space_assert(directoryIt != config.end(), "AlgoTablebase needs the directory of its tables");
+		m_tables = std::make_shared<Tablebases>(directoryIt->get<std::string>());
+		auto fallbackIt = config.find(getFallbackField());
+		space_assert(fallbackIt != config.end(), "AlgoTablebase needs a fallback algo");
+		auto fallback = AlgoFactory::tryCreateAlgo(*fallbackIt);
+		space_assert(fallback.has_value(), "AlgoTablebase fallback algo is unknown");
+		m_fallback = fallback.value();
+	}
+
+	Move AlgoTablebase::getNextMove(IBoard::Ptr board)
+	{
+		if (auto move = m_tables->bestMove(board))
+			return move.value();
+		return m_fallback->getNextMove(board);
+	}
+
+	std::string AlgoTablebase::getAlgoName() { return "AlgoTablebase"; }
+	std::string AlgoTablebase::getDirectoryField() { return "Directory"; }
+	std::string AlgoTablebase::getFallbackField() { return "Fallback"; }
+	bool AlgoTablebase::s_algoMachineRegistration = AlgoFactory::registerAlgoMachine(AlgoTablebase::getAlgoName(), AlgoTablebase::createFromConfig);
+
+} // end namespace space
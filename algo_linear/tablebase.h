@@ -0,0 +1,100 @@
+#pragma once
+
+#include <chess/board.h>
+#include <chess/algo.h>
+
+#include <nlohmann/json.hpp>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+
+
+namespace space {
+
+	// The value of a position for the side to move, with best play
+	struct TablebaseResult {
+		enum class Outcome { Loss, Draw, Win };
+		Outcome outcome = Outcome::Draw;
+		int pliesToMate = 0; // 0 for a draw, and when mated
+	};
+
+	// Win/draw/loss and distance-to-mate tables of endings of up to 4 men,
+	// one file per material set, such as KQKR: the stronger side, king first,
+	// then the other side. A colour-flipped position is looked up in the table
+	// of the stronger side, so KRKQ reads KQKR.
+	//
+	// A table indexes the placements left by the symmetries of the board (the
+	// eight of the square without pawns, the mirror of the files with them):
+	// a king pair among those not equivalent, then 64 squares per man, 48 per
+	// pawn. One byte per placement and side to move holds 0 for a draw or
+	// 1 + the plies to mate, odd plies a win and even ones a loss.
+	//
+	// Castling and en passant are not considered: a position with castling
+	// rights or an en passant capture available is not probed.
+	class Tablebases {
+	public:
+		using Ptr = std::shared_ptr<Tablebases>;
+
+		struct TableStats {
+			std::string material;
+			std::size_t positions = 0; // legal placements, both sides to move
+			std::size_t wins = 0;      // for the side to move
+			std::size_t losses = 0;
+			std::size_t draws = 0;
+			int longestMate = 0;       // in plies
+			double seconds = 0;        // to generate; 0 when read from its file
+		};
+
+		explicit Tablebases(const std::string& directory); // maps the tables found there
+		~Tablebases();
+
+		// The table of material, read from the directory or generated there,
+		// after the tables its captures and promotions lead to; threads share
+		// the scan and each retrograde pass. onTable follows every table made.
+		TableStats generate(const std::string& material, int threads = 1,
+			const std::function<void(const TableStats&)>& onTable = nullptr);
+		bool hasTable(const std::string& material) const;
+		static std::string canonicalMaterial(const std::string& material); // "KKQ" is "KQK"; throws on a malformed one
+
+		// nullopt when there is no table for the position (see above)
+		std::optional<TablebaseResult> probe(const IBoard& board) const;
+		// a move keeping the result: the quickest win, a draw, the longest loss
+		std::optional<Move> bestMove(const IBoard::Ptr& board) const;
+
+	private:
+		struct Table;
+		std::string directory;
+		std::map<std::string, std::unique_ptr<Table>> tables;
+
+		TableStats generateTable(const std::string& material, int threads);
+		void load(const std::string& material);
+	};
+
+
+	// Plays from the tables when they hold the position, otherwise asks the
+	// wrapped algo.
+	class AlgoTablebase final : public IAlgo {
+	public:
+		AlgoTablebase(IAlgo::Ptr fallback, Tablebases::Ptr tables);
+		AlgoTablebase(const nlohmann::json& config);
+		Move getNextMove(IBoard::Ptr board) override;
+
+		static IAlgo::Ptr createFromConfig(const nlohmann::json& config) {
+			return std::make_shared<AlgoTablebase>(config);
+		}
+
+		static std::string getAlgoName();
+		static std::string getDirectoryField();
+		static std::string getFallbackField();
+
+	private:
+		IAlgo::Ptr m_fallback;
+		Tablebases::Ptr m_tables;
+
+		static bool s_algoMachineRegistration;
+	};
+
+} // end namespace space
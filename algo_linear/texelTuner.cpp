@@ -0,0 +1,240 @@
+#include "texelTuner.h"
+
+#include <chess/pgn.h>
+#include <common/base.h>
+
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+
+
+namespace {
+
+	const char cacheMagic[4] = { 'S', 'P', 'T', 'X' };
+	const std::uint32_t cacheVersion = 1;
+
+	void writeU32(std::ostream& out, std::uint32_t v)
+	{
+		out.write(reinterpret_cast<const char*>(&v), sizeof v);
+	}
+
+	std::uint32_t readU32(std::istream& in)
+	{
+		std::uint32_t v = 0;
+		in.read(reinterpret_cast<char*>(&v), sizeof v);
+		return v;
+	}
+
+	std::vector<std::string> featureNames(const space::LinearEvaluator& evaluator)
+	{
+		std::vector<std::string> names;
+		for (const auto& feature : evaluator.getFeatures())
+			names.push_back(feature->toString());
+		return names;
+	}
+
+	// the cache positioned at its first record, checked against the features
+	std::ifstream openCache(const std::string& path, const std::vector<std::string>& names)
+	{
+		std::ifstream in(path, std::ios::binary);
+		if (!in)
+			throw std::runtime_error("Cannot open position cache " + path);
+		char magic[4];
+		in.read(magic, sizeof magic);
+		std::uint32_t version = readU32(in);
+		std::uint32_t count = readU32(in);
+		if (!in || std::string(magic, 4) != std::string(cacheMagic, 4) || version != cacheVersion)
+			throw std::runtime_error("Not a position cache of version 1: " + path);
+		if (count != names.size())
+			throw std::runtime_error("Position cache " + path + " has a different number of features");
+		for (const auto& name : names) {
+			std::string stored(readU32(in), '\0');
+			in.read(&stored[0], stored.size());
+			if (!in || stored != name)
+				throw std::runtime_error("Position cache " + path + " has different features");
+		}
+		return in;
+	}
+
+	// up to maxCount records of recordSize floats; returns the number read
+	std::size_t readBatch(std::istream& in, std::vector<float>& records, std::size_t recordSize, std::size_t maxCount)
+	{
+		records.resize(recordSize * maxCount);
+		in.read(reinterpret_cast<char*>(records.data()), records.size() * sizeof(float));
+		return std::size_t(in.gcount()) / (recordSize * sizeof(float));
+	}
+
+} // end anonymous namespace
+
+
+namespace space {
+
+	TexelTuner::TexelTuner(const FeatureMap& initial, TexelConfig v_config) :
+		config(v_config), evaluator(initial), weights(evaluator.getWeights())
+	{
+		space_assert(this->config.threads > 0, "TexelTuner needs at least one thread");
+		space_assert(this->config.batchSize > 0, "TexelTuner needs a positive batch size");
+		space_assert(this->config.scale > 0, "TexelTuner needs a positive scale");
+	}
+
+	std::size_t TexelTuner::extract(std::istream& pgn, const std::string& cachePath, bool append)
+	{
+		PGNReader games(pgn);
+		return this->extract(games, cachePath, append);
+	}
+
+	std::size_t TexelTuner::extract(PGNReader& games, const std::string& cachePath, bool append)
+	{
+		auto names = featureNames(this->evaluator);
+		bool fresh = !append || !std::ifstream(cachePath);
+		if (!fresh)
+			openCache(cachePath, names); // records of other features cannot go after these
+		std::ofstream out(cachePath, std::ios::binary | (fresh ? std::ios::trunc : std::ios::app));
+		if (!out)
+			throw std::runtime_error("Cannot write position cache " + cachePath);
+		if (fresh) {
+			out.write(cacheMagic, sizeof cacheMagic);
+			writeU32(out, cacheVersion);
+			writeU32(out, std::uint32_t(names.size()));
+			for (const auto& name : names) {
+				writeU32(out, std::uint32_t(name.size()));
+				out.write(name.data(), name.size());
+			}
+		}
+
+		std::size_t n = this->numFeatures();
+		std::vector<double> values(n);
+		std::vector<float> gameRecords;
+		std::size_t written = 0;
+		Game game;
+		while (games.next_parsed(game)) {
+			auto result = game.result();
+			if (!result)
+				continue;
+
+			// buffered per game, so a game that does not replay leaves nothing behind
+			gameRecords.clear();
+			int ply = 0;
+			bool legal = game.replay([&](const IBoard::Ptr& board, const Move&) {
+				if (ply++ < this->config.skipPlies || board->isUnderCheck(board->whoPlaysNext()))
+					return;
+				this->evaluator.extract(BoardScan(board), values.data());
+				gameRecords.push_back(float(*result));
+				for (double v : values)
+					gameRecords.push_back(float(v));
+			});
+			if (!legal)
+				continue;
+
+			out.write(reinterpret_cast<const char*>(gameRecords.data()), gameRecords.size() * sizeof(float));
+			written += gameRecords.size() / (n + 1);
+		}
+		if (!out)
+			throw std::runtime_error("Cannot write position cache " + cachePath);
+		return written;
+	}
+
+	double TexelTuner::accumulate(const std::vector<float>& records, std::size_t count, std::vector<double>* gradient) const
+	{
+		std::size_t n = this->numFeatures();
+		int threads = this->config.threads;
+		std::vector<std::vector<double>> threadGradients(threads, std::vector<double>(gradient ? n : 0, 0.0));
+		std::vector<double> threadLosses(threads, 0.0);
+		double K = this->config.scale;
+
+		parallel_for(count, threads, [&](int t, std::size_t begin, std::size_t end) {
+			std::vector<double>& g = threadGradients[t];
+			double sum = 0;
+			for (std::size_t i = begin; i < end; i++) {
+				const float* record = records.data() + i * (n + 1);
+				const float* values = record + 1;
+				double score = 0;
+				for (std::size_t k = 0; k < n; k++)
+					score += this->weights[k] * values[k];
+				double predicted = 1.0 / (1.0 + std::exp(-K * score));
+				double error = record[0] - predicted;
+				sum += error * error;
+				if (!g.empty()) {
+					double factor = -2 * error * predicted * (1 - predicted) * K;
+					for (std::size_t k = 0; k < n; k++)
+						g[k] += factor * values[k];
+				}
+			}
+			threadLosses[t] = sum;
+		});
+
+		double total = 0;
+		for (int t = 0; t < threads; t++) {
+			total += threadLosses[t];
+			if (gradient)
+				for (std::size_t k = 0; k < n; k++)
+					(*gradient)[k] += threadGradients[t][k];
+		}
+		return total;
+	}
+
+	double TexelTuner::fit(const std::string& cachePath, const std::function<void(int epoch, double loss)>& onEpoch)
+	{
+		std::size_t n = this->numFeatures();
+		auto names = featureNames(this->evaluator);
+
+		// Adam keeps the step per weight near learningRate whatever the scale of its feature
+		const double beta1 = 0.9, beta2 = 0.999, epsilon = 1e-8;
+		std::vector<double> m(n, 0.0), v(n, 0.0), gradient(n);
+		long long step = 0;
+
+		double epochLoss = 0;
+		std::vector<float> records;
+		for (int epoch = 0; epoch < this->config.epochs; epoch++) {
+			std::ifstream in = openCache(cachePath, names);
+			double lossSum = 0;
+			std::size_t positions = 0;
+			while (std::size_t count = readBatch(in, records, n + 1, this->config.batchSize)) {
+				std::fill(gradient.begin(), gradient.end(), 0.0);
+				lossSum += this->accumulate(records, count, &gradient);
+				positions += count;
+
+				++step;
+				for (std::size_t k = 0; k < n; k++) {
+					double g = gradient[k] / count;
+					m[k] = beta1 * m[k] + (1 - beta1) * g;
+					v[k] = beta2 * v[k] + (1 - beta2) * g * g;
+					double mHat = m[k] / (1 - std::pow(beta1, double(step)));
+					double vHat = v[k] / (1 - std::pow(beta2, double(step)));
+					this->weights[k] -= this->config.learningRate * mHat / (std::sqrt(vHat) + epsilon);
+				}
+			}
+			space_assert(positions > 0, "The position cache is empty");
+			epochLoss = lossSum / positions;
+			if (onEpoch)
+				onEpoch(epoch, epochLoss);
+		}
+		return epochLoss;
+	}
+
+	double TexelTuner::loss(const std::string& cachePath) const
+	{
+		std::size_t n = this->numFeatures();
+		std::ifstream in = openCache(cachePath, featureNames(this->evaluator));
+		std::vector<float> records;
+		double lossSum = 0;
+		std::size_t positions = 0;
+		while (std::size_t count = readBatch(in, records, n + 1, this->config.batchSize)) {
+			lossSum += this->accumulate(records, count, nullptr);
+			positions += count;
+		}
+		space_assert(positions > 0, "The position cache is empty");
+		return lossSum / positions;
+	}
+
+	TexelTuner::FeatureMap TexelTuner::getWeights() const
+	{
+		FeatureMap result;
+		const auto& features = this->evaluator.getFeatures();
+		for (std::size_t k = 0; k < features.size(); k++)
+			result[features[k]] = this->weights[k];
+		return result;
+	}
+
+}
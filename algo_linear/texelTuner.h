@@ -0,0 +1,63 @@
+#pragma once
+
+#include "feature.h"
+
+#include <chess/pgn.h>
+
+#include <cstddef>
+#include <functional>
+#include <istream>
+#include <map>
+#include <string>
+#include <vector>
+
+
+namespace space {
+
+	struct TexelConfig {
+		int skipPlies = 8;               // opening plies left out of the data
+		int threads = 1;
+		int epochs = 20;
+		std::size_t batchSize = 1 << 16; // positions in memory at once, one gradient step each
+		double learningRate = 0.01;      // Adam step size
+		double scale = 0.576;            // K of the win chance 1 / (1 + exp(-K * score)); ln(10) / 4 for pawn units
+	};
+
+	// Fits the weights of a linear evaluation to game results (Texel's method):
+	// minimizes the mean squared difference between the result of a game and the
+	// win chance predicted for each of its positions. Feature values are extracted
+	// once into a binary cache; every epoch streams the cache in batches, so memory
+	// is bounded by the batch size however large the corpus.
+	//
+	// Cache file: "SPTX", uint32 version 1, uint32 number of features, the feature
+	// names (uint32 length, bytes), then per position the result for White
+	// (0, 0.5 or 1) and the White minus Black feature values, all as float.
+	class TexelTuner {
+	public:
+		using FeatureMap = std::map<Feature::Ptr, double>;
+
+		explicit TexelTuner(const FeatureMap& initial, TexelConfig config = TexelConfig());
+
+		// Positions of the games in pgn that have a result, not in check, after the
+		// opening. A game that does not parse or replay is dropped. Returns positions written.
+		// Appending to a cache of other features throws.
+		std::size_t extract(std::istream& pgn, const std::string& cachePath, bool append = false);
+		std::size_t extract(PGNReader& games, const std::string& cachePath, bool append = false);
+
+		// epochs of minibatch descent over the cache; returns the loss of the last epoch
+		double fit(const std::string& cachePath, const std::function<void(int epoch, double loss)>& onEpoch = nullptr);
+		double loss(const std::string& cachePath) const; // mean over the cache, current weights
+
+		FeatureMap getWeights() const;
+		std::size_t numFeatures() const { return weights.size(); }
+
+	private:
+		TexelConfig config;
+		LinearEvaluator evaluator; // feature order of the cache
+		std::vector<double> weights;
+
+		// adds the loss gradient of count records into gradient; returns their summed loss
+		double accumulate(const std::vector<float>& records, std::size_t count, std::vector<double>* gradient) const;
+	};
+
+}
@@ -0,0 +1,79 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <algo_linear/openingBook.h>
+
+namespace {
+
+	struct Options {
+		std::vector<std::string> pgnFiles;
+		std::string outputFile = "book.bin";
+		space::BookConfig book;
+	};
+
+	void printUsage(const char* program)
+	{
+		std::cout << "Builds an opening book from PGN game collections.\n\t"
+			<< program << " --pgn <games.pgn> [--pgn <games.pgn>]... [--out <book.bin>] [--maxPlies n] [--minGames n] [--help|-h]\n"
+			<< "Moves of the first --maxPlies plies played in at least --minGames games with a result go into the book.\n"
+			<< "The output is a book file for the BookFile field of AlgoBook configs."
+			<< std::endl;
+	}
+
+	Options parseOptions(int argc, char const* const* const argv)
+	{
+		Options result;
+		for (int iarg = 1; iarg < argc; ++iarg)
+		{
+			std::string arg = argv[iarg];
+			auto next = [&]() -> std::string {
+				if (++iarg >= argc)
+					throw std::runtime_error("invalid command line arguments: expected a value after '" + arg + "'");
+				return argv[iarg];
+			};
+
+			if (arg == "--pgn")
+				result.pgnFiles.push_back(next());
+			else if (arg == "--out")
+				result.outputFile = next();
+			else if (arg == "--maxPlies")
+				result.book.maxPlies = std::stoi(next());
+			else if (arg == "--minGames")
+				result.book.minGames = std::uint32_t(std::stoul(next()));
+			else if (arg == "--help" || arg == "-h")
+			{
+				printUsage(argv[0]);
+				std::exit(0);
+			}
+			else
+				throw std::runtime_error("invalid command line arguments: unknown option '" + arg + "'");
+		}
+		if (result.pgnFiles.empty())
+			throw std::runtime_error("invalid command line arguments: no --pgn file given");
+		return result;
+	}
+}
+
+int main(int argc, char const * const * const argv) {
+	Options options = parseOptions(argc, argv);
+
+	auto start = std::chrono::steady_clock::now();
+	space::BookBuilder builder(options.book);
+	std::size_t games = 0;
+	for (const auto& pgnFile : options.pgnFiles)
+	{
+		space::PGNReader pgn(pgnFile); // mapped into memory, throws when it cannot be opened
+		std::size_t fileGames = builder.add(pgn);
+		std::cout << pgnFile << ": " << fileGames << " games" << std::endl;
+		games += fileGames;
+	}
+	builder.write(options.outputFile);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	space::OpeningBook book(options.outputFile);
+	std::cout << games << " games, " << book.size() << " book moves written to " << options.outputFile
+		<< " (" << elapsed.count() << " s)" << std::endl;
+	return 0;
+}
@@ -31,12 +31,17 @@ namespace space {
 		if (config.end() == algoNameIt)
 			return std::optional<IAlgo::Ptr>();
 		auto algoName = algoNameIt->get<std::string>();
-		auto instance = getInstance();
-		std::lock_guard<std::mutex> lock(getSingletonMutex());
-		auto algoIt = instance.m_algoMachines.find(algoName);
-		if (algoIt == instance.m_algoMachines.end())
-			return std::optional<IAlgo::Ptr>();
-		return (*algoIt->second)(config);
+		AlgoMachine algoMachine;
+		{
+			AlgoFactory& instance = getInstance();
+			std::lock_guard<std::mutex> lock(getSingletonMutex());
+			auto algoIt = instance.m_algoMachines.find(algoName);
+			if (algoIt == instance.m_algoMachines.end())
+				return std::optional<IAlgo::Ptr>();
+			algoMachine = algoIt->second;
+		}
+		// called unlocked: decorators create their wrapped algo through the factory
+		return (*algoMachine)(config);
 	}
 
 	AlgoFactory::AlgoFactory() {}
@@ -6,6 +6,7 @@
 #include <map>
 #include <string>
 #include <sstream>
+#include <cstdint>
 
 namespace space {
 	enum class Color { White, Black };
@@ -63,6 +64,7 @@ namespace space {
 		using MoveMap = std::map<Move, Ptr>;
 		virtual Color whoPlaysNext() const = 0;
 		virtual std::optional<Piece> getPiece(Position position) const = 0;
+		virtual Position getKingPosition(Color color) const = 0;
 
 		std::optional<Position> enPassantSquare;
 
@@ -78,6 +80,26 @@ namespace space {
 		) const = 0;
 		virtual std::optional<Ptr> updateBoard(Move move) const = 0;
 		virtual MoveMap getValidMoves() const = 0;
+		virtual bool isValidMove(const Move& move) const = 0; // one of getValidMoves, without building the boards
+
+		// Mobility without building boards: the number of getValidMoves, and the
+		// moves of color without the checks on its own king (approximate, cheaper)
+		virtual int countLegalMoves() const = 0;
+		virtual int countPseudoLegalMoves(Color color) const = 0;
+
+		// Attack maps, a square being bit rank * 8 + file; computed once per position, on the first query
+		virtual std::uint64_t getAttackedSquares(Color color) const = 0; // squares the pieces of color attack
+		virtual std::uint64_t getAttackers(Position square, Color color) const = 0; // pieces of color attacking square
+		virtual bool isHanging(Position square) const = 0; // a piece attacked by the other color and not defended
+
+		// Zobrist hash of the position (pieces, castling rights, side to move, en passant square)
+		virtual std::uint64_t getHash() const = 0;
+
+		// Kept up to date as moves are applied, so evaluators can read them in O(1)
+		virtual int getPieceCount(Color color, PieceType pieceType) const = 0;
+		virtual std::uint8_t getPawnRanks(Color color, int file) const = 0; // bit r set for a pawn on rank r
+		virtual std::uint64_t getPawnHash() const = 0; // Zobrist hash of the pawns only
+		virtual void getCounts(int (&pieceCount)[2][7], std::uint8_t (&pawnRanks)[2][8]) const = 0; // all of the above counts in one call
 		virtual std::string as_string(
 				bool unicode_pieces = false,
 				bool terminal_colors = false,
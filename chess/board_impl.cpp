@@ -1,12 +1,15 @@
 #include "board_impl.h"
+#include "zobrist.h"
 #include "common/base.h"
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 #include <stdexcept>
 #include <vector>
 #include <memory>
 #include <cmath>
+#include <limits>
 
 namespace {
 
@@ -109,6 +112,9 @@ namespace space {
 
 	Position space::BoardImpl::getKingPosition(Color color) const
 	{
+		int square = this->m_kingSquare[int(color)];
+		if (square >= 0)
+			return Position(square / 8, square % 8);
 
 		for (int i = 0; i < 8; i++) {
 			for (int j = 0; j < 8; j++) {
@@ -123,19 +129,15 @@ namespace space {
 
 	bool BoardImpl::isStaleMate() const
 	{
-		if (!this->isUnderCheck(this->m_whoPlaysNext)) {
-			std::map<Move, IBoard::Ptr> allMoves = this->getValidMoves();
-			return allMoves.size() == 0;
-		}
+		if (!this->isUnderCheck(this->m_whoPlaysNext))
+			return this->countLegal(1) == 0;
 		return false;
 	}
 
 	bool BoardImpl::isCheckMate() const
 	{
-		if (this->isUnderCheck(this->m_whoPlaysNext)) {
-			std::map<Move, IBoard::Ptr> allMoves = this->getValidMoves();
-			return allMoves.size() == 0;
-		}
+		if (this->isUnderCheck(this->m_whoPlaysNext))
+			return this->countLegal(1) == 0;
 		return false;
 	}
 
@@ -151,13 +153,15 @@ namespace space {
 		newBoard->m_canBlackCastleRight = this->m_canBlackCastleRight;
 		newBoard->m_whoPlaysNext = this->getColor(false);
 		newBoard->enPassantSquare = {};
+		newBoard->m_hash = this->m_hash ^ Zobrist::blackToMoveKey() ^ this->castlingHash();
+		newBoard->m_pawnHash = this->m_pawnHash;
+		newBoard->m_pieceCount = this->m_pieceCount;
+		newBoard->m_pawnRanks = this->m_pawnRanks;
+		newBoard->m_kingSquare = this->m_kingSquare;
 
 		Piece pSource = this->m_pieces[move.sourceRank][move.sourceFile];
-		Piece& pSourceNew = newBoard->m_pieces[move.sourceRank][move.sourceFile];
-		Piece& pTargetNew = newBoard->m_pieces[move.destinationRank][move.destinationFile];
-
-		pSourceNew = { PieceType::None, Color::White };
-		pTargetNew = { pSource.pieceType, pSource.color };
+		newBoard->setSquare(move.sourceRank, move.sourceFile, { PieceType::None, Color::White });
+		newBoard->setSquare(move.destinationRank, move.destinationFile, pSource);
 
 
 		// Castling bools update
@@ -227,9 +231,9 @@ namespace space {
 						pRook.color == pSource.color,
 					"Rook Not found for castling");
 
-				newBoard->m_pieces[move.sourceRank][rookFile].pieceType = PieceType::None;
+				newBoard->setSquare(move.sourceRank, rookFile, { PieceType::None, Color::White });
 				int rookDestFile = (move.sourceFile + move.destinationFile) / 2;
-				newBoard->m_pieces[move.sourceRank][rookDestFile] = { pRook.pieceType, pRook.color };
+				newBoard->setSquare(move.sourceRank, rookDestFile, pRook);
 			}
 			break;
 
@@ -240,7 +244,7 @@ namespace space {
 			if (move.destinationRank == 0 || move.destinationRank == 7) {  // promotion
 				space_assert((move.destinationRank == 0) == (pSource.color == Color::Black),
 					"Pawn on back row");
-				pTargetNew.pieceType = move.promotedPiece;
+				newBoard->setSquare(move.destinationRank, move.destinationFile, { move.promotedPiece, pSource.color });
 			}
 
 			switch (pSource.color){
@@ -248,28 +252,26 @@ namespace space {
 				if (move.sourceRank == 1 && move.destinationRank == 3) {  // double move
 					space_assert(this->m_pieces[2][move.sourceFile].pieceType == PieceType::None,
 						"White Pawn double move blocked");
-					pTargetNew.pieceType = PieceType::Pawn;
 					newBoard->enPassantSquare = { 2, move.sourceFile };
 				}
 				else if (move.sourceRank == 4 && enPassantSquare.has_value()
 				      && move.destinationRank == enPassantSquare.value().rank
 					  && move.destinationFile == enPassantSquare.value().file) {
-					newBoard->m_pieces[move.sourceRank][move.destinationFile].pieceType
-						= PieceType::None;    // En passant capture
+					newBoard->setSquare(move.sourceRank, move.destinationFile,
+						{ PieceType::None, Color::White });    // En passant capture
 				}
 				break;
 			case Color::Black:
 				if (move.sourceRank == 6 && move.destinationRank == 4) {  // double move
 					space_assert(this->m_pieces[5][move.sourceFile].pieceType == PieceType::None,
 						"Black Pawn double move blocked");
-					pTargetNew.pieceType = PieceType::Pawn;
 					newBoard->enPassantSquare = { 5, move.sourceFile };
 				}
 				else if (move.sourceRank == 3 && enPassantSquare.has_value()
 				      && move.destinationRank == enPassantSquare.value().rank
 					  && move.destinationFile == enPassantSquare.value().file) {
-					newBoard->m_pieces[move.sourceRank][move.destinationFile].pieceType
-						= PieceType::None;    // En passant capture
+					newBoard->setSquare(move.sourceRank, move.destinationFile,
+						{ PieceType::None, Color::White });    // En passant capture
 				}
 				break;
 			default:
@@ -280,6 +282,7 @@ namespace space {
 			break;
 		}
 
+		newBoard->m_hash ^= newBoard->castlingHash();
 		return newBoard;
 	}
 
@@ -357,6 +360,7 @@ namespace space {
 		// white make the first move
 		board->m_whoPlaysNext = Color::White;
 
+		board->computeHash();
 		return board;
 	}
 
@@ -454,6 +458,7 @@ namespace space {
 			throw std::runtime_error(std::string("Expecting 'a'-'h' or '-', got '") + c + "'");
 		}
 
+		board->computeHash();
 		return board;
 	}
 
@@ -474,7 +479,225 @@ namespace space {
 		m_canBlackCastleLeft(canBlackCastleLeft),
 		m_canBlackCastleRight(canBlackCastleRight),
 		m_whoPlaysNext(whoPlaysNext)
-	{ }
+	{
+		computeHash();
+	}
+
+	void BoardImpl::assign(
+			const std::array<std::array<Piece, 8>, 8> & pieces,
+			bool canWhiteCastleLeft,
+			bool canWhiteCastleRight,
+			bool canBlackCastleLeft,
+			bool canBlackCastleRight,
+			Color whoPlaysNext)
+	{
+		m_pieces = pieces;
+		m_canWhiteCastleLeft = canWhiteCastleLeft;
+		m_canWhiteCastleRight = canWhiteCastleRight;
+		m_canBlackCastleLeft = canBlackCastleLeft;
+		m_canBlackCastleRight = canBlackCastleRight;
+		m_whoPlaysNext = whoPlaysNext;
+		enPassantSquare.reset();
+		computeHash();
+	}
+
+
+	std::uint64_t BoardImpl::getHash() const
+	{
+		if (enPassantSquare.has_value())
+			return m_hash ^ Zobrist::enPassantKey(enPassantSquare.value().file);
+		return m_hash;
+	}
+
+	int BoardImpl::getPieceCount(Color color, PieceType pieceType) const
+	{
+		return pieceType == PieceType::None ? 0 : m_pieceCount[int(color)][int(pieceType)];
+	}
+
+	std::uint8_t BoardImpl::getPawnRanks(Color color, int file) const
+	{
+		return m_pawnRanks[int(color)][file];
+	}
+
+	std::uint64_t BoardImpl::getPawnHash() const
+	{
+		return m_pawnHash;
+	}
+
+	void BoardImpl::getCounts(int (&pieceCount)[2][7], std::uint8_t (&pawnRanks)[2][8]) const
+	{
+		for (int c = 0; c < 2; c++) {
+			std::copy(m_pieceCount[c].begin(), m_pieceCount[c].end(), pieceCount[c]);
+			std::copy(m_pawnRanks[c].begin(), m_pawnRanks[c].end(), pawnRanks[c]);
+		}
+		pieceCount[0][int(PieceType::None)] = pieceCount[1][int(PieceType::None)] = 0;
+	}
+
+	std::uint64_t BoardImpl::getAttackedSquares(Color color) const
+	{
+		return attackMaps().attacked[int(color)];
+	}
+
+	std::uint64_t BoardImpl::getAttackers(Position square, Color color) const
+	{
+		const AttackMaps& maps = attackMaps();
+		return maps.attackers[square.rank * 8 + square.file] & maps.occupied[int(color)];
+	}
+
+	bool BoardImpl::isHanging(Position square) const
+	{
+		Piece piece = m_pieces[square.rank][square.file];
+		if (piece.pieceType == PieceType::None)
+			return false;
+		Color other = piece.color == Color::White ? Color::Black : Color::White;
+		return getAttackers(square, other) != 0 && getAttackers(square, piece.color) == 0;
+	}
+
+	// Boards are shared between search threads once built, so the maps are
+	// published with a compare-exchange: the first one stored stays for the
+	// lifetime of the board and references to it remain valid.
+	const BoardImpl::AttackMaps& BoardImpl::attackMaps() const
+	{
+		std::shared_ptr<const AttackMaps> current = std::atomic_load(&m_attackMaps);
+		if (current)
+			return *current;
+
+		auto maps = std::make_shared<AttackMaps>();
+		for (int rank = 0; rank < 8; ++rank)
+			for (int file = 0; file < 8; ++file) {
+				Piece piece = m_pieces[rank][file];
+				if (piece.pieceType == PieceType::None)
+					continue;
+				int c = int(piece.color);
+				std::uint64_t bit = std::uint64_t(1) << (rank * 8 + file);
+				maps->occupied[c] |= bit;
+				auto mark = [&](int r, int f) {
+					maps->attackers[r * 8 + f] |= bit;
+					maps->attacked[c] |= std::uint64_t(1) << (r * 8 + f);
+				};
+				// rays stop at the first piece, which is attacked (or defended)
+				auto walk = [&](const std::vector<std::vector<std::pair<int, int>>>& directions) {
+					for (const auto& direction : directions)
+						for (const auto& offset : direction) {
+							int r = rank + offset.first, f = file + offset.second;
+							if (!inRange(r) || !inRange(f))
+								break;
+							mark(r, f);
+							if (m_pieces[r][f].pieceType != PieceType::None)
+								break;
+						}
+				};
+
+				switch (piece.pieceType) {
+				case PieceType::Pawn: {
+					int r = rank + (piece.color == Color::White ? 1 : -1);
+					if (inRange(r))
+						for (int f : { file - 1, file + 1 })
+							if (inRange(f))
+								mark(r, f);
+					break;
+				}
+				case PieceType::Knight:
+					walk(internals::MoveOffsets::knight_offsets);
+					break;
+				case PieceType::King:
+					walk(internals::MoveOffsets::king_offsets);
+					break;
+				case PieceType::Rook:
+					walk(internals::MoveOffsets::orthogonal_offsets);
+					break;
+				case PieceType::Bishop:
+					walk(internals::MoveOffsets::diagonal_offsets);
+					break;
+				case PieceType::Queen:
+					walk(internals::MoveOffsets::orthogonal_offsets);
+					walk(internals::MoveOffsets::diagonal_offsets);
+					break;
+				default:
+					break;
+				}
+			}
+
+		std::shared_ptr<const AttackMaps> computed = maps;
+		if (std::atomic_compare_exchange_strong(&m_attackMaps, &current, computed))
+			return *computed;
+		return *current; // another thread stored its maps first
+	}
+
+	void BoardImpl::computeHash()
+	{
+		std::uint64_t hash = castlingHash();
+		if (m_whoPlaysNext == Color::Black) hash ^= Zobrist::blackToMoveKey();
+		std::uint64_t pawnHash = 0;
+		std::array<std::array<int, 7>, 2> pieceCount = {};
+		std::array<std::array<std::uint8_t, 8>, 2> pawnRanks = {};
+		std::array<int, 2> kingSquare = { -1, -1 };
+
+		// one pass over the occupied squares, as setSquare would leave them
+		for (int rank = 0; rank < 8; ++rank)
+			for (int file = 0; file < 8; ++file) {
+				Piece piece = m_pieces[rank][file];
+				if (piece.pieceType == PieceType::None)
+					continue;
+				int c = int(piece.color);
+				std::uint64_t key = Zobrist::pieceKey(piece, rank, file);
+				hash ^= key;
+				++pieceCount[c][int(piece.pieceType)];
+				if (piece.pieceType == PieceType::Pawn) {
+					pawnRanks[c][file] |= std::uint8_t(1u << rank);
+					pawnHash ^= key;
+				}
+				else if (piece.pieceType == PieceType::King)
+					kingSquare[c] = rank * 8 + file;
+			}
+
+		m_hash = hash;
+		m_pawnHash = pawnHash;
+		m_pieceCount = pieceCount;
+		m_pawnRanks = pawnRanks;
+		m_kingSquare = kingSquare;
+		m_attackMaps.reset();
+	}
+
+	void BoardImpl::setSquare(int rank, int file, Piece piece)
+	{
+		if (m_attackMaps)
+			m_attackMaps.reset();
+		Piece& square = m_pieces[rank][file];
+		if (square.pieceType != PieceType::None) {
+			int c = int(square.color);
+			m_hash ^= Zobrist::pieceKey(square, rank, file);
+			--m_pieceCount[c][int(square.pieceType)];
+			if (square.pieceType == PieceType::Pawn) {
+				m_pawnRanks[c][file] &= std::uint8_t(~(1u << rank));
+				m_pawnHash ^= Zobrist::pieceKey(square, rank, file);
+			}
+			else if (square.pieceType == PieceType::King && m_kingSquare[c] == rank * 8 + file)
+				m_kingSquare[c] = -1;
+		}
+		square = piece;
+		if (piece.pieceType != PieceType::None) {
+			int c = int(piece.color);
+			m_hash ^= Zobrist::pieceKey(piece, rank, file);
+			++m_pieceCount[c][int(piece.pieceType)];
+			if (piece.pieceType == PieceType::Pawn) {
+				m_pawnRanks[c][file] |= std::uint8_t(1u << rank);
+				m_pawnHash ^= Zobrist::pieceKey(piece, rank, file);
+			}
+			else if (piece.pieceType == PieceType::King)
+				m_kingSquare[c] = rank * 8 + file;
+		}
+	}
+
+	std::uint64_t BoardImpl::castlingHash() const
+	{
+		std::uint64_t hash = 0;
+		if (m_canWhiteCastleLeft) hash ^= Zobrist::castleLeftKey(Color::White);
+		if (m_canWhiteCastleRight) hash ^= Zobrist::castleRightKey(Color::White);
+		if (m_canBlackCastleLeft) hash ^= Zobrist::castleLeftKey(Color::Black);
+		if (m_canBlackCastleRight) hash ^= Zobrist::castleRightKey(Color::Black);
+		return hash;
+	}
 
 
 	// In this we check for obstructions, returns true if no obstructions
@@ -718,14 +941,16 @@ namespace space {
 	
 
 
-	std::vector<Move> BoardImpl::getAllMoves(Position position) const
+	// candidate moves of the piece on position, castling included, before the
+	// obstruction and check tests of getValidMoves
+	template <class F>
+	void BoardImpl::forEachMove(Position position, F&& f) const
 	{
 		int rank = position.rank;
 		int file = position.file;
 		Piece p = this->m_pieces[rank][file];
 		PieceType t = p.pieceType;
 		Color c = p.color;
-		std::vector<Move> moves;
 
 		if (t == PieceType::King) {
 			for (int i = -1; i <= 1; i++) {
@@ -733,7 +958,7 @@ namespace space {
 					if (((i != 0) || (j != 0)) &&
 						 inRange(i + rank) && inRange(j + file) )
 					{
-						moves.push_back({ rank, file, i + rank, j + file });
+						f(Move{ rank, file, i + rank, j + file });
 					}
 				}
 			}
@@ -742,9 +967,9 @@ namespace space {
 		else if (t == PieceType::Rook || t == PieceType::Queen) {
 			for (int j = 0; j < 8; j++) {
 				if (j != rank)
-					moves.push_back({ rank, file, j, file });
+					f(Move{ rank, file, j, file });
 				if (j != file)
-					moves.push_back({ rank, file, rank, j });
+					f(Move{ rank, file, rank, j });
 			}
 		}
 
@@ -756,7 +981,7 @@ namespace space {
 						int tgtFile = file + j * (tgtRank - rank);
 
 						if (inRange(tgtFile)) {
-							moves.push_back({ rank, file, tgtRank, tgtFile });
+							f(Move{ rank, file, tgtRank, tgtFile });
 						}
 					}
 				}
@@ -772,7 +997,7 @@ namespace space {
 						int tgtFile = file + (3 - k) * j;
 						if (inRange(tgtRank) && inRange(tgtFile))
 						{
-							moves.push_back({ rank, file, tgtRank, tgtFile });
+							f(Move{ rank, file, tgtRank, tgtFile });
 						}
 					}
 				}
@@ -796,19 +1021,19 @@ namespace space {
 
 					// pawn promotion
 					if (rank == (c == Color::White ? 6 : 1)) {
-						moves.push_back({ rank, file, rank + direction, file + j,PieceType::Bishop });
-						moves.push_back({ rank, file, rank + direction, file + j,PieceType::Rook });
-						moves.push_back({ rank, file, rank + direction, file + j,PieceType::Queen });
-						moves.push_back({ rank, file, rank + direction, file + j,PieceType::Knight });
+						f(Move{ rank, file, rank + direction, file + j,PieceType::Bishop });
+						f(Move{ rank, file, rank + direction, file + j,PieceType::Rook });
+						f(Move{ rank, file, rank + direction, file + j,PieceType::Queen });
+						f(Move{ rank, file, rank + direction, file + j,PieceType::Knight });
 					}
 					// one step move
 					else {
-						moves.push_back({ rank, file, rank + direction, file + j });
+						f(Move{ rank, file, rank + direction, file + j });
 						// two step from home row, only straight
 						if (j == 0 && rank == (c == Color::White ? 1 : 6)) {
 							Piece pStraight2 = this->m_pieces[rank + 2 * direction][file];
 							if (pStraight2.pieceType == PieceType::None) {
-								moves.push_back({ rank, file, rank + 2 * direction, file });
+								f(Move{ rank, file, rank + 2 * direction, file });
 							}
 						}
 					}
@@ -819,7 +1044,7 @@ namespace space {
 			auto enPassantRank = direction == 1 ? 4 : 3;
 			if (t == PieceType::Pawn && enPassantSquare.has_value() &&
 				rank == enPassantRank && abs(file - enPassantSquare.value().file) == 1) {
-				moves.push_back({ rank, file, enPassantSquare.value().rank, enPassantSquare.value().file});
+				f(Move{ rank, file, enPassantSquare.value().rank, enPassantSquare.value().file});
 			}
 		}
 
@@ -837,7 +1062,7 @@ namespace space {
 				if (m_pieces[baseRank][i].pieceType != PieceType::None) clear = false;
 			}
 			if (clear)
-				moves.push_back({ rank, file, rank, file - 2 * direction });
+				f(Move{ rank, file, rank, file - 2 * direction });
 		}
 
 		if (t == PieceType::King && canCastleRight(c))
@@ -848,12 +1073,145 @@ namespace space {
 				if (m_pieces[baseRank][i].pieceType != PieceType::None) clear = false;
 			}
 			if (clear)
-			moves.push_back({ rank, file, rank, file + 2 * direction });
+			f(Move{ rank, file, rank, file + 2 * direction });
 		}
 
+	}
+
+
+	std::vector<Move> BoardImpl::getAllMoves(Position position) const
+	{
+		std::vector<Move> moves;
+		this->forEachMove(position, [&moves](const Move& m) { moves.push_back(m); });
 		return moves;
 	}
 
+	int BoardImpl::countLegalMoves() const
+	{
+		return this->countLegal(std::numeric_limits<int>::max());
+	}
+
+	int BoardImpl::countPseudoLegalMoves(Color color) const
+	{
+		int count = 0;
+		for (int rank = 0; rank < 8; rank++)
+			for (int file = 0; file < 8; file++) {
+				Piece piece = this->m_pieces[rank][file];
+				if (piece.color == color && piece.pieceType != PieceType::None)
+					this->forEachMove({ rank, file }, [this, &count](const Move& m) {
+						if (this->checkObstructions(m))
+							++count;
+					});
+			}
+		return count;
+	}
+
+	int BoardImpl::countLegal(int limit) const
+	{
+		Color color = this->getColor(true);
+		bool inCheck = this->isUnderCheck(color);
+		BoardImpl scratch = this->scratchCopy();
+		int count = 0;
+		for (int rank = 0; rank < 8 && count < limit; rank++)
+			for (int file = 0; file < 8 && count < limit; file++) {
+				Piece piece = this->m_pieces[rank][file];
+				if (piece.color == color && piece.pieceType != PieceType::None)
+					this->forEachMove({ rank, file }, [&](const Move& m) {
+						if (count < limit && this->checkObstructions(m) && this->isLegal(scratch, m, inCheck))
+							++count;
+					});
+			}
+		return count;
+	}
+
+	bool BoardImpl::isValidMove(const Move& move) const
+	{
+		if (!inRange(move.sourceRank) || !inRange(move.sourceFile) || !inRange(move.destinationRank) || !inRange(move.destinationFile))
+			return false;
+		Color color = this->getColor(true);
+		Piece piece = this->m_pieces[move.sourceRank][move.sourceFile];
+		if (piece.color != color || piece.pieceType == PieceType::None)
+			return false;
+		bool generated = false;
+		this->forEachMove({ move.sourceRank, move.sourceFile }, [&move, &generated](const Move& m) {
+			if (!(m < move) && !(move < m))
+				generated = true;
+		});
+		if (!generated || !this->checkObstructions(move))
+			return false;
+		BoardImpl scratch = this->scratchCopy();
+		return this->isLegal(scratch, move, this->isUnderCheck(color));
+	}
+
+	BoardImpl BoardImpl::scratchCopy() const
+	{
+		BoardImpl scratch;
+		scratch.m_pieces = this->m_pieces;
+		scratch.m_canWhiteCastleLeft = this->m_canWhiteCastleLeft;
+		scratch.m_canWhiteCastleRight = this->m_canWhiteCastleRight;
+		scratch.m_canBlackCastleLeft = this->m_canBlackCastleLeft;
+		scratch.m_canBlackCastleRight = this->m_canBlackCastleRight;
+		scratch.m_whoPlaysNext = this->m_whoPlaysNext;
+		scratch.enPassantSquare = this->enPassantSquare;
+		scratch.m_hash = this->m_hash;
+		scratch.m_pawnHash = this->m_pawnHash;
+		scratch.m_pieceCount = this->m_pieceCount;
+		scratch.m_pawnRanks = this->m_pawnRanks;
+		scratch.m_kingSquare = this->m_kingSquare;
+		return scratch;
+	}
+
+	// the squares updateBoard changes, set on scratch and restored after the check test
+	bool BoardImpl::isLegal(BoardImpl& scratch, const Move& m, bool inCheck) const
+	{
+		Color color = this->getColor(true);
+		Piece pSource = this->m_pieces[m.sourceRank][m.sourceFile];
+		int fileChange = m.destinationFile - m.sourceFile;
+		bool castling = pSource.pieceType == PieceType::King && abs(fileChange) == 2;
+		if (castling) {
+			int castledir = fileChange / 2;
+			if (inCheck ||
+				this->isUnderCheck(color, Position(m.sourceRank, m.sourceFile + 2 * castledir)) ||
+				this->isUnderCheck(color, Position(m.sourceRank, m.sourceFile + castledir)))
+				return false;
+		}
+
+		struct Saved { int rank; int file; Piece piece; };
+		Saved saved[4];
+		int numSaved = 0;
+		auto set = [&](int rank, int file, Piece piece) {
+			saved[numSaved++] = { rank, file, scratch.m_pieces[rank][file] };
+			scratch.m_pieces[rank][file] = piece;
+		};
+
+		bool promotion = pSource.pieceType == PieceType::Pawn && (m.destinationRank == 0 || m.destinationRank == 7);
+		set(m.sourceRank, m.sourceFile, { PieceType::None, Color::White });
+		set(m.destinationRank, m.destinationFile, promotion ? Piece(m.promotedPiece, color) : pSource);
+		if (castling) {
+			int rookFile = (fileChange > 0 ? 7 : 0);
+			set(m.sourceRank, (m.sourceFile + m.destinationFile) / 2, this->m_pieces[m.sourceRank][rookFile]);
+			set(m.sourceRank, rookFile, { PieceType::None, Color::White });
+		}
+		else if (pSource.pieceType == PieceType::Pawn && this->enPassantSquare.has_value()
+			&& m.sourceRank == (color == Color::White ? 4 : 3)
+			&& m.destinationRank == this->enPassantSquare.value().rank
+			&& m.destinationFile == this->enPassantSquare.value().file) {
+			set(m.sourceRank, m.destinationFile, { PieceType::None, Color::White }); // En passant capture
+		}
+		int kingSquare = scratch.m_kingSquare[int(color)];
+		if (pSource.pieceType == PieceType::King)
+			scratch.m_kingSquare[int(color)] = m.destinationRank * 8 + m.destinationFile;
+
+		bool legal = !scratch.isUnderCheck(color);
+
+		scratch.m_kingSquare[int(color)] = kingSquare;
+		while (numSaved > 0) {
+			--numSaved;
+			scratch.m_pieces[saved[numSaved].rank][saved[numSaved].file] = saved[numSaved].piece;
+		}
+		return legal;
+	}
+
 
 	std::string BoardImpl::as_string(
 			bool terminal_colors,
@@ -24,6 +24,17 @@ namespace space {
 		) const override;
 		std::optional<Ptr> updateBoard(Move move) const override;
 		MoveMap getValidMoves() const override;
+		bool isValidMove(const Move& move) const override;
+		int countLegalMoves() const override;
+		int countPseudoLegalMoves(Color color) const override;
+		std::uint64_t getHash() const override;
+		int getPieceCount(Color color, PieceType pieceType) const override;
+		std::uint8_t getPawnRanks(Color color, int file) const override;
+		std::uint64_t getPawnHash() const override;
+		void getCounts(int (&pieceCount)[2][7], std::uint8_t (&pawnRanks)[2][8]) const override;
+		std::uint64_t getAttackedSquares(Color color) const override;
+		std::uint64_t getAttackers(Position square, Color color) const override;
+		bool isHanging(Position square) const override;
 
 		static Ptr getStartingBoard();
 		static Ptr fromFen(const Fen& fen);
@@ -41,9 +52,17 @@ namespace space {
 				bool canBlackCastleLeft,
 				bool canBlackCastleRight,
 				Color whoPlaysNext);
+		// sets up the board in place, as the constructor above does, without allocating
+		void assign(
+				const std::array<std::array<Piece, 8>, 8> & pieces,
+				bool canWhiteCastleLeft,
+				bool canWhiteCastleRight,
+				bool canBlackCastleLeft,
+				bool canBlackCastleRight,
+				Color whoPlaysNext);
 
 
-		Position getKingPosition(Color color) const;
+		Position getKingPosition(Color color) const override;
 
 
 	private:
@@ -53,12 +72,33 @@ namespace space {
 		bool m_canBlackCastleLeft;
 		bool m_canBlackCastleRight;
 		Color m_whoPlaysNext;
+		std::uint64_t m_hash; // without the en passant key, which is added in getHash
+		std::uint64_t m_pawnHash;
+		std::array<std::array<int, 7>, 2> m_pieceCount;           // by color and piece type
+		std::array<std::array<std::uint8_t, 8>, 2> m_pawnRanks;  // by color and file
+		std::array<int, 2> m_kingSquare;                         // rank * 8 + file, -1 without a king
+		struct AttackMaps {
+			std::array<std::uint64_t, 64> attackers = {}; // by square, pieces of both colors
+			std::array<std::uint64_t, 2> occupied = {};   // by color
+			std::array<std::uint64_t, 2> attacked = {};   // by color
+		};
+		mutable std::shared_ptr<const AttackMaps> m_attackMaps; // set once by attackMaps, dropped by setSquare
+		const AttackMaps& attackMaps() const;
+		void computeHash(); // hashes, counts and pawn ranks from scratch
+		void setSquare(int rank, int file, Piece piece); // keeps hashes, counts and pawn ranks up to date
+		std::uint64_t castlingHash() const;
 		bool checkObstructions(Move m) const;
 		bool canMove(Move m) const;
 		bool checkPathEmpty(Move m) const;
     
 		std::vector<Move> getAllMoves(Color color) const;
 		std::vector<Move> getAllMoves(Position position) const;
+		template <class F> void forEachMove(Position position, F&& f) const; // f(Move) for each of getAllMoves(position)
+		int countLegal(int limit) const; // legal moves, counting stops at limit
+		// A board for isLegal to apply moves to: the pieces, flags, counts and king
+		// squares, not the attack maps, which other threads may be publishing
+		BoardImpl scratchCopy() const;
+		bool isLegal(BoardImpl& scratch, const Move& m, bool inCheck) const; // as getValidMoves, applying m to scratch and undoing it
 		std::vector<Move> getAllmovesWithoutObstructions(Color color) const;
 		inline bool inRange(int x) const { return (x >= 0) && (x < 8); }
 		Color getColor(bool current = true) const;
@@ -75,10 +75,10 @@ namespace space {
 
 		result << ' ';
 		bool canCastle = false;
-		if (board->canCastleLeft(Color::White)) { result << 'K'; canCastle = true; }
-		if (board->canCastleRight(Color::White)) { result << 'Q'; canCastle = true; }
-		if (board->canCastleRight(Color::Black)) { result << 'k'; canCastle = true; }
-		if (board->canCastleLeft(Color::Black)) { result << 'q'; canCastle = true; }
+		if (board->canCastleRight(Color::White)) { result << 'K'; canCastle = true; }
+		if (board->canCastleLeft(Color::White)) { result << 'Q'; canCastle = true; }
+		if (board->canCastleLeft(Color::Black)) { result << 'k'; canCastle = true; }
+		if (board->canCastleRight(Color::Black)) { result << 'q'; canCastle = true; }
 		if (!canCastle) result << '-';
 
 		result << ' ';
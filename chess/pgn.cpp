@@ -1,7 +1,7 @@
 #include "pgn.h"
 #include "board_impl.h"
+#include <algorithm>
 #include <iostream>
-#include <sstream>
 #include <map>
 #include <vector>
 #include <cctype>
@@ -24,12 +24,12 @@ namespace {
 
     int to_rank(char c) { return c - '1'; }
 
-    space::Ply parse_move(std::string move, int move_number, space::Color side) {
-        int pos = move.length() - 1;
+    space::Ply parse_move(std::string_view move, int move_number, space::Color side) {
+        int pos = int(move.length()) - 1;
 
         // Annotations: ?, !
         while (move[pos] == '!' || move[pos] == '?') pos -= 1;
-        std::string annotation = pos == move.length() - 1 ? "" : move.substr(pos + 1);
+        std::string_view annotation = pos == int(move.length()) - 1 ? std::string_view() : move.substr(pos + 1);
 
         // Checks: +, ++, #
         bool is_check = move[pos] == '+' || move[pos] == '#';
@@ -41,7 +41,7 @@ namespace {
         bool is_short_castle = !is_long_castle && move.substr(0, 3) == "O-O";
 
         // Promotion: =Q, =N, etc
-        auto promotion_piece = space::Piece();
+        auto promotion_piece = space::Piece(space::PieceType::None, side);
         bool is_promotion = !is_long_castle && !is_short_castle && move[pos - 1] == '=';
         if (is_promotion) {
             char promotion_piece_char = is_promotion ? move[pos] : '-';
@@ -51,12 +51,12 @@ namespace {
         }
 
         // Destination: a3, b5, etc
-        auto destination_str =
+        std::string_view destination_str =
             is_short_castle ? (side == space::Color::White ? "g1" : "g8") :
             is_long_castle  ? (side == space::Color::White ? "c1" : "c8") :
             move.substr(pos - 1, 2);
         pos = (is_short_castle || is_long_castle) ? -1 : pos - 2;
-        auto destination = space::Position(destination_str);
+        auto destination = space::Position(destination_str[1] - '1', destination_str[0] - 'a');
 
         // Capture symbol: 'x'
         bool is_capture = !is_short_castle && !is_long_castle && pos >= 0 && move[pos] == 'x';
@@ -74,13 +74,13 @@ namespace {
         // Disambiguation: a, 4, a5
         // For pawn captures axb3, a is the disambiguation
         int start = isupper(move[0]) ? 1 : 0;
-        std::string disambiguation = (!is_short_castle && !is_long_castle && pos >= 0)
+        std::string_view disambiguation = (!is_short_castle && !is_long_castle && pos >= 0)
             ? move.substr(start, pos - start + 1)
-            : "";
+            : std::string_view();
 
         // Create the ply object.
         space::Ply ply;
-        ply.move = move;
+        ply.move.assign(move.data(), move.size());
         ply.color = side;
         ply.move_number = move_number;
         ply.is_check = is_check;
@@ -92,94 +92,268 @@ namespace {
         ply.piece = piece;
         ply.is_promotion = is_promotion;
         ply.promotion_piece = promotion_piece;
-        ply.disambiguation = disambiguation;
-        ply.annotation = annotation;
+        ply.disambiguation.assign(disambiguation.data(), disambiguation.size());
+        ply.annotation.assign(annotation.data(), annotation.size());
 
         return ply;
     }
 
-    std::vector<space::Ply> parse_moves(std::string movetext) {
-        std::vector<space::Ply> moves;
+    // Appends the plies of the movetext tokens to moves.
+    void parse_moves(const std::vector<std::string_view>& movetext, std::vector<space::Ply>& moves) {
         space::Color side = space::Color::White;
         int move_number = -1;
 
-        auto ss = std::stringstream(movetext);
-        std::string s;
-        while (!ss.eof()) {
-            ss >> s;
-            if (s == "{") {
-                char c = 0;
-                while (c != '}') ss >> c;
-                continue;
-            }
-
+        for (std::string_view s : movetext) {
             // Termination markers
             if (s == "0-1" || s == "1-0" || s == "1/2-1/2" || s == "*") break;
 
             // Is it a move number?
             if (isdigit(s[0]) && s[s.length() - 1] == '.') {
                 // White moves have single . at the end. Black moves have ...
-                side = (s[s.length() - 2] == '.' && s[s.length() - 3] == '.')
+                side = (s.length() >= 3 && s[s.length() - 2] == '.' && s[s.length() - 3] == '.')
                     ? space::Color::Black
                     : space::Color::White;
-                move_number = atoi(s.c_str());
+                move_number = 0;
+                for (std::size_t i = 0; i < s.length() && isdigit(s[i]); i++)
+                    move_number = move_number * 10 + (s[i] - '0');
                 continue;
             }
 
             // It is a move (There are more complex pgn constructs, but we ignore them.)
-            auto ply = parse_move(s, move_number, side);
-            moves.push_back(ply);
+            moves.push_back(parse_move(s, move_number, side));
 
             // Flip sides for next move in case the next ply doesn't have a move number.
             side = side == space::Color::White ? space::Color::Black : space::Color::White;
         }
+    }
+
+    bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    const char* const standard_starting_position = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+    bool is_blank_line(const std::string& line) { return line.find_first_not_of(" \t\r") == std::string::npos; }
+
+    // Reads the lines of one game of a stream into text: its tag pairs, then
+    // its movetext up to a blank line or the tags of the next game, left in
+    // line with pending set. False at the end of the input.
+    bool read_game_text(std::istream& input, std::string& line, bool& pending, std::string& text) {
+        text.clear();
+        bool read = pending || bool(std::getline(input, line));
+        pending = false;
+        while (read && is_blank_line(line)) read = bool(std::getline(input, line));
+        while (read && line[0] == '[') {
+            text += line;
+            text += '\n';
+            read = bool(std::getline(input, line));
+        }
+        if (!read) return false;
+
+        text += '\n';
+        do {
+            text += line;
+            text += '\n';
+        } while (std::getline(input, line) && !is_blank_line(line) && !(pending = line[0] == '['));
+        return true;
+    }
+
+    // Fills game from its tokens, reusing its storage. False for a game with
+    // a malformed tag pair.
+    bool to_game(const space::PGNTokenizer::GameTokens& tokens, space::Game& game) {
+        game.starting_position = space::Fen(standard_starting_position);
+        game.plies.clear();
+        game.metadata.clear();
+        if (tokens.malformed) return false;
+
+        for (const auto& tag : tokens.tags) {
+            std::string& value = game.metadata[std::string(tag.first)];
+            value.assign(tag.second.data(), tag.second.size());
+            if (tag.first == "FEN") game.starting_position = space::Fen(value);
+        }
+        parse_moves(tokens.movetext, game.plies);
+        return true;
+    }
 
-        return moves;
+    // visits the games of reader
+    std::size_t for_each_game_of(space::PGNReader& reader, const std::function<bool(const space::Game&)>& visit) {
+        space::Game game;
+        std::size_t count = 0;
+        while (reader.next(game)) {
+            count++;
+            if (!visit(game)) break;
+        }
+        return count;
     }
 }
 
 namespace space {
+    Game::Game() : starting_position(Fen(standard_starting_position)) {}
+
+    std::optional<double> Game::result() const {
+        auto it = metadata.find("Result");
+        if (it == metadata.end()) return std::nullopt;
+        if (it->second == "1-0") return 1.0;
+        if (it->second == "0-1") return 0.0;
+        if (it->second == "1/2-1/2") return 0.5;
+        return std::nullopt;
+    }
+
+    bool Game::replay(const std::function<void(const IBoard::Ptr&, const Move&)>& visit, int max_plies) const {
+        IBoard::Ptr board = BoardImpl::fromFen(starting_position);
+        for (std::size_t i = 0; i < plies.size() && (max_plies < 0 || int(i) < max_plies); i++) {
+            auto move = plies[i].to_move(board.get());
+            if (!move) return false;
+            auto next = board->updateBoard(move.value());
+            if (!next) return false;
+            visit(board, move.value());
+            board = next.value();
+        }
+        return true;
+    }
+
+    bool PGNTokenizer::next(GameTokens& game) {
+        game.tags.clear();
+        game.movetext.clear();
+        game.malformed = false;
+
+        std::size_t size = text.size();
+        auto line_end = [this, size](std::size_t from) {
+            std::size_t end = text.find('\n', from);
+            return end == std::string_view::npos ? size : end;
+        };
+        auto skip_blank_lines = [&]() {
+            while (pos < size) {
+                std::size_t end = line_end(pos);
+                std::size_t i = pos;
+                while (i < end && is_blank(text[i])) i++;
+                if (i != end) return;
+                pos = end + 1;
+            }
+        };
+
+        skip_blank_lines();
+        if (pos >= size) return false;
+
+        // Tag pairs: [Name "Value"]
+        while (pos < size && text[pos] == '[') {
+            std::size_t end = line_end(pos);
+            std::string_view line = text.substr(pos, end - pos);
+            pos = std::min(end + 1, size);
+            while (!line.empty() && is_blank(line.back())) line.remove_suffix(1);
+
+            std::size_t name_end = 1;
+            while (name_end < line.length() && !is_blank(line[name_end])) name_end++;
+            std::size_t quote = name_end;
+            while (quote < line.length() && is_blank(line[quote])) quote++;
+            if (line.length() < quote + 3 || line[quote] != '"' || line[line.length() - 1] != ']' || line[line.length() - 2] != '"') {
+                game.malformed = true; // read on to the movetext, to skip the whole game
+                continue;
+            }
+            game.tags.emplace_back(line.substr(1, name_end - 1), line.substr(quote + 1, line.length() - quote - 3));
+        }
+        skip_blank_lines();
+
+        // Movetext, up to a blank line or the tags of the next game. Comments,
+        // variations and numeric annotation glyphs are skipped.
+        while (pos < size) {
+            char c = text[pos];
+            if (c == '\n') {
+                pos++;
+                std::size_t i = pos;
+                while (i < size && is_blank(text[i])) i++;
+                if (i >= size || text[i] == '\n' || text[i] == '[') break;
+                continue;
+            }
+            if (is_blank(c)) {
+                pos++;
+            }
+            else if (c == '{') {
+                std::size_t end = text.find('}', pos);
+                pos = end == std::string_view::npos ? size : end + 1;
+            }
+            else if (c == ';') {
+                pos = line_end(pos);
+            }
+            else if (c == '(') {
+                int depth = 0;
+                for (; pos < size; pos++) {
+                    if (text[pos] == '{') {
+                        std::size_t end = text.find('}', pos);
+                        pos = end == std::string_view::npos ? size - 1 : end;
+                    }
+                    else if (text[pos] == '(') depth++;
+                    else if (text[pos] == ')' && --depth == 0) break;
+                }
+                pos = std::min(pos + 1, size);
+            }
+            else {
+                std::size_t start = pos;
+                while (pos < size && !is_blank(text[pos]) && text[pos] != '\n'
+                    && text[pos] != '{' && text[pos] != '(' && text[pos] != ';') pos++;
+                std::string_view token = text.substr(start, pos - start);
+
+                // A move number may run into its move: 12.e4, 12...e5
+                if (isdigit(token[0])) {
+                    std::size_t digits = 0;
+                    while (digits < token.length() && isdigit(token[digits])) digits++;
+                    std::size_t dots = digits;
+                    while (dots < token.length() && token[dots] == '.') dots++;
+                    if (dots > digits && dots < token.length()) {
+                        game.movetext.push_back(token.substr(0, dots));
+                        token.remove_prefix(dots);
+                    }
+                }
+                if (token[0] != '$') game.movetext.push_back(token);
+            }
+        }
+        return true;
+    }
+
     // For now, assume everything is well-formatted.
     // This is a poor parser.
     std::unique_ptr<Game> PGN::parse(std::istream& input) {
-        std::string line;
-        std::string starting_position = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
-        std::map<std::string, std::string> metadata;
-
-        while (std::getline(input, line) && line.length() != 0 && line[0] == '[') {
-            // We could avoid a couple of allocations, by directly reading from
-            // input. Can't be bothered.
-            auto ss = std::stringstream(line);
-
-            char c; ss >> c;
-            if (c != '[') return std::unique_ptr<Game>(nullptr); // Malformed?
-
-            std::string name, value;
-            ss >> name;
-
-            std::getline(ss, value);
-            if (value[0] != ' '
-             || value[1] != '"'
-             || value[value.length() - 1] != ']'
-             || value[value.length() - 2] != '"'
-            ) {
-                return std::unique_ptr<Game>(nullptr);
-            }
-            value = value.substr(2, value.length() - 4);
-            metadata[name] = value;
+        std::string line, text;
+        bool pending = false;
+        if (!read_game_text(input, line, pending, text)) return std::unique_ptr<Game>(nullptr);
+        PGNTokenizer tokenizer(text);
+        PGNTokenizer::GameTokens tokens;
+        auto game = std::make_unique<Game>();
+        if (!tokenizer.next(tokens) || !to_game(tokens, *game)) return std::unique_ptr<Game>(nullptr);
+        return game;
+    }
+
+    PGNReader::PGNReader(const std::string& path) :
+        file(path, MappedFile::Mode::Read),
+        tokenizer(std::string_view(file.data(), file.size())) {}
 
-            if (name == "FEN") starting_position = value;
+    bool PGNReader::next(Game& game) {
+        while (true) {
+            while (tokenizer.next(tokens)) {
+                if (to_game(tokens, game)) return true;
+            }
+            if (!input || !read_game_text(*input, line, pending, text)) return false;
+            tokenizer = PGNTokenizer(text);
         }
-        if (input.eof()) return std::unique_ptr<Game>(nullptr);
+    }
 
-        std::stringbuf movetext_buf;
-        while (std::getline(input, line) && line.length() != 0) {
-            movetext_buf.sputn(line.c_str(), line.length());
+    bool PGNReader::next_parsed(Game& game) {
+        while (true) {
+            try {
+                return next(game);
+            }
+            catch (const std::exception&) {
+                // the tokenizer is past the game already, go on with the next one
+            }
         }
-        auto movetext = movetext_buf.str();
-        auto moves = parse_moves(movetext);
+    }
+
+    std::size_t PGN::for_each_game(std::istream& input, const std::function<bool(const Game&)>& visit) {
+        PGNReader reader(input);
+        return for_each_game_of(reader, visit);
+    }
 
-        return std::make_unique<Game>(Fen(starting_position), moves, metadata);
+    std::size_t PGN::for_each_game(const std::string& path, const std::function<bool(const Game&)>& visit) {
+        PGNReader reader(path);
+        return for_each_game_of(reader, visit);
     }
 
     std::vector<Game> PGN::parse_all(std::istream& input) {
@@ -188,13 +362,10 @@ namespace space {
 
     std::vector<Game> PGN::parse_many(std::istream& input, int limit) {
         std::vector<Game> games;
-        while (!input.eof()) {
-            auto game = PGN::parse(input);
-            if (game) {
-                games.push_back(*game);
-                if (limit != 0 && games.size() == limit) break;
-            }
-        }
+        for_each_game(input, [&games, limit](const Game& game) {
+            games.push_back(game);
+            return limit == 0 || games.size() != std::size_t(limit);
+        });
         return games;
     }
 
@@ -2,7 +2,11 @@
 
 #include "board.h"
 #include "fen.h"
+#include <common/mappedFile.h>
+#include <functional>
 #include <iostream>
+#include <string_view>
+#include <utility>
 
 namespace space {
 	struct Ply {
@@ -53,14 +57,76 @@ namespace space {
 
 		std::map<std::string, std::string> metadata;
 
+		Game(); // the standard starting position, no plies
+
 		Game(Fen _fen, std::vector<Ply> _plies, std::map<std::string, std::string> _metadata) :
 			starting_position(_fen), plies(_plies), metadata(_metadata) {}
+
+		// Points of White by the Result tag: 1, 0.5 or 0; none when unfinished.
+		std::optional<double> result() const;
+
+		// Plays the plies from the starting position, calling visit with the
+		// position before each of the first max_plies (all when negative) and
+		// its move. False when a ply is not a legal move there.
+		bool replay(const std::function<void(const IBoard::Ptr&, const Move&)>& visit, int max_plies = -1) const;
+	};
+
+	// Splits PGN text into the tag pairs and movetext tokens of each game, as
+	// views into the text: nothing is copied, and nothing allocated once the
+	// vectors of GameTokens have grown. Comments, variations and numeric
+	// annotation glyphs are dropped; a move number written into its move
+	// (12.e4) is split from it.
+	class PGNTokenizer {
+	public:
+		struct GameTokens {
+			std::vector<std::pair<std::string_view, std::string_view>> tags; // name, value
+			std::vector<std::string_view> movetext; // move numbers, moves and the result
+			bool malformed = false; // a tag pair did not parse
+		};
+
+		PGNTokenizer() {}
+		explicit PGNTokenizer(std::string_view _text) : text(_text) {}
+
+		// The next game; false at the end of the text.
+		bool next(GameTokens& game);
+
+	private:
+		std::string_view text;
+		std::size_t pos = 0;
+	};
+
+	// Reads games one at a time into the same Game, so memory stays that of the
+	// longest game however large the input. A file is mapped into memory and
+	// tokenized in place; a stream is read a game at a time.
+	class PGNReader {
+	public:
+		explicit PGNReader(std::istream& _input) : input(&_input) {}
+		explicit PGNReader(const std::string& path);
+
+		// False at the end of the input; a game with a malformed tag pair is skipped.
+		bool next(Game& game);
+		// As next, also skipping a game whose movetext does not parse.
+		bool next_parsed(Game& game);
+
+	private:
+		std::istream* input = nullptr;
+		MappedFile file;
+		PGNTokenizer tokenizer;
+		PGNTokenizer::GameTokens tokens;
+		std::string line;
+		bool pending = false; // line starts the next game of a stream
+		std::string text;     // of the current game of a stream
 	};
 
 	class PGN {
 	public:
 		static std::unique_ptr<Game> parse(std::istream& input);
 
+		// Calls visit with each game until it returns false; returns the games visited.
+		static std::size_t for_each_game(std::istream& input, const std::function<bool(const Game&)>& visit);
+		static std::size_t for_each_game(const std::string& path, const std::function<bool(const Game&)>& visit);
+
+		// All the games at once; for_each_game keeps memory bounded.
 		static std::vector<Game> parse_all(std::istream& input);
 
 		static std::vector<Game> parse_many(std::istream& input, int limit);
@@ -0,0 +1,57 @@
+#include "zobrist.h"
+
+#include <array>
+
+namespace {
+
+	// splitmix64, fixed seed so hashes are stable across runs
+	std::uint64_t nextRandom(std::uint64_t& seed)
+	{
+		std::uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return z ^ (z >> 31);
+	}
+
+	struct ZobristKeys {
+		std::array<std::uint64_t, 2 * 6 * 64> pieces;
+		std::array<std::uint64_t, 4> castling;
+		std::array<std::uint64_t, 8> enPassant;
+		std::uint64_t blackToMove;
+
+		ZobristKeys() {
+			std::uint64_t seed = 0x5EACE5EACEULL;
+			for (auto& k : pieces) k = nextRandom(seed);
+			for (auto& k : castling) k = nextRandom(seed);
+			for (auto& k : enPassant) k = nextRandom(seed);
+			blackToMove = nextRandom(seed);
+		}
+	};
+
+	const ZobristKeys& getKeys()
+	{
+		static const ZobristKeys keys;
+		return keys;
+	}
+
+	inline int colorIndex(space::Color color) { return color == space::Color::White ? 0 : 1; }
+
+} // end anonymous namespace
+
+
+namespace space {
+
+	std::uint64_t Zobrist::pieceKey(Piece piece, int rank, int file)
+	{
+		if (piece.pieceType == PieceType::None)
+			return 0;
+		int index = (colorIndex(piece.color) * 6 + static_cast<int>(piece.pieceType)) * 64 + rank * 8 + file;
+		return getKeys().pieces[index];
+	}
+
+	std::uint64_t Zobrist::castleLeftKey(Color color) { return getKeys().castling[colorIndex(color) * 2]; }
+	std::uint64_t Zobrist::castleRightKey(Color color) { return getKeys().castling[colorIndex(color) * 2 + 1]; }
+	std::uint64_t Zobrist::blackToMoveKey() { return getKeys().blackToMove; }
+	std::uint64_t Zobrist::enPassantKey(int file) { return getKeys().enPassant[file]; }
+
+} // end namespace space
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "board.h"
+
+#include <cstdint>
+
+namespace space {
+
+	// Fixed pseudo-random keys for Zobrist hashing of positions.
+	// A position hash is the xor of the keys of everything on the board,
+	// so a move can update it by xor-ing out old keys and xor-ing in new ones.
+	class Zobrist {
+	public:
+		static std::uint64_t pieceKey(Piece piece, int rank, int file);
+		static std::uint64_t castleLeftKey(Color color);
+		static std::uint64_t castleRightKey(Color color);
+		static std::uint64_t blackToMoveKey();
+		static std::uint64_t enPassantKey(int file);
+	};
+
+} // end namespace space
@@ -3,6 +3,9 @@
 #include "test_positions.h"
 
 #include <chess/board_impl.h>
+#include <cmath>
+#include <fstream>
+#include <set>
 
 #include <algo_linear/algo_dumbo.h>
 #include <algo_linear/algo_dumbo_impl.h>
@@ -72,6 +75,33 @@ TEST(AlgoDumboSuite, StateBoardConversionTest)
 	}
 }
 
+TEST(AlgoDumboSuite, PackedStateTest)
+{
+	using namespace algo_dumbo_impl;
+	space::BoardImpl decoded;
+	for (auto tp: space::getAllTestPositions())
+	{
+		auto board = space::BoardImpl::fromFen(tp->position);
+		auto state = boardToState(*board);
+		ASSERT_EQ(unpack(pack(state)), state);
+
+		// decoding in place gives the board of the allocating decode, en passant aside
+		stateToBoard(state, decoded);
+		auto allocated = stateToBoard(state);
+		ASSERT_EQ(decoded.getHash(), allocated->getHash());
+		ASSERT_EQ(decoded.getPawnHash(), board->getPawnHash());
+		ASSERT_EQ(boardToState(decoded), state);
+		ASSERT_EQ(getSideToMove(state), board->whoPlaysNext());
+	}
+
+	// a white pawn on e2 is nibble 4 of word 0, a black king on e8 nibble 12 of word 3
+	auto packed = pack(boardToState(*space::BoardImpl::getStartingBoard()));
+	ASSERT_EQ((packed.squares[0] >> (4 * 12)) & 15, std::uint64_t(space::PieceType::Pawn));
+	ASSERT_EQ((packed.squares[3] >> (4 * 12)) & 15, std::uint64_t(space::PieceType::King) | 8);
+	ASSERT_EQ(packed.flags, unsigned(PackedState::castling));
+}
+
+
 TEST(AlgoDumboSuite, StateOperationsTest)
 {
 	using namespace algo_dumbo_impl;
@@ -136,6 +166,41 @@ TEST(AlgoDumboSuite, StateOperationsTest)
 }
 
 
+TEST(AlgoDumboSuite, StateScoresGrowthTest)
+{
+	using namespace algo_dumbo_impl;
+	using namespace space;
+
+	// every position three plies from the start, with transpositions; enough to grow the table
+	std::vector<State> states;
+	auto startingBoard = BoardImpl::getStartingBoard();
+	for (const auto& first : startingBoard->getValidMoves())
+		for (const auto& second : first.second->getValidMoves())
+			for (const auto& third : second.second->getValidMoves())
+				states.push_back(boardToState(*third.second));
+	std::set<State, StateCompare> unique(states.begin(), states.end());
+
+	StateScores scores;
+	StateSet stateSet;
+	for (const auto& state : states)
+		addState(scores, stateSet, state, 2);
+	ASSERT_EQ(getNumUniqueStates(scores), unique.size());
+	ASSERT_EQ(stateSet.size(), unique.size());
+
+	// handles taken while the table grew still point at their states
+	int i = 0;
+	forEachState(stateSet, [&i](StateHandle sh) { setScore(sh, 2, i++); });
+	i = 0;
+	for (auto sh : stateSet) {
+		ASSERT_EQ(scores.find(getState(sh)), sh.index);
+		ASSERT_DOUBLE_EQ(getScore(scores, getState(sh), 2), i++);
+		ASSERT_TRUE(std::isnan(getScore(sh, 0)));
+	}
+	ASSERT_EQ(scores.find(boardToState(*startingBoard)), StateScores::npos);
+	ASSERT_THROW(addState(scores, boardToState(*startingBoard), 3), std::runtime_error);
+}
+
+
 TEST(AlgoDumboSuite, StateHandleCompareTest)
 {
 	using namespace algo_dumbo_impl;
@@ -258,7 +323,8 @@ TEST(AlgoDumboSuite, ExploreStatesTest)
 	StateScores stateScores;
 	StateSet stateSet;
 	addState(stateScores, stateSet, state, config.maxDepth);
-	exploreStates(stateScores, stateSet, 0, space::Color::Black, config);
+	auto stats = exploreStates(stateScores, stateSet, 0, space::Color::Black, config);
+	ASSERT_GT(stats.evaluations, 0);
 	auto comparator = getComparatorForColor(space::Color::Black);
 	auto validMoves = board->getValidMoves();
 	auto bestMove = validMoves.begin()->first;
@@ -286,4 +352,210 @@ TEST(AlgoDumboSuite, ExploreStatesTest)
 	ASSERT_EQ(bestMove.destinationRank, 1);
 	ASSERT_EQ(bestMove.destinationFile, 4);
 	ASSERT_EQ(bestMove.promotedPiece, space::PieceType::None);
+
+	// the expansion recorded one edge per move, to the states scored at depth 1
+	auto root = stateScores.find(state);
+	ASSERT_EQ(stateScores.numChildren(root), validMoves.size());
+	for (std::uint32_t i = 0; i < stateScores.numChildren(root); ++i)
+		ASSERT_FALSE(std::isnan(stateScores.score(stateScores.child(root, i), 1)));
+
+	// the same search again scores the same states, mostly from the shared eval cache
+	StateScores againScores;
+	StateSet againSet;
+	addState(againScores, againSet, state, config.maxDepth);
+	auto again = exploreStates(againScores, againSet, 0, space::Color::Black, config);
+	ASSERT_EQ(again.evaluations, stats.evaluations);
+	ASSERT_GT(again.evalCacheHits, again.evaluations / 2);
+	ASSERT_GE(again.evalSecondsSaved, 0);
+}
+
+TEST(AlgoDumboSuite, ParallelExploreStatesTest)
+{
+	using namespace algo_dumbo_impl;
+	auto board = space::BoardImpl::fromFen(space::Fen("6k1/5ppp/8/8/5n2/2Q5/5PPP/6K1 b - - 20 20"));
+	auto state = boardToState(*board);
+
+	// the same states in the same order, so the same scores, whatever the number of threads;
+	// also when config.maxNumStates stops the expansion part way through a level
+	auto explore = [&state](space::AlgoDumboConfig config, int threads, StateScores& scores)
+	{
+		StateSet stateSet;
+		addState(scores, stateSet, state, config.maxDepth);
+		config.threads = threads;
+		exploreStates(scores, stateSet, 0, space::Color::Black, config);
+	};
+	space::AlgoDumboConfig config;
+	config.maxDepth = 3;
+	std::size_t unlimitedStates = 0;
+	for (int maxNumStates : { config.maxNumStates, 3000 })
+	{
+		config.maxNumStates = maxNumStates;
+		StateScores serialScores, parallelScores;
+		explore(config, 1, serialScores);
+		explore(config, 4, parallelScores);
+
+		ASSERT_EQ(getNumUniqueStates(parallelScores), getNumUniqueStates(serialScores));
+		for (std::uint32_t i = 0; i < getNumUniqueStates(serialScores); ++i)
+		{
+			ASSERT_EQ(parallelScores.getState(i), serialScores.getState(i));
+			for (int depth = 0; depth <= config.maxDepth; ++depth)
+			{
+				double serial = serialScores.score(i, depth), parallel = parallelScores.score(i, depth);
+				ASSERT_TRUE(std::isnan(serial) ? std::isnan(parallel) : serial == parallel);
+			}
+		}
+		if (unlimitedStates == 0)
+			unlimitedStates = getNumUniqueStates(serialScores);
+		else
+			ASSERT_LT(getNumUniqueStates(serialScores), unlimitedStates); // the cutoff was reached
+	}
+}
+
+TEST(AlgoDumboSuite, CanonicalStateTest)
+{
+	using namespace algo_dumbo_impl;
+
+	// the color-flipped starting position is the starting position with Black to move
+	auto start = boardToState(*space::BoardImpl::getStartingBoard());
+	auto startBlack = boardToState(*space::BoardImpl::fromFen(space::Fen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR b KQkq - 0 1")));
+	ASSERT_EQ(transformState(start, true, false), startBlack);
+	auto castling = boardToState(*space::BoardImpl::fromFen(space::Fen("r3k3/8/8/8/8/8/8/4K2R w Kq - 0 1")));
+	auto castlingFlipped = boardToState(*space::BoardImpl::fromFen(space::Fen("4k2r/8/8/8/8/8/8/R3K3 b Qk - 0 1")));
+	ASSERT_EQ(transformState(castling, true, false), castlingFlipped);
+	for (bool flip : { false, true })
+		for (bool mirror : { false, true })
+			ASSERT_EQ(transformState(transformState(castling, flip, mirror), flip, mirror), castling);
+
+	// all mirror images share one canonical state; without castling rights files may be mirrored too
+	auto endgame = boardToState(*space::BoardImpl::fromFen(space::Fen("8/8/3k4/8/1p6/8/2PK4/8 w - - 0 1")));
+	auto canonical = canonicalize(endgame);
+	for (bool flip : { false, true })
+		for (bool mirror : { false, true })
+		{
+			auto image = canonicalize(transformState(endgame, flip, mirror));
+			ASSERT_EQ(image.state, canonical.state);
+			ASSERT_EQ(image.flipped != flip, canonical.flipped);
+		}
+	ASSERT_EQ(canonicalize(castling).state, std::min(castling, castlingFlipped, StateCompare()));
+}
+
+TEST(AlgoDumboSuite, CanonicalExploreStatesTest)
+{
+	using namespace algo_dumbo_impl;
+	auto board = space::BoardImpl::fromFen(space::Fen("4k3/8/8/8/8/8/8/3K4 w - - 0 1"));
+	auto state = boardToState(*board);
+	space::AlgoDumboConfig config;
+	config.maxDepth = 3;
+
+	// the same score from fewer states: Kd1-e2 Ke8-d7 and Kd1-d2 Ke8-e7 are mirror images
+	StateScores literalScores, canonicalScores;
+	StateSet literalSet, canonicalSet;
+	addState(literalScores, literalSet, state, config.maxDepth);
+	addState(canonicalScores, canonicalSet, state, config.maxDepth);
+	exploreStates(literalScores, literalSet, 0, space::Color::White, config);
+	config.canonicalize = true;
+	exploreStates(canonicalScores, canonicalSet, 0, space::Color::White, config);
+
+	ASSERT_LT(getNumUniqueStates(canonicalScores), getNumUniqueStates(literalScores));
+	ASSERT_NEAR(getScore(canonicalScores, state, 0), getScore(literalScores, state, 0), 1e-9);
+}
+
+TEST(AlgoDumboSuite, SpilledStateScoresTest)
+{
+	using namespace algo_dumbo_impl;
+	auto board = space::BoardImpl::fromFen(space::Fen("6k1/5ppp/8/8/5n2/2Q5/5PPP/6K1 b - - 20 20"));
+	auto state = boardToState(*board);
+	space::AlgoDumboConfig config;
+	config.maxDepth = 3;
+	const std::string spillPath = "algo_dumbo_spill_test";
+
+	{
+		// the same states and scores from the store in memory and the one mapped to files
+		StateScores memoryScores, spilledScores(spillPath);
+		ASSERT_FALSE(memoryScores.isSpilled());
+		ASSERT_TRUE(spilledScores.isSpilled());
+		StateSet memorySet, spilledSet;
+		addState(memoryScores, memorySet, state, config.maxDepth);
+		addState(spilledScores, spilledSet, state, config.maxDepth);
+		exploreStates(memoryScores, memorySet, 0, space::Color::Black, config);
+		exploreStates(spilledScores, spilledSet, 0, space::Color::Black, config);
+		ASSERT_TRUE(std::ifstream(spillPath + ".states").good());
+
+		ASSERT_EQ(getNumUniqueStates(spilledScores), getNumUniqueStates(memoryScores));
+		for (std::uint32_t i = 0; i < getNumUniqueStates(memoryScores); ++i)
+		{
+			ASSERT_EQ(spilledScores.getState(i), memoryScores.getState(i));
+			ASSERT_EQ(spilledScores.find(memoryScores.getState(i)), i);
+			ASSERT_EQ(spilledScores.numChildren(i), memoryScores.numChildren(i));
+			for (int depth = 0; depth <= config.maxDepth; ++depth)
+			{
+				double memory = memoryScores.score(i, depth), spilled = spilledScores.score(i, depth);
+				ASSERT_TRUE(std::isnan(memory) ? std::isnan(spilled) : memory == spilled);
+			}
+		}
+	}
+
+	// scratch files go with the store
+	for (const char* suffix : { ".states", ".scores", ".ranges", ".edges", ".slots" })
+		ASSERT_FALSE(std::ifstream(spillPath + suffix).good()) << suffix;
+}
+
+TEST(AlgoDumboSuite, CheckpointResumeTest)
+{
+	using namespace algo_dumbo_impl;
+	auto board = space::BoardImpl::fromFen(space::Fen("6k1/5ppp/8/8/5n2/2Q5/5PPP/6K1 b - - 20 20"));
+	auto state = boardToState(*board);
+	space::AlgoDumboConfig config;
+	config.maxDepth = 3;
+	const std::string path = "algo_dumbo_checkpoint_test.bin";
+
+	StateScores fullScores;
+	StateSet fullSet;
+	addState(fullScores, fullSet, state, config.maxDepth);
+	exploreStates(fullScores, fullSet, 0, space::Color::Black, config);
+
+	// preempted after each snapshot in turn, then resumed from that snapshot
+	int snapshots = 0;
+	for (int preemptAt = 1; ; ++preemptAt)
+	{
+		Checkpoint checkpoint;
+		checkpoint.path = path;
+		checkpoint.key = 42;
+		int saved = 0;
+		checkpoint.onSaved = [&saved, preemptAt](int) { if (++saved == preemptAt) throw std::runtime_error("preempted"); };
+		StateScores interruptedScores;
+		StateSet interruptedSet;
+		addState(interruptedScores, interruptedSet, state, config.maxDepth);
+		try
+		{
+			exploreStates(interruptedScores, interruptedSet, 0, space::Color::Black, config, &checkpoint);
+			break;
+		}
+		catch (const std::runtime_error&)
+		{
+			++snapshots;
+		}
+
+		ASSERT_FALSE(StateScores().load(path, 43));
+		StateScores resumedScores;
+		StateSet resumedSet;
+		ASSERT_TRUE(resumedScores.load(path, 42));
+		addState(resumedScores, resumedSet, state, config.maxDepth);
+		exploreStates(resumedScores, resumedSet, 0, space::Color::Black, config);
+
+		ASSERT_EQ(getNumUniqueStates(resumedScores), getNumUniqueStates(fullScores));
+		for (std::uint32_t i = 0; i < getNumUniqueStates(fullScores); ++i)
+		{
+			ASSERT_EQ(resumedScores.getState(i), fullScores.getState(i));
+			ASSERT_EQ(resumedScores.numChildren(i), fullScores.numChildren(i));
+			for (int depth = 0; depth <= config.maxDepth; ++depth)
+			{
+				double full = fullScores.score(i, depth), resumed = resumedScores.score(i, depth);
+				ASSERT_TRUE(std::isnan(full) ? std::isnan(resumed) : full == resumed);
+			}
+		}
+	}
+	// each level on the way down but the last, and on the way up
+	ASSERT_EQ(snapshots, 2 * config.maxDepth);
+	std::remove(path.c_str());
 }
@@ -8,11 +8,22 @@
 #include <chess/pgn.h>
 #include <algo_linear/algoLinear.h>
 #include <algo_linear/algoGeneric.h>
+#include <algo_linear/algoInterval.h>
+#include <algo_linear/algoMcts.h>
+#include <algo_linear/mateSolver.h>
+#include <algo_linear/linearKernel.h>
+#include <algo_linear/evalCache.h>
+#include <algo_linear/nnue.h>
+#include <algo_linear/texelTuner.h>
+#include <algo_linear/tablebase.h>
+#include <algo_linear/openingBook.h>
+#include <chess/algo_factory.h>
 
 #include <fstream>
 #include <filesystem>
 #include <algo_linear/algo_dumbo.h>
 #include <sstream>
+#include <random>
 
 namespace test_utils {
 	void validate_ply(space::Ply ply) {
@@ -79,6 +90,8 @@ TEST(BoardSuite, StartingBoardTest) {
 	std::string expectedStartingFen = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
 	ASSERT_EQ(startingFen.fen, expectedStartingFen);
 	ASSERT_EQ(Fen::fromBoard(BoardImpl::fromFen(startingFen), 0, 1).fen, expectedStartingFen);
+	std::string someRightsFen = "r3k3/8/8/8/8/8/8/4K2R w Kq - 0 1";
+	ASSERT_EQ(Fen::fromBoard(BoardImpl::fromFen(someRightsFen), 0, 1).fen, someRightsFen);
 }
 
 
@@ -252,6 +265,190 @@ TEST(BoardSuite, CastlingFlagUpdate) {
 	ASSERT_FALSE(newBoard.value()->canCastleRight(Color::White));
 }
 
+TEST(BoardSuite, PositionHashTest) {
+	using namespace space;
+
+	// same position through two move orders: Nf3 Nf6 Nc3 / Nc3 Nf6 Nf3
+	auto start = BoardImpl::getStartingBoard();
+	auto b1 = start
+		->updateBoard({ 0, 6, 2, 5 }).value()
+		->updateBoard({ 7, 6, 5, 5 }).value()
+		->updateBoard({ 0, 1, 2, 2 }).value();
+	auto b2 = start
+		->updateBoard({ 0, 1, 2, 2 }).value()
+		->updateBoard({ 7, 6, 5, 5 }).value()
+		->updateBoard({ 0, 6, 2, 5 }).value();
+	ASSERT_EQ(b1->getHash(), b2->getHash());
+	ASSERT_EQ(b1->getHash(), BoardImpl::fromFen(Fen::fromBoard(b1, 0, 1))->getHash());
+	ASSERT_NE(b1->getHash(), start->getHash());
+
+	// side to move, castling rights and en passant square are part of the hash
+	auto white = BoardImpl::fromFen(Fen("4k3/8/8/8/8/8/8/R3K3 w Q - 0 1"));
+	auto black = BoardImpl::fromFen(Fen("4k3/8/8/8/8/8/8/R3K3 b Q - 0 1"));
+	auto noCastle = BoardImpl::fromFen(Fen("4k3/8/8/8/8/8/8/R3K3 w - - 0 1"));
+	ASSERT_NE(white->getHash(), black->getHash());
+	ASSERT_NE(white->getHash(), noCastle->getHash());
+	auto e4 = start->updateBoard({ 1, 4, 3, 4 }).value();
+	auto e4NoEnPassant = BoardImpl::fromFen(Fen("rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq - 0 1"));
+	ASSERT_NE(e4->getHash(), e4NoEnPassant->getHash());
+}
+
+TEST(BoardSuite, IncrementalStateTest) {
+	using namespace space;
+
+	// castling, promotion and en passant all come up in these lines
+	std::vector<IBoard::Ptr> starts = {
+		BoardImpl::getStartingBoard(),
+		BoardImpl::fromFen(Fen("r3k2r/1P4pp/8/3pP3/8/8/6PP/R3K2R w KQkq d6 0 1")),
+	};
+	for (auto board : starts) {
+		for (int ply = 0; ply < 80; ply++) {
+			// recompute everything from the pieces
+			std::array<std::array<Piece, 8>, 8> pieces;
+			int counts[2][7] = {};
+			std::uint8_t pawnRanks[2][8] = {};
+			for (int rank = 0; rank < 8; rank++)
+				for (int file = 0; file < 8; file++) {
+					auto p = board->getPiece({ rank, file });
+					pieces[rank][file] = p.value_or(Piece(PieceType::None, Color::White));
+					if (!p.has_value())
+						continue;
+					++counts[int(p->color)][int(p->pieceType)];
+					if (p->pieceType == PieceType::Pawn)
+						pawnRanks[int(p->color)][file] |= std::uint8_t(1u << rank);
+				}
+			BoardImpl scratch(pieces,
+				board->canCastleLeft(Color::White), board->canCastleRight(Color::White),
+				board->canCastleLeft(Color::Black), board->canCastleRight(Color::Black),
+				board->whoPlaysNext());
+			scratch.enPassantSquare = board->enPassantSquare;
+			ASSERT_EQ(board->getHash(), scratch.getHash());
+			ASSERT_EQ(board->getPawnHash(), scratch.getPawnHash());
+			for (Color color : { Color::White, Color::Black }) {
+				for (int t = 0; t < 6; t++)
+					ASSERT_EQ(board->getPieceCount(color, PieceType(t)), counts[int(color)][t]);
+				for (int file = 0; file < 8; file++)
+					ASSERT_EQ(board->getPawnRanks(color, file), pawnRanks[int(color)][file]);
+			}
+
+			auto moves = board->getValidMoves();
+			if (moves.empty())
+				break;
+			auto it = moves.begin();
+			std::advance(it, (ply * 7) % moves.size());
+			board = it->second;
+		}
+	}
+}
+
+TEST(BoardSuite, CountLegalMovesTest) {
+	using namespace space;
+
+	// pins, checks, castling through attacked squares, en passant and promotions,
+	// and every position one move away from them
+	std::vector<IBoard::Ptr> positions;
+	for (const char* fen : {
+			"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+			"r3k2r/1P4pp/8/3pP3/8/8/6PP/R3K2R w KQkq d6 0 1",
+			"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+			"4k3/8/8/8/1b6/8/3P4/4K2R w K - 0 1",
+			"kbK5/pp6/1P6/8/8/8/8/R7 w - - 0 1" }) {
+		auto board = BoardImpl::fromFen(Fen(fen));
+		positions.push_back(board);
+		for (const auto& mb : board->getValidMoves())
+			positions.push_back(mb.second);
+	}
+	for (const auto& board : positions) {
+		int legal = int(board->getValidMoves().size());
+		ASSERT_EQ(board->countLegalMoves(), legal) << board->as_string();
+		ASSERT_GE(board->countPseudoLegalMoves(board->whoPlaysNext()), legal);
+		ASSERT_EQ(board->isCheckMate(), legal == 0 && board->isUnderCheck(board->whoPlaysNext()));
+		ASSERT_EQ(board->isStaleMate(), legal == 0 && !board->isUnderCheck(board->whoPlaysNext()));
+
+		// every move of a piece of the side to move is valid exactly when getValidMoves has it
+		auto valid = board->getValidMoves();
+		for (int source = 0; source < 64; source++) {
+			auto piece = board->getPiece({ source / 8, source % 8 });
+			if (!piece || piece->pieceType == PieceType::None || piece->color != board->whoPlaysNext())
+				continue;
+			for (int destination = 0; destination < 64; destination++)
+				for (PieceType promotion : { PieceType::None, PieceType::Queen, PieceType::Knight }) {
+					Move move(source / 8, source % 8, destination / 8, destination % 8, promotion);
+					ASSERT_EQ(board->isValidMove(move), valid.count(move) == 1) << board->as_string() << move.toString();
+				}
+		}
+	}
+
+	auto start = BoardImpl::getStartingBoard();
+	ASSERT_EQ(start->countLegalMoves(), 20);
+	ASSERT_EQ(start->countPseudoLegalMoves(Color::Black), 20);
+	ASSERT_EQ(Feature_Mobility().getValue(start, Color::White), 20);
+}
+
+TEST(BoardSuite, AttackMapTest) {
+	using namespace space;
+
+	// a square is attacked by a color exactly when a king of the other color would be in check there
+	for (const char* fen : {
+			"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+			"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1" }) {
+		auto board = BoardImpl::fromFen(Fen(fen));
+		for (const auto& mb : board->getValidMoves()) {
+			const auto& child = mb.second;
+			for (int rank = 0; rank < 8; ++rank)
+				for (int file = 0; file < 8; ++file)
+					for (Color color : { Color::White, Color::Black }) {
+						Color other = color == Color::White ? Color::Black : Color::White;
+						bool attacked = child->getAttackers(Position(rank, file), other) != 0;
+						ASSERT_EQ(attacked, child->isUnderCheck(color, Position(rank, file))) << child->as_string();
+						ASSERT_EQ(attacked, ((child->getAttackedSquares(other) >> (rank * 8 + file)) & 1) != 0);
+					}
+		}
+	}
+
+	auto start = BoardImpl::getStartingBoard();
+	std::uint64_t f3 = start->getAttackers(Position("f3"), Color::White);
+	ASSERT_EQ(f3, (std::uint64_t(1) << 6) | (std::uint64_t(1) << 12) | (std::uint64_t(1) << 14)); // g1, e2, g2
+	ASSERT_EQ(start->getAttackers(Position("f3"), Color::Black), 0u);
+
+	// the knight on e5 is attacked by the d6 pawn and defended by nothing; the e4 pawn is defended by the d3 bishop
+	auto board = BoardImpl::fromFen(Fen("4k3/8/3p4/4N3/4P3/3B4/8/4K3 w - - 0 1"));
+	ASSERT_TRUE(board->isHanging(Position("e5")));
+	ASSERT_FALSE(board->isHanging(Position("e4")));
+	ASSERT_FALSE(board->isHanging(Position("a1")));
+	ASSERT_EQ(Feature_HangingPieces().getValue(board, Color::White), 1);
+	ASSERT_EQ(Feature_HangingPieces().getValue(board, Color::Black), 0);
+	ASSERT_EQ(Feature_KingZoneAttacks().getValue(board, Color::Black), 2); // d7 and f7, by the knight
+	ASSERT_EQ(Feature_KingZoneAttacks().getValue(start, Color::White), 0);
+}
+
+TEST(BoardSuite, SharedBoardThreadsTest) {
+	using namespace space;
+
+	// threads publish the attack maps of one board while others count its legal
+	// moves on scratch copies; every answer is that of an unshared board
+	const char* fen = "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1";
+	auto reference = BoardImpl::fromFen(Fen(fen));
+	std::uint64_t attacked = reference->getAttackedSquares(Color::Black);
+	int legal = reference->countLegalMoves();
+	Move castle(0, 4, 0, 6);
+	bool castleValid = reference->isValidMove(castle);
+
+	for (int round = 0; round < 20; round++) {
+		auto shared = BoardImpl::fromFen(Fen(fen)); // maps not computed yet
+		std::vector<int> mismatches(4, 0);
+		parallel_for(4, 4, [&](int thread, std::size_t, std::size_t) {
+			for (int i = 0; i < 50; i++) {
+				if (thread % 2 == 0 && shared->getAttackedSquares(Color::Black) != attacked)
+					++mismatches[thread];
+				if (shared->countLegalMoves() != legal || shared->isValidMove(castle) != castleValid)
+					++mismatches[thread];
+			}
+		});
+		ASSERT_EQ(mismatches, std::vector<int>(4, 0));
+	}
+}
+
 TEST(AlgoSuite, AlgoLinearTest) {
 	std::vector<double> wts01 = {1, 5, 4, 4, 10};
 	using namespace space;
@@ -272,6 +469,170 @@ TEST(AlgoSuite, AlgoLinearTest) {
 }
 
 
+TEST(AlgoSuite, AlgoLinearBeamTest) {
+	std::vector<double> wts01 = {1, 5, 4, 4, 10};
+	using namespace space;
+
+	auto b0 = BoardImpl::fromFen(Fen("1n1qk1nr/8/8/4NP2/3P4/1pP3Pp/rB5P/3Q1RKB w - - 0 0"));
+	auto b1 = b0->updateBoard(AlgoLinearDepthTwoExt(5, wts01).getNextMove(b0)).value();
+
+	// a single beam is the depth two search
+	for (auto board : { b0, b1 }) {
+		Move expected = AlgoLinearDepthTwoExt(5, wts01).getNextMove(board);
+		ASSERT_EQ(AlgoLinearBeam({ 5 }, wts01, false).getNextMove(board).toString(), expected.toString());
+		ASSERT_EQ(AlgoLinearBeam({ 5 }, wts01, true).getNextMove(board).toString(), expected.toString());
+	}
+
+	// cutting beams changes the work, not the move
+	auto full = AlgoLinearBeam({ 6, 4, 3 }, wts01, false);
+	auto cut = AlgoLinearBeam({ 6, 4, 3 }, wts01, true);
+	for (auto board : { b0, b1 }) {
+		ASSERT_EQ(cut.getNextMove(board).toString(), full.getNextMove(board).toString());
+		ASSERT_LT(cut.getNumScored(), full.getNumScored());
+	}
+}
+
+TEST(AlgoSuite, FeatureScanTest) {
+	using namespace space;
+
+	auto board = BoardImpl::fromFen(Fen("4k3/8/3p4/8/1P2P3/8/P7/4K3 w - - 0 1"));
+	BoardScan scan(board);
+	ASSERT_EQ(scan.count(Color::White, PieceType::Pawn), 3);
+	ASSERT_EQ(scan.numPieces, 6);
+
+	// d6 stops e4, nothing stops a2 and b4, e4 stops d6
+	ASSERT_EQ(Feature_PassedPawn().getValue(scan, Color::White), 2);
+	ASSERT_EQ(Feature_PassedPawn().getValue(scan, Color::Black), 0);
+	ASSERT_EQ(Feature_PawnRank(4).getValue(scan, Color::White), 3);
+	ASSERT_EQ(Feature_PawnRank(3).getValue(scan, Color::Black), 2);
+
+	// one scan and a dot product give the per-feature sum
+	auto wts = AlgoGeneric::getDefaultWeights();
+	wts[std::make_shared<Feature_PassedPawn>()] = 0.5;
+	double expected = 0;
+	for (const auto& v : wts)
+		expected += (v.first->getValue(board, Color::White) - v.first->getValue(board, Color::Black)) * v.second;
+	ASSERT_NEAR(LinearEvaluator(wts).evaluate(board), expected, 1e-9);
+}
+
+TEST(AlgoSuite, PawnTableTest) {
+	using namespace space;
+
+	// White: doubled and isolated c-pawns, a passed h-pawn. Black: isolated a-pawn
+	auto board = BoardImpl::fromFen(Fen("4k3/p7/8/7P/2P5/2P5/8/4K3 w - - 0 1"));
+	BoardScan scan(board);
+	ASSERT_EQ(Feature_DoubledPawn().getValue(scan, Color::White), 1);
+	ASSERT_EQ(Feature_IsolatedPawn().getValue(scan, Color::White), 3);
+	ASSERT_EQ(Feature_IsolatedPawn().getValue(scan, Color::Black), 1);
+	ASSERT_EQ(Feature_PassedPawn().getValue(scan, Color::White), 3);
+	ASSERT_EQ(Feature_DoubledPawn().getValue(scan, Color::Black), 0);
+
+	// king moves keep the pawn key, so the structure comes from the table
+	auto kingMove = board->updateBoard({ 0, 4, 0, 3 }).value();
+	ASSERT_EQ(kingMove->getPawnHash(), board->getPawnHash());
+	ASSERT_NE(kingMove->getHash(), board->getHash());
+	auto pawnMove = board->updateBoard({ 2, 2, 3, 2 }).value();
+	ASSERT_NE(pawnMove->getPawnHash(), board->getPawnHash());
+
+	PawnTable::clear();
+	Feature_PassedPawn passed;
+	passed.getValue(board, Color::White);
+	passed.getValue(kingMove, Color::White);
+	ASSERT_EQ(PawnTable::getStats().misses, 1);
+	ASSERT_EQ(PawnTable::getStats().hits, 1);
+}
+
+TEST(AlgoSuite, LinearKernelTest) {
+	using namespace space;
+
+	// odd sizes run through every tail of the vector kernels
+	const std::size_t numFeatures = 13, count = 23, stride = 29;
+	std::vector<double> values(numFeatures * stride), weights(numFeatures);
+	for (std::size_t k = 0; k < values.size(); k++)
+		values[k] = double((k * 37) % 11) - 5;
+	for (std::size_t k = 0; k < numFeatures; k++)
+		weights[k] = 0.25 * double(k) - 1;
+	std::vector<double> expected(count), actual(count);
+	linearKernelScalar(values.data(), stride, weights.data(), numFeatures, count, expected.data());
+	linearKernel(values.data(), stride, weights.data(), numFeatures, count, actual.data());
+	for (std::size_t i = 0; i < count; i++)
+		ASSERT_NEAR(actual[i], expected[i], 1e-9) << linearKernelName();
+
+	// the batch path of every feature, vectorized or not, matches its values one by one
+	auto board = BoardImpl::fromFen(Fen("1n1qk1nr/8/8/4NP2/3P4/1pP3Pp/rB5P/3Q1RKB w - - 0 0"));
+	std::vector<IBoard::Ptr> boards;
+	for (const auto& mb : board->getValidMoves())
+		boards.push_back(mb.second);
+	BatchScan batch;
+	batch.assign(boards.data(), boards.size());
+	std::vector<std::string> names = { "Feature_PawnAdvance", "Feature_PassedPawn", "Feature_DoubledPawn",
+		"Feature_IsolatedPawn", "Feature_MinorBalance", "Feature_Dummy", "Feature_MoveCount",
+		"Feature_Mobility", "Feature_HangingPieces", "Feature_KingZoneAttacks" };
+	for (int t = 0; t < int(PieceType::None); t++)
+		names.push_back("Feature_Piece" + std::to_string(t));
+	for (int file = 0; file < 8; file++)
+		names.push_back("Feature_PawnRank" + std::to_string(file));
+	std::map<Feature::Ptr, double> featureWeights;
+	for (const auto& name : names) {
+		auto feature = Feature::fromString(name);
+		std::vector<double> differences(boards.size());
+		feature->getDifferences(batch, differences.data());
+		for (std::size_t i = 0; i < boards.size(); i++)
+			ASSERT_EQ(differences[i], feature->getValue(boards[i], Color::White) - feature->getValue(boards[i], Color::Black)) << name;
+		featureWeights[feature] = 0.5 + double(featureWeights.size());
+	}
+
+	// so a batch scores every position like one by one evaluation
+	for (const auto& evaluator : { LinearEvaluator(AlgoGeneric::getDefaultWeights()), LinearEvaluator(featureWeights) }) {
+		std::vector<double> scores;
+		evaluator.evaluateBatch(boards, scores);
+		ASSERT_EQ(scores.size(), boards.size());
+		for (std::size_t i = 0; i < boards.size(); i++)
+			ASSERT_NEAR(scores[i], evaluator.evaluate(boards[i]), 1e-9);
+	}
+
+	// Feature_PawnAdvance: b3 and h3 have come 4 ranks each, c3 d4 f5 g3 h2 have come 1 2 3 1 0
+	ASSERT_EQ(Feature_PawnAdvance().getValue(board, Color::Black), 8);
+	ASSERT_EQ(Feature_PawnAdvance().getValue(board, Color::White), 7);
+}
+
+TEST(AlgoSuite, EvalCacheTest) {
+	using namespace space;
+
+	auto board = BoardImpl::fromFen(Fen("1n1qk1nr/8/8/4NP2/3P4/1pP3Pp/rB5P/3Q1RKB w - - 0 0"));
+	LinearEvaluator evaluator(AlgoGeneric::getDefaultWeights());
+	auto otherWeights = AlgoGeneric::getDefaultWeights();
+	otherWeights.begin()->second += 1;
+	LinearEvaluator other(otherWeights);
+	ASSERT_EQ(evaluator.getKey(), LinearEvaluator(AlgoGeneric::getDefaultWeights()).getKey());
+	ASSERT_NE(evaluator.getKey(), other.getKey());
+
+	// a position is cached separately per weight set
+	EvalCache cache(1000);
+	ASSERT_EQ(cache.size(), 1024);
+	double score;
+	ASSERT_FALSE(cache.probe(board->getHash(), evaluator.getKey(), score));
+	cache.store(board->getHash(), evaluator.getKey(), evaluator.evaluate(board));
+	ASSERT_TRUE(cache.probe(board->getHash(), evaluator.getKey(), score));
+	ASSERT_EQ(score, evaluator.evaluate(board));
+	ASSERT_FALSE(cache.probe(board->getHash(), other.getKey(), score));
+	ASSERT_EQ(cache.getStats().hits, 1);
+	ASSERT_EQ(cache.getStats().misses, 2);
+
+	// a second search of the same position is served mostly from the cache;
+	// not entirely, as colliding positions replace each other
+	auto shared = std::make_shared<EvalCache>();
+	Algo442 first, second;
+	first.setEvalCache(shared);
+	second.setEvalCache(shared);
+	Move firstMove = first.getNextMove(board);
+	ASSERT_GT(first.getStats().evaluations, 0);
+	Move secondMove = second.getNextMove(board);
+	ASSERT_EQ(firstMove.toString(), secondMove.toString());
+	ASSERT_GT(second.getStats().evalCacheHits, second.getStats().evaluations / 2);
+	ASSERT_GE(second.getStats().evalSecondsSaved, 0);
+}
+
 TEST(AlgoSuite, AlgoGenericTest) {
 	using namespace space;
 
@@ -286,6 +647,512 @@ TEST(AlgoSuite, AlgoGenericTest) {
 	Move m0 = aa.getNextMove(b0);
 }
 
+TEST(AlgoSuite, AlgoGenericTranspositionTest) {
+	using namespace space;
+
+	Fen boardfen = Fen("r1bqk2r/pp2bppp/2n1pn2/3p4/2PP4/2N1PN2/PP3PPP/R1BQKB1R w KQkq - 0 7");
+	auto b0 = BoardImpl::fromFen(boardfen);
+
+	// without the shared eval cache, whose contents may change the scores a little
+	Algo442 tree;
+	tree.setEvalCache(nullptr);
+	Move treeMove = tree.getNextMove(b0);
+
+	Algo442 dag;
+	dag.setEvalCache(nullptr);
+	dag.setShareTranspositions(true);
+	Move dagMove = dag.getNextMove(b0);
+
+	// sharing the nodes of transposed lines finds the same move with less work
+	ASSERT_EQ(dagMove.toString(), treeMove.toString());
+	ASSERT_GT(dag.getStats().transpositionHits, 0);
+	ASSERT_LT(dag.getStats().nodesCreated, tree.getStats().nodesCreated);
+	ASSERT_LT(dag.getStats().leafExpansions, tree.getStats().leafExpansions);
+}
+
+TEST(AlgoSuite, AlgoGenericCheckpointTest) {
+	using namespace space;
+
+	auto b0 = BoardImpl::fromFen(Fen("1n1qk1nr/8/8/4NP2/3P4/1pP3Pp/rB5P/3Q1RKB w - - 0 0"));
+	auto path = (std::filesystem::temp_directory_path() / "algo442_checkpoint.bin").string();
+
+	// without the shared eval cache, whose contents may change the scores a little
+	Algo442 full;
+	full.setEvalCache(nullptr);
+	full.setShareTranspositions(true);
+	Move fullMove = full.getNextMove(b0);
+
+	// preempted after the second round, then resumed from its snapshot
+	Algo442 interrupted;
+	interrupted.setEvalCache(nullptr);
+	interrupted.setShareTranspositions(true);
+	interrupted.setCheckpoint(path, 0, [](int round) { if (round == 2) throw std::runtime_error("preempted"); });
+	ASSERT_THROW(interrupted.getNextMove(b0), std::runtime_error);
+
+	Algo442 resumed;
+	resumed.setEvalCache(nullptr);
+	resumed.setShareTranspositions(true);
+	std::vector<int> rounds;
+	resumed.setCheckpoint(path, 0, [&rounds](int round) { rounds.push_back(round); });
+	Move resumedMove = resumed.getNextMove(b0);
+
+	ASSERT_EQ(rounds, (std::vector<int>{ 3, 4 }));
+	ASSERT_EQ(resumedMove.toString(), fullMove.toString());
+	ASSERT_EQ(resumed.getStats().nodesCreated, full.getStats().nodesCreated);
+	ASSERT_EQ(resumed.getStats().leafExpansions, full.getStats().leafExpansions);
+	ASSERT_EQ(resumed.getStats().transpositionHits, full.getStats().transpositionHits);
+	ASSERT_FALSE(std::ifstream(path).good());
+}
+
+TEST(AlgoSuite, AlgoBStarTest) {
+	using namespace space;
+
+	Fen boardfen = Fen("1n1qk1nr/8/8/4NP2/3P4/1pP3Pp/rB5P/3Q1RKB w - - 0 0");
+	auto b0 = BoardImpl::fromFen(boardfen);
+
+	int genericNodesBefore = Node::objectCount;
+	Algo442().getNextMove(b0);
+	int genericNodes = Node::objectCount - genericNodesBefore;
+
+	int intervalNodesBefore = NodeInterval::objectCount;
+	auto algo = AlgoFactory::tryCreateAlgo({ {AlgoFactory::AlgoNameField, AlgoBStar::getAlgoName()} });
+	ASSERT_TRUE(algo.has_value());
+	Move m0 = algo.value()->getNextMove(b0);
+	int intervalNodes = NodeInterval::objectCount - intervalNodesBefore;
+
+	ASSERT_EQ(b0->getValidMoves().count(m0), 1);
+	ASSERT_LT(intervalNodes * 2, genericNodes);
+}
+
+TEST(AlgoSuite, AlgoBStarFindsMateTest) {
+	using namespace space;
+
+	// Ra8 is mate
+	auto board = BoardImpl::fromFen(Fen("6k1/5ppp/8/8/8/8/5PPP/R5K1 w - - 0 1"));
+	AlgoBStar algo;
+	Move m = algo.getNextMove(board);
+	auto next = board->updateBoard(m);
+	ASSERT_TRUE(next.has_value());
+	ASSERT_TRUE(next.value()->isCheckMate());
+}
+
+TEST(AlgoSuite, AlgoMctsTest) {
+	using namespace space;
+
+	auto config = nlohmann::json{
+		{AlgoFactory::AlgoNameField, AlgoMcts::getAlgoName()},
+		{AlgoMcts::getPlayoutsField(), 400},
+		{AlgoMcts::getThreadsField(), 4}
+	};
+	auto algo = AlgoFactory::tryCreateAlgo(config);
+	ASSERT_TRUE(algo.has_value());
+
+	auto b0 = BoardImpl::fromFen(Fen("1n1qk1nr/8/8/4NP2/3P4/1pP3Pp/rB5P/3Q1RKB w - - 0 0"));
+	Move m0 = algo.value()->getNextMove(b0);
+	ASSERT_EQ(b0->getValidMoves().count(m0), 1);
+
+	// Ra8 is mate
+	auto mateBoard = BoardImpl::fromFen(Fen("6k1/5ppp/8/8/8/8/5PPP/R5K1 w - - 0 1"));
+	Move mate = algo.value()->getNextMove(mateBoard);
+	ASSERT_TRUE(mateBoard->updateBoard(mate).value()->isCheckMate());
+}
+
+TEST(AlgoSuite, NnueTest) {
+	using namespace space;
+
+	std::mt19937 rng(7);
+	auto uniform = [&rng](int lo, int hi) { return std::uniform_int_distribution<int>(lo, hi)(rng); };
+	NnueEvaluator::Weights w;
+	w.hidden = 32;
+	w.outputScale = 100;
+	for (int i = 0; i < NnueEvaluator::numInputs * w.hidden; i++)
+		w.inputWeights.push_back(std::int16_t(uniform(-8, 8)));
+	for (int i = 0; i < w.hidden; i++)
+		w.inputBias.push_back(std::int16_t(uniform(0, 32)));
+	for (int i = 0; i < NnueEvaluator::numDense * 2 * w.hidden; i++)
+		w.denseWeights.push_back(std::int8_t(uniform(-20, 20)));
+	for (int i = 0; i < NnueEvaluator::numDense; i++) {
+		w.denseBias.push_back(uniform(-500, 500));
+		w.outputWeights.push_back(std::int8_t(uniform(-20, 20)));
+	}
+	auto nnue = std::make_shared<NnueEvaluator>(w);
+
+	// incremental updates match a full refresh, through castling, en passant and promotions
+	auto board = BoardImpl::fromFen(Fen("r3k2r/1P6/8/3pP3/8/8/8/R3K2R w KQkq d6 0 1"));
+	NnueEvaluator::Accumulator parentAcc, updated, refreshed;
+	nnue->refresh(*board, parentAcc);
+	for (const auto& mb : board->getValidMoves()) {
+		nnue->update(parentAcc, *board, mb.first, *mb.second, updated);
+		nnue->refresh(*mb.second, refreshed);
+		for (int p = 0; p < 2; p++)
+			for (int i = 0; i < w.hidden; i++)
+				ASSERT_EQ(updated.values[p][i], refreshed.values[p][i]) << mb.first.toString();
+		ASSERT_EQ(nnue->evaluate(updated, mb.second->whoPlaysNext()), nnue->evaluate(mb.second));
+	}
+
+	// the SIMD layers match plain integer arithmetic
+	auto clip = [](int x) { return std::clamp(x, 0, 127); };
+	int stm = int(board->whoPlaysNext());
+	std::int32_t expected = w.outputBias;
+	for (int n = 0; n < NnueEvaluator::numDense; n++) {
+		std::int32_t sum = w.denseBias[n];
+		for (int i = 0; i < 2 * w.hidden; i++) {
+			int perspective = i < w.hidden ? stm : 1 - stm;
+			sum += clip(parentAcc.values[perspective][i % w.hidden]) * w.denseWeights[n * 2 * w.hidden + i];
+		}
+		expected += clip(sum >> 6) * w.outputWeights[n];
+	}
+	ASSERT_EQ(nnue->evaluate(parentAcc, board->whoPlaysNext()), expected / w.outputScale * colorToSign(board->whoPlaysNext()));
+
+	// the weight file round trips
+	auto path = (std::filesystem::temp_directory_path() / "nnue_test.bin").string();
+	nnue->save(path);
+	auto loaded = NnueEvaluator::load(path);
+	ASSERT_EQ(loaded->getKey(), nnue->getKey());
+	ASSERT_EQ(loaded->evaluate(board), nnue->evaluate(board));
+	ASSERT_THROW(NnueEvaluator::load(path + ".missing"), std::runtime_error);
+
+	// searches run on the network
+	Algo442 algo;
+	algo.setNnue(nnue);
+	Move m0 = algo.getNextMove(board);
+	ASSERT_EQ(board->getValidMoves().count(m0), 1);
+
+	auto config = nlohmann::json{
+		{AlgoFactory::AlgoNameField, AlgoMcts::getAlgoName()},
+		{AlgoMcts::getPlayoutsField(), 100},
+		{AlgoMcts::getNnueFileField(), path}
+	};
+	auto mcts = AlgoFactory::tryCreateAlgo(config);
+	ASSERT_TRUE(mcts.has_value());
+	ASSERT_EQ(board->getValidMoves().count(mcts.value()->getNextMove(board)), 1);
+	std::filesystem::remove(path);
+}
+
+TEST(AlgoSuite, TexelTunerTest) {
+	using namespace space;
+
+	// scholar's mate, fool's mate, and a game without a result that is skipped
+	std::stringstream pgn(
+		"[Result \"1-0\"]\n\n1. e4 e5 2. Qh5 Nc6 3. Bc4 Nf6 4. Qxf7# 1-0\n\n"
+		"[Result \"0-1\"]\n\n1. f3 e5 2. g4 Qh4# 0-1\n\n"
+		"[Result \"*\"]\n\n1. d4 d5 *\n\n");
+	TexelConfig config;
+	config.skipPlies = 0;
+	config.epochs = 50;
+	config.batchSize = 4; // several steps per epoch, the last batch short
+	config.learningRate = 0.05;
+	auto cache = (std::filesystem::temp_directory_path() / "texel_test.bin").string();
+	TexelTuner tuner(AlgoGeneric::getDefaultWeights(), config);
+	ASSERT_EQ(tuner.extract(pgn, cache), 11); // positions before each ply
+
+	// the loss is the same on any number of threads, and fitting lowers it
+	config.threads = 3;
+	double initialLoss = tuner.loss(cache);
+	ASSERT_NEAR(TexelTuner(AlgoGeneric::getDefaultWeights(), config).loss(cache), initialLoss, 1e-12);
+	double finalLoss = tuner.fit(cache);
+	ASSERT_LT(tuner.loss(cache), initialLoss);
+	ASSERT_LT(finalLoss, initialLoss);
+
+	// tuned weights are a config file of AlgoBStar
+	auto weightsFile = (std::filesystem::temp_directory_path() / "texel_test.json").string();
+	AlgoGeneric::saveWeights(tuner.getWeights(), weightsFile);
+	auto loaded = AlgoGeneric::loadWeights(weightsFile);
+	ASSERT_EQ(LinearEvaluator(loaded).getKey(), LinearEvaluator(tuner.getWeights()).getKey());
+	auto algo = AlgoFactory::tryCreateAlgo({
+		{AlgoFactory::AlgoNameField, AlgoBStar::getAlgoName()},
+		{AlgoBStar::getWeightsFileField(), weightsFile} });
+	ASSERT_TRUE(algo.has_value());
+	auto b0 = BoardImpl::getStartingBoard();
+	ASSERT_EQ(b0->getValidMoves().count(algo.value()->getNextMove(b0)), 1);
+	ASSERT_THROW(Feature::fromString("Feature_Piece9"), std::runtime_error);
+
+	// more games go after the cached ones, of the same features only
+	std::stringstream more("[Result \"0-1\"]\n\n1. f3 e5 2. g4 Qh4# 0-1\n\n");
+	ASSERT_EQ(tuner.extract(more, cache, true), 4);
+	auto fewer = AlgoGeneric::getDefaultWeights();
+	fewer.erase(fewer.begin());
+	std::stringstream other("[Result \"0-1\"]\n\n1. f3 e5 2. g4 Qh4# 0-1\n\n");
+	ASSERT_THROW(TexelTuner(fewer, config).extract(other, cache, true), std::runtime_error);
+	ASSERT_GT(tuner.loss(cache), 0); // reads the 15 positions
+
+	std::filesystem::remove(cache);
+	std::filesystem::remove(weightsFile);
+}
+
+TEST(AlgoSuite, MateSolverTest) {
+	using namespace space;
+
+	MateSolver solver;
+
+	// Morphy: 1.Ra6 bxa6 2.b7#
+	auto morphy = BoardImpl::fromFen(Fen("kbK5/pp6/1P6/8/8/8/8/R7 w - - 0 1"));
+	MateResult result = solver.solve(morphy);
+	ASSERT_TRUE(result.isMate);
+	ASSERT_EQ(result.matePlies, 3);
+	ASSERT_EQ(result.line.size(), 3);
+	IBoard::Ptr board = morphy;
+	for (const Move& move : result.line) {
+		ASSERT_EQ(board->getValidMoves().count(move), 1);
+		board = board->updateBoard(move).value();
+	}
+	ASSERT_TRUE(board->isCheckMate());
+
+	// Ra8 is mate
+	auto mateInOne = BoardImpl::fromFen(Fen("6k1/5ppp/8/8/8/8/5PPP/R5K1 w - - 0 1"));
+	result = solver.solve(mateInOne);
+	ASSERT_TRUE(result.isMate);
+	ASSERT_EQ(result.matePlies, 1);
+
+	// a bare king cannot be mated
+	MateSolverConfig config;
+	config.maxPlies = 3;
+	MateSolver shortSolver(config);
+	result = shortSolver.solve(BoardImpl::fromFen(Fen("4k3/8/8/8/8/8/8/4K3 w - - 0 1")));
+	ASSERT_FALSE(result.isMate);
+	ASSERT_FALSE(result.budgetExhausted);
+}
+
+TEST(AlgoSuite, AlgoMateOracleTest) {
+	using namespace space;
+
+	auto config = nlohmann::json{
+		{AlgoFactory::AlgoNameField, AlgoMateOracle::getAlgoName()},
+		{AlgoMateOracle::getFallbackField(), {{AlgoFactory::AlgoNameField, AlgoBStar::getAlgoName()}}}
+	};
+	auto algo = AlgoFactory::tryCreateAlgo(config);
+	ASSERT_TRUE(algo.has_value());
+
+	auto morphy = BoardImpl::fromFen(Fen("kbK5/pp6/1P6/8/8/8/8/R7 w - - 0 1"));
+	Move move = algo.value()->getNextMove(morphy);
+	ASSERT_EQ(move.toString(), Move(0, 0, 5, 0).toString()); // Ra6
+
+	// nothing forcing: the fallback plays
+	auto b0 = BoardImpl::getStartingBoard();
+	ASSERT_EQ(b0->getValidMoves().count(algo.value()->getNextMove(b0)), 1);
+}
+
+TEST(AlgoSuite, TablebaseTest) {
+	using namespace space;
+	using Outcome = TablebaseResult::Outcome;
+
+	auto directory = (std::filesystem::temp_directory_path() / "tablebase_test").string();
+	std::filesystem::remove_all(directory);
+	std::vector<std::string> generated;
+	{
+		Tablebases tables(directory);
+		ASSERT_EQ(Tablebases::canonicalMaterial("KKQ"), "KQK");
+		ASSERT_EQ(Tablebases::canonicalMaterial("KRKQ"), "KQKR");
+		ASSERT_THROW(Tablebases::canonicalMaterial("KQRBK"), std::runtime_error);
+
+		auto onTable = [&generated](const Tablebases::TableStats& stats) { generated.push_back(stats.material); };
+		auto kqk = tables.generate("KQK", 2, onTable);
+		auto krk = tables.generate("KRK", 1, onTable);
+		tables.generate("KPK", 2, onTable);
+		ASSERT_EQ(kqk.longestMate, 19);
+		ASSERT_EQ(krk.longestMate, 31);
+		ASSERT_EQ(kqk.wins + kqk.draws + kqk.losses, kqk.positions);
+	}
+	// KPK needs the tables of its promotions
+	ASSERT_EQ(generated, (std::vector<std::string>{ "KQK", "KRK", "KBK", "KNK", "KPK" }));
+
+	// read back from the files
+	Tablebases tables(directory);
+	ASSERT_TRUE(tables.hasTable("KKP"));
+	ASSERT_FALSE(tables.hasTable("KQKR"));
+
+	auto mateInOne = BoardImpl::fromFen(Fen("k7/8/1K6/8/8/8/8/6Q1 w - - 0 1"));
+	auto result = tables.probe(*mateInOne);
+	ASSERT_TRUE(result.has_value());
+	ASSERT_EQ(result->outcome, Outcome::Win);
+	ASSERT_EQ(result->pliesToMate, 1);
+	auto move = tables.bestMove(mateInOne);
+	ASSERT_TRUE(move.has_value());
+	ASSERT_TRUE(mateInOne->updateBoard(move.value()).value()->isCheckMate());
+
+	// the rook pawn with the defending king in front
+	result = tables.probe(*BoardImpl::fromFen(Fen("k7/8/8/8/8/8/P7/K7 w - - 0 1")));
+	ASSERT_TRUE(result.has_value());
+	ASSERT_EQ(result->outcome, Outcome::Draw);
+	result = tables.probe(*BoardImpl::fromFen(Fen("4k3/8/8/8/4K3/8/4P3/8 w - - 0 1")));
+	ASSERT_TRUE(result.has_value());
+	ASSERT_EQ(result->outcome, Outcome::Win);
+	// colours flipped: the same table
+	result = tables.probe(*BoardImpl::fromFen(Fen("8/4p3/8/4k3/8/8/8/4K3 b - - 0 1")));
+	ASSERT_TRUE(result.has_value());
+	ASSERT_EQ(result->outcome, Outcome::Win);
+
+	ASSERT_FALSE(tables.probe(*BoardImpl::getStartingBoard()).has_value());
+	ASSERT_FALSE(tables.probe(*BoardImpl::fromFen(Fen("k7/8/8/8/8/8/8/R3K3 w Q - 0 1"))).has_value());
+
+	// every result agrees with the results of the moves from the position
+	std::mt19937 random(7);
+	int checked = 0;
+	while (checked < 300) {
+		const char* materials[3] = { "KkQ", "KkR", "KkP" };
+		std::string men = materials[random() % 3];
+		char squares[64];
+		std::fill(squares, squares + 64, '.');
+		bool placed = true;
+		for (char man : men) {
+			int square = int(random() % 64);
+			placed = placed && squares[square] == '.' && (man != 'P' || (square >= 8 && square < 56));
+			squares[square] = man;
+		}
+		if (!placed)
+			continue;
+		std::string fen;
+		for (int rank = 7; rank >= 0; rank--) {
+			int empty = 0;
+			for (int file = 0; file < 8; file++) {
+				char c = squares[rank * 8 + file];
+				if (c == '.') {
+					empty++;
+					continue;
+				}
+				if (empty)
+					fen += char('0' + empty);
+				empty = 0;
+				fen += c;
+			}
+			if (empty)
+				fen += char('0' + empty);
+			if (rank)
+				fen += '/';
+		}
+		fen += random() % 2 ? " w - - 0 1" : " b - - 0 1";
+		auto board = BoardImpl::fromFen(Fen(fen));
+		Color other = board->whoPlaysNext() == Color::White ? Color::Black : Color::White;
+		if (board->isUnderCheck(other))
+			continue;
+		result = tables.probe(*board);
+		ASSERT_TRUE(result.has_value()) << fen;
+		auto moves = board->getValidMoves();
+		if (moves.empty()) {
+			ASSERT_EQ(result->outcome, board->isCheckMate() ? Outcome::Loss : Outcome::Draw) << fen;
+			ASSERT_EQ(result->pliesToMate, 0) << fen;
+			checked++;
+			continue;
+		}
+		int quickestWin = -1, slowestLoss = -1;
+		bool draws = false;
+		for (const auto& child : moves) {
+			auto value = tables.probe(*child.second);
+			if (!value)
+				continue; // a double push with an en passant capture
+			if (value->outcome == Outcome::Loss)
+				quickestWin = quickestWin < 0 ? value->pliesToMate + 1 : std::min(quickestWin, value->pliesToMate + 1);
+			else if (value->outcome == Outcome::Draw)
+				draws = true;
+			else
+				slowestLoss = std::max(slowestLoss, value->pliesToMate + 1);
+		}
+		if (quickestWin >= 0) {
+			ASSERT_EQ(result->outcome, Outcome::Win) << fen;
+			ASSERT_EQ(result->pliesToMate, quickestWin) << fen;
+		}
+		else if (draws)
+			ASSERT_EQ(result->outcome, Outcome::Draw) << fen;
+		else {
+			ASSERT_EQ(result->outcome, Outcome::Loss) << fen;
+			ASSERT_EQ(result->pliesToMate, slowestLoss) << fen;
+		}
+		checked++;
+	}
+	std::filesystem::remove_all(directory);
+}
+
+TEST(AlgoSuite, AlgoTablebaseTest) {
+	using namespace space;
+
+	auto directory = (std::filesystem::temp_directory_path() / "algo_tablebase_test").string();
+	std::filesystem::remove_all(directory);
+	Tablebases(directory).generate("KRK");
+
+	auto config = nlohmann::json{
+		{AlgoFactory::AlgoNameField, AlgoTablebase::getAlgoName()},
+		{AlgoTablebase::getDirectoryField(), directory},
+		{AlgoTablebase::getFallbackField(), {{AlgoFactory::AlgoNameField, AlgoBStar::getAlgoName()}}}
+	};
+	auto algo = AlgoFactory::tryCreateAlgo(config);
+	ASSERT_TRUE(algo.has_value());
+
+	// the rook mates from the tables
+	auto tables = std::make_shared<Tablebases>(directory);
+	IBoard::Ptr board = BoardImpl::fromFen(Fen("8/8/8/4k3/8/8/8/R3K3 w - - 0 1"));
+	int plies = tables->probe(*board)->pliesToMate;
+	for (int ply = 0; ply < plies; ply++) {
+		board = board->updateBoard(algo.value()->getNextMove(board)).value();
+		ASSERT_EQ(tables->probe(*board)->pliesToMate, plies - ply - 1);
+	}
+	ASSERT_TRUE(board->isCheckMate());
+
+	// not in the tables: the fallback plays
+	auto b0 = BoardImpl::getStartingBoard();
+	ASSERT_EQ(b0->getValidMoves().count(algo.value()->getNextMove(b0)), 1);
+	std::filesystem::remove_all(directory);
+}
+
+TEST(AlgoSuite, OpeningBookTest) {
+	using namespace space;
+
+	// 1. e4 three times, 1. d4 twice; a game without a result and one that does not replay are skipped
+	std::stringstream pgn(
+		"[Result \"1-0\"]\n\n1. e4 e5 2. Nf3 Nc6 1-0\n\n"
+		"[Result \"1/2-1/2\"]\n\n1. e4 e5 2. Nf3 Nf6 1/2-1/2\n\n"
+		"[Result \"0-1\"]\n\n1. e4 c5 0-1\n\n"
+		"[Result \"1-0\"]\n\n1. d4 d5 1-0\n\n"
+		"[Result \"0-1\"]\n\n1. d4 Nf6 0-1\n\n"
+		"[Result \"*\"]\n\n1. c4 e5 *\n\n"
+		"[Result \"1-0\"]\n\n1. e4 e4 1-0\n\n");
+	BookConfig config;
+	config.maxPlies = 3;
+	config.memoryEntries = 4; // merged several times along the way
+	auto path = (std::filesystem::temp_directory_path() / "opening_book_test.bin").string();
+	BookBuilder builder(config);
+	ASSERT_EQ(builder.add(pgn), 5);
+	builder.write(path);
+
+	OpeningBook book(path);
+	ASSERT_EQ(book.size(), 4); // e4, d4, e4 e5, e4 e5 Nf3; the rest once only
+	auto b0 = BoardImpl::getStartingBoard();
+	auto moves = book.probe(*b0);
+	ASSERT_EQ(moves.size(), 2);
+	ASSERT_EQ(moves[0].move.toString(), Move(1, 4, 3, 4).toString());
+	ASSERT_EQ(moves[0].games, 3);
+	ASSERT_EQ(moves[0].wins, 1);
+	ASSERT_EQ(moves[0].draws, 1);
+	ASSERT_EQ(moves[1].move.toString(), Move(1, 3, 3, 3).toString());
+	ASSERT_NEAR(moves[1].score(), 0.5, 1e-12);
+
+	auto e4 = b0->updateBoard(Move(1, 4, 3, 4)).value();
+	moves = book.probe(*e4);
+	ASSERT_EQ(moves.size(), 1);
+	ASSERT_EQ(moves[0].games, 2); // for Black, not the 1-0 of the game
+	ASSERT_EQ(moves[0].wins, 0);
+	ASSERT_TRUE(book.probe(*e4->updateBoard(Move(6, 2, 4, 2)).value()).empty());
+
+	auto config2 = nlohmann::json{
+		{AlgoFactory::AlgoNameField, AlgoBook::getAlgoName()},
+		{AlgoBook::getBookFileField(), path},
+		{AlgoBook::getFallbackField(), {{AlgoFactory::AlgoNameField, AlgoBStar::getAlgoName()}}}
+	};
+	auto algo = AlgoFactory::tryCreateAlgo(config2);
+	ASSERT_TRUE(algo.has_value());
+	ASSERT_EQ(algo.value()->getNextMove(b0).toString(), Move(1, 4, 3, 4).toString());
+	// out of the book: the fallback plays
+	auto c4 = b0->updateBoard(Move(1, 2, 3, 2)).value();
+	ASSERT_EQ(c4->getValidMoves().count(algo.value()->getNextMove(c4)), 1);
+
+	// weighted picks stay in the book
+	AlgoBook weighted(algo.value(), std::make_shared<OpeningBook>(path), true);
+	for (int i = 0; i < 10; i++) {
+		std::string move = weighted.getNextMove(b0).toString();
+		ASSERT_TRUE(move == Move(1, 4, 3, 4).toString() || move == Move(1, 3, 3, 3).toString());
+	}
+	std::filesystem::remove(path);
+}
+
 TEST(BoardSuite, PGNParseTest) {
 	using namespace space;
 
@@ -313,3 +1180,106 @@ TEST(BoardSuite, PGNParseFromPositionTest) {
 	f.close();
 	test_utils::validate_game_moves(*game);
 }
+
+TEST(BoardSuite, PGNReaderTest) {
+	using namespace space;
+
+	// movetext over two lines, a game with a malformed tag pair that is skipped, a game without a result
+	const std::string text =
+		"[Event \"first\"]\n[Result \"1-0\"]\n\n1. e4 e5 2. Qh5 Nc6\n3. Bc4 Nf6 4. Qxf7# 1-0\n\n"
+		"[Event broken]\n\n1. d4 d5 *\n\n"
+		"[Event \"third\"]\n[FEN \"k7/8/1K6/8/8/8/8/6Q1 w - - 0 1\"]\n\n1. Qg8#\n\n"
+		"[Event \"fourth\"]\n\n1. f3 e5 2. g4 Qh4# 0-1\n\n";
+
+	std::stringstream in(text);
+	PGNReader reader(in);
+	Game game;
+	std::vector<std::string> events;
+	std::vector<std::size_t> plies;
+	while (reader.next(game)) {
+		events.push_back(game.metadata["Event"]);
+		plies.push_back(game.plies.size());
+		test_utils::validate_game_moves(game);
+	}
+	ASSERT_EQ(events, (std::vector<std::string>{ "first", "third", "fourth" }));
+	ASSERT_EQ(plies, (std::vector<std::size_t>{ 7, 1, 4 }));
+
+	// the visitor stops when asked, and parse_all wraps it
+	std::stringstream in2(text);
+	std::size_t visited = PGN::for_each_game(in2, [](const Game& g) { return g.metadata.at("Event") != "third"; });
+	ASSERT_EQ(visited, 2);
+	std::stringstream in3(text);
+	auto games = PGN::parse_all(in3);
+	ASSERT_EQ(games.size(), 3);
+	ASSERT_EQ(games[1].starting_position.fen, "k7/8/1K6/8/8/8/8/6Q1 w - - 0 1");
+	ASSERT_EQ(games[2].metadata.count("FEN"), 0); // nothing left over from the game before
+
+	// results by the tag, replays visiting the position before each ply
+	ASSERT_EQ(games[0].result(), std::optional<double>(1.0));
+	ASSERT_FALSE(games[2].result().has_value());
+	std::vector<std::string> replayed;
+	ASSERT_TRUE(games[0].replay([&replayed](const IBoard::Ptr& board, const Move& move) {
+		replayed.push_back(move.toString());
+		ASSERT_EQ(board->getValidMoves().count(move), 1);
+	}, 3));
+	ASSERT_EQ(replayed.size(), 3);
+	Game moved = games[0];
+	moved.starting_position = games[1].starting_position; // 1. e4 has no pawn to play
+	ASSERT_FALSE(moved.replay([](const IBoard::Ptr&, const Move&) {}));
+}
+
+TEST(BoardSuite, PGNTokenizerTest) {
+	using namespace space;
+
+	// CRLF line ends, a comment over two lines, a variation, glyphs, move numbers run into their moves
+	const std::string text =
+		"[Event \"first\"]\r\n[White \"a \\\"quoted\\\" name\"]\r\n\r\n"
+		"1.e4 {best\r\nby test} e5 2. Nf3 $1 (2. Qh5 Nc6 (2... g6)) Nc6 ; rest of line\r\n"
+		"3.Bb5 a6 1-0\r\n\r\n\r\n"
+		"[Event \"second\"]\n[FEN \"k7/8/1K6/8/8/8/8/6Q1 b - - 0 1\"]\n\n1... Ka7 *\n"
+		"[Event \"third\"]\n\n1. d4";
+
+	PGNTokenizer tokenizer(text);
+	PGNTokenizer::GameTokens tokens;
+	ASSERT_TRUE(tokenizer.next(tokens));
+	ASSERT_EQ(tokens.tags.size(), 2);
+	ASSERT_EQ(tokens.tags[0].first, "Event");
+	ASSERT_EQ(tokens.tags[0].second, "first");
+	ASSERT_EQ(tokens.tags[1].second, "a \\\"quoted\\\" name");
+	std::vector<std::string_view> expected = { "1.", "e4", "e5", "2.", "Nf3", "Nc6", "3.", "Bb5", "a6", "1-0" };
+	ASSERT_EQ(tokens.movetext, expected);
+	// views into the text, no copies
+	ASSERT_TRUE(tokens.movetext[1].data() >= text.data() && tokens.movetext[1].data() < text.data() + text.size());
+
+	ASSERT_TRUE(tokenizer.next(tokens));
+	ASSERT_EQ(tokens.tags[1].second, "k7/8/1K6/8/8/8/8/6Q1 b - - 0 1");
+	expected = { "1...", "Ka7", "*" };
+	ASSERT_EQ(tokens.movetext, expected);
+	ASSERT_TRUE(tokenizer.next(tokens));
+	expected = { "1.", "d4" };
+	ASSERT_EQ(tokens.movetext, expected);
+	ASSERT_FALSE(tokenizer.next(tokens));
+
+	// the same games from a mapped file and from a stream
+	auto path = (std::filesystem::temp_directory_path() / "pgn_tokenizer_test.pgn").string();
+	{
+		std::ofstream out(path, std::ios::binary);
+		out << text;
+	}
+	std::vector<std::string> fromFile, fromStream;
+	auto collect = [](std::vector<std::string>& games) {
+		return [&games](const Game& game) {
+			std::string s = game.metadata.at("Event") + ":" + game.starting_position.fen;
+			for (const auto& ply : game.plies)
+				s += " " + std::to_string(ply.move_number) + (ply.color == Color::White ? "w" : "b") + ply.move;
+			games.push_back(s);
+			return true;
+		};
+	};
+	ASSERT_EQ(PGN::for_each_game(path, collect(fromFile)), 3);
+	std::stringstream in(text);
+	ASSERT_EQ(PGN::for_each_game(in, collect(fromStream)), 3);
+	ASSERT_EQ(fromFile, fromStream);
+	ASSERT_EQ(fromFile[1], "second:k7/8/1K6/8/8/8/8/6Q1 b - - 0 1 1bKa7");
+	std::filesystem::remove(path);
+}
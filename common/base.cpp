@@ -3,6 +3,10 @@
 #include <stdexcept>
 
 #include <algorithm>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 
 namespace space {
@@ -32,5 +36,39 @@ namespace space {
     }
 
 
+	void parallel_for(std::size_t count, int numThreads,
+		const std::function<void(int thread, std::size_t begin, std::size_t end)>& body)
+	{
+		space_assert(numThreads > 0, "parallel_for needs at least one thread");
+		if (numThreads == 1 || count < 2) {
+			body(0, 0, count);
+			return;
+		}
+
+		std::exception_ptr firstError;
+		std::mutex errorMutex;
+		std::vector<std::thread> workers;
+		std::size_t slice = (count + numThreads - 1) / numThreads;
+		for (int t = 0; t < numThreads && std::size_t(t) * slice < count; t++) {
+			std::size_t begin = std::size_t(t) * slice;
+			std::size_t end = std::min(count, begin + slice);
+			workers.emplace_back([&, t, begin, end]() {
+				try {
+					body(t, begin, end);
+				}
+				catch (...) {
+					std::lock_guard<std::mutex> lock(errorMutex);
+					if (!firstError)
+						firstError = std::current_exception();
+				}
+			});
+		}
+		for (auto& worker : workers)
+			worker.join();
+		if (firstError)
+			std::rethrow_exception(firstError);
+	}
+
+
 
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+#include <functional>
 #include <string>
 #include <map>
 
@@ -12,5 +14,11 @@ namespace space {
 
 	double urand();
 
+	// Splits [0, count) into one contiguous slice per thread and runs
+	// body(thread, begin, end) on each; returns when all are done and
+	// rethrows the first exception of a slice. One thread runs inline.
+	void parallel_for(std::size_t count, int numThreads,
+		const std::function<void(int thread, std::size_t begin, std::size_t end)>& body);
+
 
 }
\ No newline at end of file
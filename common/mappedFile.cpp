@@ -0,0 +1,185 @@
+#include "mappedFile.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace space {
+
+	MappedFile::MappedFile(const std::string& v_path, Mode mode) :
+		path(v_path), writable(mode != Mode::Read)
+	{
+#ifdef _WIN32
+		HANDLE h = CreateFileA(path.c_str(),
+			this->writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+			FILE_SHARE_READ,
+			nullptr,
+			mode == Mode::Create ? CREATE_ALWAYS : OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL,
+			nullptr);
+		if (h == INVALID_HANDLE_VALUE)
+			throw std::runtime_error("Cannot open " + path);
+		this->file = h;
+		LARGE_INTEGER size;
+		GetFileSizeEx(h, &size);
+		this->length = std::size_t(size.QuadPart);
+#else
+		int flags = mode == Mode::Read ? O_RDONLY
+			: mode == Mode::Write ? O_RDWR
+			: O_RDWR | O_CREAT | O_TRUNC;
+		this->fd = ::open(path.c_str(), flags, 0644);
+		if (this->fd < 0)
+			throw std::runtime_error("Cannot open " + path);
+		struct stat st;
+		fstat(this->fd, &st);
+		this->length = std::size_t(st.st_size);
+#endif
+		this->open = true;
+		this->map();
+	}
+
+	MappedFile::MappedFile(MappedFile&& that) noexcept
+	{
+		*this = std::move(that);
+	}
+
+	MappedFile& MappedFile::operator=(MappedFile&& that) noexcept
+	{
+		if (this != &that) {
+			this->close();
+			this->path = std::move(that.path);
+			this->open = that.open;
+			this->writable = that.writable;
+			this->address = that.address;
+			this->length = that.length;
+#ifdef _WIN32
+			this->file = that.file;
+			this->mapping = that.mapping;
+			that.file = that.mapping = nullptr;
+#else
+			this->fd = that.fd;
+			that.fd = -1;
+#endif
+			that.open = false;
+			that.address = nullptr;
+			that.length = 0;
+		}
+		return *this;
+	}
+
+	MappedFile::~MappedFile()
+	{
+		this->close();
+	}
+
+	void MappedFile::map()
+	{
+		if (this->length == 0)
+			return; // nothing to map; data() stays null
+#ifdef _WIN32
+		this->mapping = CreateFileMappingA(this->file, nullptr,
+			this->writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, nullptr);
+		if (this->mapping)
+			this->address = static_cast<char*>(MapViewOfFile(this->mapping,
+				this->writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, this->length));
+#else
+		void* p = mmap(nullptr, this->length,
+			this->writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, this->fd, 0);
+		if (p != MAP_FAILED)
+			this->address = static_cast<char*>(p);
+#endif
+		if (!this->address)
+			throw std::runtime_error("Cannot map " + this->path);
+	}
+
+	void MappedFile::unmap()
+	{
+#ifdef _WIN32
+		if (this->address)
+			UnmapViewOfFile(this->address);
+		if (this->mapping)
+			CloseHandle(this->mapping);
+		this->mapping = nullptr;
+#else
+		if (this->address)
+			munmap(this->address, this->length);
+#endif
+		this->address = nullptr;
+	}
+
+	void MappedFile::resize(std::size_t size)
+	{
+		if (!this->open || !this->writable)
+			throw std::runtime_error("Cannot resize " + this->path + ", not open for writing");
+		this->unmap();
+#ifdef _WIN32
+		LARGE_INTEGER end;
+		end.QuadPart = LONGLONG(size);
+		bool resized = SetFilePointerEx(this->file, end, nullptr, FILE_BEGIN) && SetEndOfFile(this->file);
+#else
+		bool resized = ftruncate(this->fd, off_t(size)) == 0;
+#endif
+		if (!resized)
+			throw std::runtime_error("Cannot resize " + this->path);
+		this->length = size;
+		this->map();
+	}
+
+	void MappedFile::flush()
+	{
+		if (!this->address || !this->writable)
+			return;
+#ifdef _WIN32
+		FlushViewOfFile(this->address, 0);
+		FlushFileBuffers(this->file);
+#else
+		msync(this->address, this->length, MS_SYNC);
+#endif
+	}
+
+	void MappedFile::close()
+	{
+		if (!this->open)
+			return;
+		this->unmap();
+#ifdef _WIN32
+		CloseHandle(this->file);
+		this->file = nullptr;
+#else
+		::close(this->fd);
+		this->fd = -1;
+#endif
+		this->open = false;
+		this->length = 0;
+	}
+
+	void replaceFile(const std::string& path, std::size_t size, const std::function<void(char* data)>& fill)
+	{
+		std::string temporary = path + ".tmp";
+		{
+			MappedFile file(temporary, MappedFile::Mode::Create);
+			if (size > 0) {
+				file.resize(size);
+				fill(file.data());
+				file.flush();
+			}
+		}
+#ifdef _WIN32
+		bool renamed = MoveFileExA(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+		bool renamed = std::rename(temporary.c_str(), path.c_str()) == 0;
+#endif
+		if (!renamed)
+			throw std::runtime_error("Cannot replace " + path);
+	}
+
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace space {
+
+	// A file mapped into memory. A writable mapping is shared with the file,
+	// so the page cache decides which parts stay resident and writes the rest
+	// back. resize maps the file again: pointers into it do not survive.
+	// Throws std::runtime_error when the file cannot be opened or mapped.
+	class MappedFile {
+	public:
+		enum class Mode { Read, Write, Create }; // Write opens an existing file, Create truncates or makes one
+
+		MappedFile() {}
+		MappedFile(const std::string& path, Mode mode);
+		MappedFile(MappedFile&& that) noexcept;
+		MappedFile& operator=(MappedFile&& that) noexcept;
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		~MappedFile();
+
+		void resize(std::size_t size); // of a writable file; new bytes are zero
+		void flush();                  // dirty pages to disk, before returning
+		void close();
+
+		bool isOpen() const { return open; }
+		char* data() { return address; }
+		const char* data() const { return address; }
+		std::size_t size() const { return length; }
+		const std::string& getPath() const { return path; }
+
+	private:
+		std::string path;
+		bool open = false;
+		bool writable = false;
+		char* address = nullptr;
+		std::size_t length = 0;
+#ifdef _WIN32
+		void* file = nullptr;    // HANDLE
+		void* mapping = nullptr; // HANDLE
+#else
+		int fd = -1;
+#endif
+		void map();
+		void unmap();
+	};
+
+
+	// Writes a file of size bytes, filled in place by fill, under a temporary
+	// name renamed to path once flushed: a crash while writing leaves the
+	// previous file at path whole. For snapshots that must survive preemption.
+	void replaceFile(const std::string& path, std::size_t size, const std::function<void(char* data)>& fill);
+
+
+	// Array of trivially copyable values, on the heap or, given a path, in a
+	// scratch file mapped into memory and removed with the array. Grows
+	// geometrically like std::vector; growing a mapped array remaps it.
+	template <class T>
+	class MappedArray {
+		static_assert(std::is_trivially_copyable<T>::value, "MappedArray holds raw bytes");
+
+	public:
+		MappedArray() {}
+		explicit MappedArray(const std::string& path) : file(path, MappedFile::Mode::Create) {}
+		MappedArray(MappedArray&&) = default;
+		MappedArray& operator=(MappedArray&&) = delete;
+		~MappedArray()
+		{
+			if (file.isOpen()) {
+				std::string path = file.getPath();
+				file.close();
+				std::remove(path.c_str());
+			}
+		}
+
+		bool isMapped() const { return file.isOpen(); }
+		std::size_t size() const { return file.isOpen() ? count : heap.size(); }
+		bool empty() const { return size() == 0; }
+		T* data() { return file.isOpen() ? reinterpret_cast<T*>(file.data()) : heap.data(); }
+		const T* data() const { return file.isOpen() ? reinterpret_cast<const T*>(file.data()) : heap.data(); }
+		T& operator[](std::size_t i) { return data()[i]; }
+		const T& operator[](std::size_t i) const { return data()[i]; }
+		T* begin() { return data(); }
+		T* end() { return data() + size(); }
+		const T* begin() const { return data(); }
+		const T* end() const { return data() + size(); }
+
+		void resize(std::size_t n, T value = T()) // by value, it may be an element moved by the remap
+		{
+			if (!file.isOpen()) {
+				heap.resize(n, value);
+				return;
+			}
+			if (n * sizeof(T) > file.size())
+				file.resize(std::max(n, std::max(2 * file.size() / sizeof(T), std::size_t(4096))) * sizeof(T));
+			for (std::size_t i = count; i < n; i++)
+				data()[i] = value;
+			count = n;
+		}
+		void assign(std::size_t n, const T& value)
+		{
+			resize(0);
+			resize(n, value);
+		}
+		void push_back(const T& value)
+		{
+			resize(size() + 1, value);
+		}
+		template <class... Args> void emplace_back(Args&&... args)
+		{
+			push_back(T(std::forward<Args>(args)...));
+		}
+		template <class It> void append(It first, It last)
+		{
+			std::size_t n = size();
+			resize(n + std::size_t(last - first));
+			std::copy(first, last, data() + n);
+		}
+
+	private:
+		std::vector<T> heap;
+		MappedFile file;
+		std::size_t count = 0; // in use of the mapped file
+	};
+
+}
@@ -0,0 +1,76 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <algo_linear/tablebase.h>
+
+namespace {
+
+	struct Options {
+		std::vector<std::string> materials;
+		std::string directory = "tablebases";
+		int threads = 1;
+	};
+
+	void printUsage(const char* program)
+	{
+		std::cout << "Generates endgame tablebases by retrograde analysis.\n\t"
+			<< program << " [--dir <directory>] [--threads n] [--help|-h] <material>...\n"
+			<< "A material set has up to 4 men, each side its king first, such as KQK, KPK or KRKB.\n"
+			<< "The tables its captures and promotions lead to are generated first; tables already in the directory are kept.\n"
+			<< "The directory is the Directory field of AlgoTablebase configs."
+			<< std::endl;
+	}
+
+	Options parseOptions(int argc, char const* const* const argv)
+	{
+		Options result;
+		for (int iarg = 1; iarg < argc; ++iarg)
+		{
+			std::string arg = argv[iarg];
+			auto next = [&]() -> std::string {
+				if (++iarg >= argc)
+					throw std::runtime_error("invalid command line arguments: expected a value after '" + arg + "'");
+				return argv[iarg];
+			};
+
+			if (arg == "--dir")
+				result.directory = next();
+			else if (arg == "--threads")
+				result.threads = std::stoi(next());
+			else if (arg == "--help" || arg == "-h")
+			{
+				printUsage(argv[0]);
+				std::exit(0);
+			}
+			else if (!arg.empty() && arg[0] == '-')
+				throw std::runtime_error("invalid command line arguments: unknown option '" + arg + "'");
+			else
+				result.materials.push_back(arg);
+		}
+		if (result.materials.empty())
+			throw std::runtime_error("invalid command line arguments: no material set given");
+		return result;
+	}
+}
+
+int main(int argc, char const * const * const argv) {
+	Options options = parseOptions(argc, argv);
+
+	space::Tablebases tables(options.directory);
+	for (const auto& material : options.materials)
+	{
+		if (tables.hasTable(material))
+		{
+			std::cout << space::Tablebases::canonicalMaterial(material) << ": already in " << options.directory << std::endl;
+			continue;
+		}
+		tables.generate(material, options.threads, [](const space::Tablebases::TableStats& stats) {
+			std::cout << stats.material << ": " << stats.positions << " positions, "
+				<< stats.wins << " wins, " << stats.draws << " draws, " << stats.losses << " losses"
+				<< " for the side to move, longest mate " << stats.longestMate << " plies ("
+				<< stats.seconds << " s)" << std::endl;
+		});
+	}
+	return 0;
+}
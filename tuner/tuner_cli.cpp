@@ -0,0 +1,100 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <algo_linear/algoGeneric.h>
+#include <algo_linear/texelTuner.h>
+
+namespace {
+
+	struct Options {
+		std::vector<std::string> pgnFiles;
+		std::string cacheFile = "texel_positions.bin";
+		std::string initialWeightsFile;
+		std::string outputFile = "weights.json";
+		space::TexelConfig tuning;
+	};
+
+	void printUsage(const char* program)
+	{
+		std::cout << "Fits the linear evaluation weights to game results (Texel tuning).\n\t"
+			<< program << " [--pgn <games.pgn>]... [--cache <positions.bin>] [--weights <initial.json>]"
+			<< " [--out <weights.json>] [--threads n] [--epochs n] [--batch n] [--skipPlies n]"
+			<< " [--learningRate x] [--scale K] [--help|-h]\n"
+			<< "Positions of the --pgn files are extracted into the cache first; without --pgn an existing cache is tuned.\n"
+			<< "The output is a weights file for the WeightsFile field of AlgoMcts and AlgoBStar configs."
+			<< std::endl;
+	}
+
+	Options parseOptions(int argc, char const* const* const argv)
+	{
+		Options result;
+		for (int iarg = 1; iarg < argc; ++iarg)
+		{
+			std::string arg = argv[iarg];
+			auto next = [&]() -> std::string {
+				if (++iarg >= argc)
+					throw std::runtime_error("invalid command line arguments: expected a value after '" + arg + "'");
+				return argv[iarg];
+			};
+
+			if (arg == "--pgn")
+				result.pgnFiles.push_back(next());
+			else if (arg == "--cache")
+				result.cacheFile = next();
+			else if (arg == "--weights")
+				result.initialWeightsFile = next();
+			else if (arg == "--out")
+				result.outputFile = next();
+			else if (arg == "--threads")
+				result.tuning.threads = std::stoi(next());
+			else if (arg == "--epochs")
+				result.tuning.epochs = std::stoi(next());
+			else if (arg == "--batch")
+				result.tuning.batchSize = std::stoul(next());
+			else if (arg == "--skipPlies")
+				result.tuning.skipPlies = std::stoi(next());
+			else if (arg == "--learningRate")
+				result.tuning.learningRate = std::stod(next());
+			else if (arg == "--scale")
+				result.tuning.scale = std::stod(next());
+			else if (arg == "--help" || arg == "-h")
+			{
+				printUsage(argv[0]);
+				std::exit(0);
+			}
+			else
+				throw std::runtime_error("invalid command line arguments: unknown option '" + arg + "'");
+		}
+		return result;
+	}
+}
+
+int main(int argc, char const * const * const argv) {
+	Options options = parseOptions(argc, argv);
+
+	auto initial = options.initialWeightsFile.empty()
+		? space::AlgoGeneric::getDefaultWeights()
+		: space::AlgoGeneric::loadWeights(options.initialWeightsFile);
+	space::TexelTuner tuner(initial, options.tuning);
+
+	for (std::size_t i = 0; i < options.pgnFiles.size(); ++i)
+	{
+		space::PGNReader pgn(options.pgnFiles[i]); // mapped into memory, throws when it cannot be opened
+		std::size_t positions = tuner.extract(pgn, options.cacheFile, i > 0);
+		std::cout << options.pgnFiles[i] << ": " << positions << " positions" << std::endl;
+	}
+
+	std::cout << "Initial loss " << tuner.loss(options.cacheFile) << std::endl;
+	auto start = std::chrono::steady_clock::now();
+	tuner.fit(options.cacheFile, [&start](int epoch, double loss) {
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		std::cout << "Epoch " << epoch + 1 << ": loss " << loss << " (" << elapsed.count() << " s)" << std::endl;
+	});
+	std::cout << "Final loss " << tuner.loss(options.cacheFile) << std::endl;
+
+	space::AlgoGeneric::saveWeights(tuner.getWeights(), options.outputFile);
+	std::cout << "Weights written to " << options.outputFile << std::endl;
+	return 0;
+}